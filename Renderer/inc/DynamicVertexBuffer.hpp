@@ -0,0 +1,129 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+// Vertex data rewritten every frame. The buffer holds REGION_COUNT copies of
+// the data and stays mapped for its whole life (ARB_buffer_storage), so the
+// CPU writes one region while the GPU is still reading the frames before it
+// from the others, and nothing waits on an implicit synchronization. A fence
+// after each frame's draws says when its region can be written again
+class DynamicVertexBuffer {
+ public:
+  static const unsigned REGION_COUNT = 3;
+
+  DynamicVertexBuffer(size_t regionSize)
+      : regionSize_(align(std::max<size_t>(regionSize, 1))),
+        region_(0),
+        frameCount_(0),
+        stallCount_(0) {
+    if (!GLEW_ARB_buffer_storage) {
+      throw std::runtime_error(
+          "Dynamic geometry needs ARB_buffer_storage, which this GL does not "
+          "support");
+    }
+
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+    glBufferStorage(GL_ARRAY_BUFFER, REGION_COUNT * regionSize_, NULL, flags);
+    mapping_ = static_cast<char*>(glMapBufferRange(
+        GL_ARRAY_BUFFER, 0, REGION_COUNT * regionSize_, flags));
+    if (mapping_ == NULL) {
+      glDeleteBuffers(1, &buffer_);
+      throw std::runtime_error("Failed to map the dynamic vertex buffer");
+    }
+
+    std::fill(fences_, fences_ + REGION_COUNT, GLsync(0));
+  }
+
+  DynamicVertexBuffer(const DynamicVertexBuffer&) = delete;
+  DynamicVertexBuffer& operator=(const DynamicVertexBuffer&) = delete;
+
+  // The GL keeps the storage alive until draws already issued from it are
+  // done
+  ~DynamicVertexBuffer() {
+    for (GLsync fence : fences_) {
+      if (fence) {
+        glDeleteSync(fence);
+      }
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glDeleteBuffers(1, &buffer_);
+  }
+
+  GLuint getBuffer() const {
+    return buffer_;
+  }
+
+  // Waits until the GPU has finished with the current region, and returns
+  // where this frame's data goes. The memory is write-combined: write it in
+  // order, and never read it back
+  void* beginFrame() {
+    GLsync& fence = fences_[region_];
+    if (fence) {
+      if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        ++stallCount_;
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                WAIT_TIMEOUT_NANOSECONDS) ==
+               GL_TIMEOUT_EXPIRED) {
+        }
+      }
+
+      glDeleteSync(fence);
+      fence = 0;
+    }
+
+    return mapping_ + getRegionOffset();
+  }
+
+  // Where, in the buffer, the current region starts; attribute pointers for
+  // this frame's draws are offset by it
+  size_t getRegionOffset() const {
+    return region_ * regionSize_;
+  }
+
+  // Call after the draws that read this frame's data have been issued
+  void endFrame() {
+    fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region_ = (region_ + 1) % REGION_COUNT;
+    ++frameCount_;
+  }
+
+  uint64_t getFrameCount() const {
+    return frameCount_;
+  }
+
+  // Bytes allocated, for all the regions
+  size_t getSize() const {
+    return REGION_COUNT * regionSize_;
+  }
+
+  // Frames in which the CPU caught up with the GPU and had to wait for a
+  // region to come free
+  uint64_t getStallCount() const {
+    return stallCount_;
+  }
+
+ private:
+  static const GLuint64 WAIT_TIMEOUT_NANOSECONDS = 1000000000;
+
+  GLuint buffer_;
+  char* mapping_;
+  size_t regionSize_;
+  unsigned region_;
+  GLsync fences_[REGION_COUNT];
+  uint64_t frameCount_;
+  uint64_t stallCount_;
+
+  // Regions start on 256-byte boundaries
+  static size_t align(size_t size) {
+    return (size + 255) & ~size_t(255);
+  }
+};
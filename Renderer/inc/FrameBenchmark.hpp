@@ -0,0 +1,153 @@
+#pragma once
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <Eigen/Geometry>
+
+#include "Camera.hpp"
+#include "Model.hpp"
+
+// Times a fixed number of frames of a scripted scene: the model spins while
+// the camera orbits it and moves in and out. The script only depends on the
+// frame number, so runs of either viewer, on any machine, render the same
+// frames and their reports can be compared directly
+class FrameBenchmark {
+ public:
+  FrameBenchmark(unsigned frameCount) : frameCount_(frameCount), frame_(0) {
+    frameTimes_.reserve(frameCount);
+  }
+
+  unsigned getFrameCount() const {
+    return frameCount_;
+  }
+
+  void setLoadTime(double milliseconds) {
+    loadTime_ = milliseconds;
+  }
+
+  void setSetupTime(double milliseconds) {
+    setupTime_ = milliseconds;
+  }
+
+  void startScript(Camera& camera) {
+    camera.setCameraProjectionMode(Camera::CAMERA_PROJECTION_MODE::PERSPECTIVE);
+  }
+
+  // Moves the model (or anything else placed the same way, such as a scene)
+  // and camera on to the next frame of the script
+  template <typename Subject>
+  void advance(Subject& model, Camera& camera) {
+    const float PI = 3.14159265f;
+
+    float spin = SPIN_DEGREES * PI / 180;
+    model.rotate(Eigen::Quaternion<float>(std::cos(spin / 2), 0.0f,
+                                          std::sin(spin / 2), 0.0f));
+
+    //// Swing the camera up and down around the model, rather than around
+    //// the eye, and move it along its line of sight
+    float phase = 2 * PI * frame_ / ORBIT_PERIOD;
+    Eigen::Quaternion<float> orbit(Eigen::AngleAxis<float>(
+        ORBIT_DEGREES * PI / 180 * std::sin(phase),
+        Eigen::Vector3f::UnitX()));
+    camera.rotate(orbit * camera.getOrientation().inverse());
+
+    std::vector<float> modelPosition = model.getDisplacement();
+    Eigen::Vector3f target(modelPosition[0], modelPosition[1],
+                           modelPosition[2]);
+    Eigen::Vector3f position = target - orbit * target;
+    position[2] += DOLLY_DISTANCE * std::sin(phase);
+
+    std::vector<float> cameraPosition = camera.getDisplacement();
+    camera.translate(std::vector<float>{position[0] - cameraPosition[0],
+                                        position[1] - cameraPosition[1],
+                                        position[2] - cameraPosition[2]});
+
+    ++frame_;
+  }
+
+  void beginFrame() {
+    frameStart_ = std::chrono::steady_clock::now();
+  }
+
+  // The caller must have waited for the GPU to finish the frame
+  void endFrame() {
+    frameTimes_.push_back(std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - frameStart_)
+                              .count());
+  }
+
+  // Prints one JSON object; times are in milliseconds
+  void writeReport(std::ostream& outputStream, const std::string& viewerName,
+                   const std::string& modelFilePath) const {
+    std::vector<double> sortedFrameTimes = frameTimes_;
+    std::sort(sortedFrameTimes.begin(), sortedFrameTimes.end());
+
+    double totalFrameTime = 0.0;
+    for (double frameTime : sortedFrameTimes) {
+      totalFrameTime += frameTime;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    outputStream << "{\"viewer\": \"" << viewerName << "\", \"model\": \""
+                 << escape(modelFilePath)
+                 << "\", \"frames\": " << sortedFrameTimes.size()
+                 << ", \"loadTime\": " << loadTime_
+                 << ", \"setupTime\": " << setupTime_
+                 << ", \"frameTime\": {\"mean\": "
+                 << (sortedFrameTimes.empty()
+                         ? 0.0
+                         : totalFrameTime / sortedFrameTimes.size())
+                 << ", \"p50\": " << percentile(sortedFrameTimes, 50)
+                 << ", \"p95\": " << percentile(sortedFrameTimes, 95)
+                 << ", \"p99\": " << percentile(sortedFrameTimes, 99)
+                 << "}, \"peakResidentKilobytes\": " << usage.ru_maxrss << "}"
+                 << std::endl;
+  }
+
+ private:
+  static constexpr float SPIN_DEGREES = 2.0f;
+
+  // The camera swings this far either way, and comes this much closer and
+  // further, once every period
+  static constexpr float ORBIT_DEGREES = 30.0f;
+  static constexpr float DOLLY_DISTANCE = 0.75f;
+  static const unsigned ORBIT_PERIOD = 240;
+
+  unsigned frameCount_;
+  unsigned frame_;
+  double loadTime_ = 0.0;
+  double setupTime_ = 0.0;
+  std::chrono::steady_clock::time_point frameStart_;
+  std::vector<double> frameTimes_;
+
+  // Nearest rank
+  static double percentile(const std::vector<double>& sortedValues,
+                           unsigned percent) {
+    if (sortedValues.empty()) {
+      return 0.0;
+    }
+
+    size_t rank = (sortedValues.size() * percent + 99) / 100;
+    return sortedValues[std::max<size_t>(rank, 1) - 1];
+  }
+
+  static std::string escape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+      if (c == '"' || c == '\\') {
+        escaped += '\\';
+      }
+      escaped += c;
+    }
+
+    return escaped;
+  }
+};
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Times the named sections of each frame on the CPU and, where the GL has
+// timer queries, on the GPU, side by side; a section that takes longer on
+// the GPU than on the CPU is where the frame waits for the GPU. Each frame's
+// GL_TIME_ELAPSED queries are only read back once their results are
+// available, up to QUERY_RING_SIZE - 1 frames later, so reading them never
+// waits on the GPU; a frame still unfinished when its queries come round
+// again just goes without GPU times. Sections are one at a time, as timer
+// queries cannot overlap, and may be left out of a frame. The last finished
+// frames are averaged for an overlay, and every frame can be written to a
+// CSV trace, one line each
+class FrameProfiler {
+ public:
+  static const unsigned QUERY_RING_SIZE = 4;
+
+  // Frames averaged by getSummary
+  static const unsigned AVERAGE_FRAME_COUNT = 60;
+
+  FrameProfiler(const std::vector<std::string>& sectionNames,
+                const std::string& traceFilePath = "")
+      : sectionNames_(sectionNames),
+        hasGpuTimer_(GLEW_ARB_timer_query),
+        frame_(0),
+        section_(NO_SECTION),
+        droppedFrameCount_(0) {
+    if (sectionNames_.empty() || sectionNames_.size() > 32) {
+      throw std::runtime_error("Profile between 1 and 32 sections");
+    }
+
+    const size_t sectionCount = sectionNames_.size();
+    for (FrameRecord& frameRecord : frameRing_) {
+      frameRecord.cpuTimes.resize(sectionCount);
+      frameRecord.queries.resize(sectionCount);
+      if (hasGpuTimer_) {
+        glGenQueries(sectionCount, frameRecord.queries.data());
+      }
+    }
+
+    if (!traceFilePath.empty()) {
+      traceStream_.open(traceFilePath);
+      if (!traceStream_) {
+        throw std::runtime_error("Failed to open the profile trace " +
+                                 traceFilePath);
+      }
+
+      traceStream_ << "frame,frame cpu ms";
+      for (const std::string& sectionName : sectionNames_) {
+        traceStream_ << "," << sectionName << " cpu ms," << sectionName
+                     << " gpu ms";
+      }
+      traceStream_ << std::endl;
+    }
+  }
+
+  FrameProfiler(const FrameProfiler&) = delete;
+  FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+  // Frames still waiting on the GPU are dropped from the trace
+  ~FrameProfiler() {
+    if (hasGpuTimer_) {
+      for (FrameRecord& frameRecord : frameRing_) {
+        glDeleteQueries(frameRecord.queries.size(),
+                        frameRecord.queries.data());
+      }
+    }
+  }
+
+  bool hasGpuTimer() const {
+    return hasGpuTimer_;
+  }
+
+  void beginFrame() {
+    FrameRecord& frameRecord = frameRing_[frame_ % QUERY_RING_SIZE];
+
+    // Its queries are about to be reused; their results are lost if the GPU
+    // has not got to them yet
+    if (frameRecord.pending && !finishFrame(frameRecord, false)) {
+      ++droppedFrameCount_;
+      finishFrame(frameRecord, true);
+    }
+
+    frameRecord.frame = frame_;
+    frameRecord.sectionMask = 0;
+    frameRecord.frameStart = std::chrono::steady_clock::now();
+  }
+
+  void beginSection(unsigned section) {
+    FrameRecord& frameRecord = frameRing_[frame_ % QUERY_RING_SIZE];
+    if (section_ != NO_SECTION) {
+      throw std::runtime_error("Profiled sections cannot overlap");
+    }
+
+    section_ = section;
+    frameRecord.sectionMask |= uint32_t(1) << section;
+    if (hasGpuTimer_) {
+      glBeginQuery(GL_TIME_ELAPSED, frameRecord.queries[section]);
+    }
+    sectionStart_ = std::chrono::steady_clock::now();
+  }
+
+  void endSection() {
+    FrameRecord& frameRecord = frameRing_[frame_ % QUERY_RING_SIZE];
+    frameRecord.cpuTimes[section_] = millisecondsSince(sectionStart_);
+    if (hasGpuTimer_) {
+      glEndQuery(GL_TIME_ELAPSED);
+    }
+    section_ = NO_SECTION;
+  }
+
+  // Also reads back whichever earlier frames the GPU has finished, oldest
+  // first
+  void endFrame() {
+    FrameRecord& frameRecord = frameRing_[frame_ % QUERY_RING_SIZE];
+    frameRecord.frameTime = millisecondsSince(frameRecord.frameStart);
+    frameRecord.pending = true;
+    ++frame_;
+
+    uint64_t oldestFrame =
+        frame_ > QUERY_RING_SIZE ? frame_ - QUERY_RING_SIZE : 0;
+    for (uint64_t frame = oldestFrame; frame < frame_; ++frame) {
+      FrameRecord& earlierRecord = frameRing_[frame % QUERY_RING_SIZE];
+      if (earlierRecord.pending && !finishFrame(earlierRecord, false)) {
+        break;
+      }
+    }
+  }
+
+  // A line per section, and one for the whole frame: mean CPU and GPU
+  // milliseconds over the last frames finished
+  std::vector<std::string> getSummary() const {
+    Means means = getMeans();
+    std::vector<std::string> summary;
+    summary.push_back(formatLine("ms", "CPU", "GPU"));
+    for (size_t section = 0; section < sectionNames_.size(); ++section) {
+      summary.push_back(formatLine(sectionNames_[section],
+                                   formatTime(means.cpuTimes[section]),
+                                   formatTime(means.gpuTimes[section])));
+    }
+    summary.push_back(formatLine("frame", formatTime(means.frameTime), ""));
+    if (droppedFrameCount_ > 0) {
+      summary.push_back(std::to_string(droppedFrameCount_) +
+                        " frames without GPU times");
+    }
+
+    return summary;
+  }
+
+  // The same on one line, such as a window title
+  std::string getSummaryLine() const {
+    Means means = getMeans();
+    std::string summaryLine = "CPU/GPU ms:";
+    for (size_t section = 0; section < sectionNames_.size(); ++section) {
+      summaryLine += " " + sectionNames_[section] + " " +
+                     formatTime(means.cpuTimes[section]) + "/" +
+                     formatTime(means.gpuTimes[section]) + ",";
+    }
+    return summaryLine + " frame " + formatTime(means.frameTime);
+  }
+
+ private:
+  static const unsigned NO_SECTION = ~0u;
+
+  // A frame on its way through the ring
+  struct FrameRecord {
+    uint64_t frame = 0;
+    bool pending = false;
+    uint32_t sectionMask = 0;
+    std::chrono::steady_clock::time_point frameStart;
+    double frameTime = 0.0;
+    std::vector<double> cpuTimes;
+    std::vector<GLuint> queries;
+  };
+
+  // Negative times were not measured: the section was left out of the frame,
+  // or went without GPU times
+  struct FinishedFrame {
+    double frameTime;
+    std::vector<double> cpuTimes;
+    std::vector<double> gpuTimes;
+  };
+
+  // Each over the finished frames that have it; negative if none do
+  struct Means {
+    double frameTime = 0.0;
+    std::vector<double> cpuTimes;
+    std::vector<double> gpuTimes;
+  };
+
+  std::vector<std::string> sectionNames_;
+  bool hasGpuTimer_;
+  FrameRecord frameRing_[QUERY_RING_SIZE];
+  uint64_t frame_;
+  unsigned section_;
+  std::chrono::steady_clock::time_point sectionStart_;
+  std::deque<FinishedFrame> finishedFrames_;
+  uint64_t droppedFrameCount_;
+  std::ofstream traceStream_;
+
+  Means getMeans() const {
+    const size_t sectionCount = sectionNames_.size();
+    Means means;
+    means.cpuTimes.assign(sectionCount, 0.0);
+    means.gpuTimes.assign(sectionCount, 0.0);
+    std::vector<unsigned> cpuFrameCounts(sectionCount, 0);
+    std::vector<unsigned> gpuFrameCounts(sectionCount, 0);
+    for (const FinishedFrame& finishedFrame : finishedFrames_) {
+      means.frameTime += finishedFrame.frameTime;
+      for (size_t section = 0; section < sectionCount; ++section) {
+        addTime(finishedFrame.cpuTimes[section], means.cpuTimes[section],
+                cpuFrameCounts[section]);
+        addTime(finishedFrame.gpuTimes[section], means.gpuTimes[section],
+                gpuFrameCounts[section]);
+      }
+    }
+
+    means.frameTime /= std::max<size_t>(finishedFrames_.size(), 1);
+    for (size_t section = 0; section < sectionCount; ++section) {
+      means.cpuTimes[section] =
+          cpuFrameCounts[section] > 0
+              ? means.cpuTimes[section] / cpuFrameCounts[section]
+              : -1.0;
+      means.gpuTimes[section] =
+          gpuFrameCounts[section] > 0
+              ? means.gpuTimes[section] / gpuFrameCounts[section]
+              : -1.0;
+    }
+    return means;
+  }
+
+  static void addTime(double time, double& sum, unsigned& count) {
+    if (time >= 0.0) {
+      sum += time;
+      ++count;
+    }
+  }
+
+  // Returns false, leaving the frame pending, if its GPU times are not in
+  // yet, unless told to go without them
+  bool finishFrame(FrameRecord& frameRecord, bool withoutGpuTimes) {
+    const size_t sectionCount = sectionNames_.size();
+    FinishedFrame finishedFrame;
+    finishedFrame.frameTime = frameRecord.frameTime;
+    finishedFrame.cpuTimes.assign(sectionCount, -1.0);
+    finishedFrame.gpuTimes.assign(sectionCount, -1.0);
+
+    for (size_t section = 0; section < sectionCount; ++section) {
+      if (!(frameRecord.sectionMask & (uint32_t(1) << section))) {
+        continue;
+      }
+
+      finishedFrame.cpuTimes[section] = frameRecord.cpuTimes[section];
+      if (!hasGpuTimer_ || withoutGpuTimes) {
+        continue;
+      }
+
+      GLuint available = GL_FALSE;
+      glGetQueryObjectuiv(frameRecord.queries[section],
+                          GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) {
+        return false;
+      }
+
+      GLuint64 nanoseconds;
+      glGetQueryObjectui64v(frameRecord.queries[section], GL_QUERY_RESULT,
+                            &nanoseconds);
+      finishedFrame.gpuTimes[section] = nanoseconds / 1e6;
+    }
+
+    frameRecord.pending = false;
+    if (traceStream_.is_open()) {
+      writeTraceLine(frameRecord.frame, finishedFrame);
+    }
+
+    // Drivers do their lazy setup in the first frame, which can throw its
+    // times far out (llvmpipe's first clear takes hours, by its queries), so
+    // it is only traced
+    if (frameRecord.frame > 0) {
+      finishedFrames_.push_back(std::move(finishedFrame));
+      if (finishedFrames_.size() > AVERAGE_FRAME_COUNT) {
+        finishedFrames_.pop_front();
+      }
+    }
+    return true;
+  }
+
+  // Times not measured are left empty
+  void writeTraceLine(uint64_t frame, const FinishedFrame& finishedFrame) {
+    traceStream_ << frame << "," << finishedFrame.frameTime;
+    for (size_t section = 0; section < sectionNames_.size(); ++section) {
+      for (double time : {finishedFrame.cpuTimes[section],
+                          finishedFrame.gpuTimes[section]}) {
+        traceStream_ << ",";
+        if (time >= 0.0) {
+          traceStream_ << time;
+        }
+      }
+    }
+    traceStream_ << "\n";
+  }
+
+  // Negative times were not measured
+  static std::string formatTime(double milliseconds) {
+    if (milliseconds < 0.0) {
+      return "-";
+    }
+
+    char text[16];
+    std::snprintf(text, sizeof(text), "%.3f", milliseconds);
+    return text;
+  }
+
+  static std::string formatLine(const std::string& name,
+                                const std::string& cpuTime,
+                                const std::string& gpuTime) {
+    char text[64];
+    std::snprintf(text, sizeof(text), "%-8.8s %9s %9s", name.c_str(),
+                  cpuTime.c_str(), gpuTime.c_str());
+    return text;
+  }
+
+  static double millisecondsSince(
+      std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+};
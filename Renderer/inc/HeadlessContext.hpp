@@ -0,0 +1,119 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <stdexcept>
+
+// An OpenGL context with no window or display server behind it (EGL on Mesa's
+// surfaceless platform), rendering into a framebuffer object of its own. Lets
+// the viewers run on machines without a GPU or X server, such as CI boxes,
+// where Mesa falls back to its software rasterizer
+class HeadlessContext {
+ public:
+  // A compatibility profile context of at least 3.0, or a 3.3 core profile
+  // one
+  HeadlessContext(int width, int height, bool coreProfile = false) {
+    display_ = getDisplay();
+    if (display_ == EGL_NO_DISPLAY || !eglInitialize(display_, NULL, NULL)) {
+      throw std::runtime_error("Failed to initialize an EGL display");
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+      eglTerminate(display_);
+      throw std::runtime_error("EGL does not support desktop OpenGL");
+    }
+
+    // No window surface; the default configuration asks for one
+    const EGLint configAttributes[] = {EGL_SURFACE_TYPE, 0,
+                                       EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                       EGL_NONE};
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display_, configAttributes, &config, 1,
+                         &configCount) ||
+        configCount == 0) {
+      eglTerminate(display_);
+      throw std::runtime_error("Failed to choose an EGL configuration");
+    }
+
+    // The profiles the viewers ask GLUT for. Drivers give a compatibility
+    // context of their newest version, which the scene viewer checks is at
+    // least the 3.3 it asks GLUT for
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION,
+        3,
+        EGL_CONTEXT_MINOR_VERSION,
+        coreProfile ? 3 : 0,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK,
+        coreProfile ? EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT
+                    : EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+        EGL_NONE};
+    context_ =
+        eglCreateContext(display_, config, EGL_NO_CONTEXT, contextAttributes);
+    if (context_ == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, context_)) {
+      eglTerminate(display_);
+      throw std::runtime_error("Failed to create a surfaceless GL context");
+    }
+
+    // GLEW's own initialization also looks for an X display, which fails
+    // here after the GL entry points have been loaded; that part is not
+    // needed
+    glewExperimental = GL_TRUE;
+    glewInit();
+
+    //// Color and depth attachments stand in for the window
+    glGenRenderbuffers(2, renderbuffers_);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers_[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers_[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+    glGenFramebuffers(1, &framebuffer_);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, renderbuffers_[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, renderbuffers_[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      throw std::runtime_error("Failed to create an offscreen framebuffer");
+    }
+
+    glViewport(0, 0, width, height);
+  }
+
+  HeadlessContext(const HeadlessContext&) = delete;
+  HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+  ~HeadlessContext() {
+    glDeleteFramebuffers(1, &framebuffer_);
+    glDeleteRenderbuffers(2, renderbuffers_);
+
+    eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display_, context_);
+    eglTerminate(display_);
+  }
+
+ private:
+  EGLDisplay display_;
+  EGLContext context_;
+  GLuint framebuffer_;
+  GLuint renderbuffers_[2];
+
+  static EGLDisplay getDisplay() {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+            "eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay != NULL) {
+      EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                              EGL_DEFAULT_DISPLAY, NULL);
+      if (display != EGL_NO_DISPLAY) {
+        return display;
+      }
+    }
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+};
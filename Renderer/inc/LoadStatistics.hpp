@@ -0,0 +1,241 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Model.hpp"
+
+// Where the time went while a model was loaded and set up, and what it left
+// behind: counts (faces, triangles...), memory held (by each of the model's
+// containers, or GL buffers) and bytes uploaded to GL, by name. Each kind is
+// listed in the order its names first came up, and a phase timed more than
+// once adds up, so that a phase split across frames reads as one.
+// ModelFactory fills in the load, and the viewers add their setup. Threads
+// may record at the same time
+class LoadStatistics {
+ public:
+  // Adds its lifetime to the phase, or to each phase in turn
+  class ScopedTimer {
+   public:
+    ScopedTimer(LoadStatistics& loadStatistics, const std::string& phase)
+        : loadStatistics_(loadStatistics),
+          phase_(phase),
+          start_(std::chrono::steady_clock::now()) {
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    ~ScopedTimer() {
+      stop();
+    }
+
+    // Ends the phase, and times the next one from here
+    void startPhase(const std::string& phase) {
+      stop();
+      phase_ = phase;
+      start_ = std::chrono::steady_clock::now();
+    }
+
+   private:
+    void stop() {
+      loadStatistics_.addTime(
+          phase_, std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start_)
+                      .count());
+    }
+
+    LoadStatistics& loadStatistics_;
+    std::string phase_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  LoadStatistics() {
+  }
+
+  LoadStatistics(const LoadStatistics& other) {
+    std::lock_guard<std::mutex> lock(other.mutex_);
+    copyEntries(other);
+  }
+
+  LoadStatistics& operator=(const LoadStatistics& other) {
+    if (this != &other) {
+      std::scoped_lock lock(mutex_, other.mutex_);
+      copyEntries(other);
+    }
+    return *this;
+  }
+
+  void addTime(const std::string& phase, double milliseconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& entry = findEntry(phases_, phase);
+    entry.value += milliseconds;
+    ++entry.count;
+  }
+
+  void addCount(const std::string& name, uint64_t count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    findEntry(counts_, name).value += count;
+  }
+
+  // Replaces what was recorded before under the name, as memory is held
+  // rather than accumulated
+  void setMemory(const std::string& name, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    findEntry(memory_, name).value = bytes;
+  }
+
+  void addUpload(const std::string& name, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& entry = findEntry(uploads_, name);
+    entry.value += bytes;
+    ++entry.count;
+  }
+
+  // What each of the model's containers holds, as Model::getMemoryUsage
+  // counts it
+  void setModelMemory(const Model& model) {
+    Model::MemoryUsage memoryUsage = model.getMemoryUsage();
+    setMemory("model vertices", memoryUsage.vertexBytes);
+    setMemory("model colors", memoryUsage.colorBytes);
+    setMemory("model normals", memoryUsage.normalBytes);
+    setMemory("model indices", memoryUsage.indexBytes);
+    setMemory("model levels of detail", memoryUsage.levelOfDetailBytes);
+    setMemory("model, other", memoryUsage.otherBytes);
+  }
+
+  // A table per kind, for people
+  void writeReport(std::ostream& outputStream,
+                   const std::string& modelFilePath) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ios::fmtflags flags = outputStream.flags();
+    std::streamsize precision = outputStream.precision();
+    outputStream << std::fixed;
+
+    outputStream << "Load statistics for " << modelFilePath << ":"
+                 << std::endl;
+    writeTable(outputStream, "Time (ms)", phases_, 1.0, 1, true);
+    writeTable(outputStream, "Counts", counts_, 1.0, 0, false);
+    writeTable(outputStream, "Memory held (MB)", memory_, MEGABYTE, 2, false);
+    writeTable(outputStream, "Uploaded to GL (MB)", uploads_, MEGABYTE, 2,
+               true);
+
+    outputStream.flags(flags);
+    outputStream.precision(precision);
+  }
+
+  // One JSON object; times are in milliseconds and sizes in bytes
+  void writeJson(std::ostream& outputStream,
+                 const std::string& modelFilePath) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    outputStream << "{\"model\": \"" << escape(modelFilePath)
+                 << "\", \"phases\": {";
+    for (size_t i = 0; i < phases_.size(); ++i) {
+      outputStream << (i > 0 ? ", " : "") << "\"" << escape(phases_[i].name)
+                   << "\": {\"time\": " << phases_[i].value
+                   << ", \"runs\": " << phases_[i].count << "}";
+    }
+
+    outputStream << "}, \"counts\": ";
+    writeJsonValues(outputStream, counts_);
+    outputStream << ", \"memory\": ";
+    writeJsonValues(outputStream, memory_);
+
+    outputStream << ", \"uploads\": {";
+    for (size_t i = 0; i < uploads_.size(); ++i) {
+      outputStream << (i > 0 ? ", " : "") << "\"" << escape(uploads_[i].name)
+                   << "\": {\"bytes\": " << uint64_t(uploads_[i].value)
+                   << ", \"calls\": " << uploads_[i].count << "}";
+    }
+    outputStream << "}}" << std::endl;
+  }
+
+ private:
+  static constexpr double MEGABYTE = 1 << 20;
+
+  // A sum, and how many times it was added to
+  struct Entry {
+    std::string name;
+    double value = 0.0;
+    uint64_t count = 0;
+  };
+
+  mutable std::mutex mutex_;
+  std::vector<Entry> phases_;
+  std::vector<Entry> counts_;
+  std::vector<Entry> memory_;
+  std::vector<Entry> uploads_;
+
+  void copyEntries(const LoadStatistics& other) {
+    phases_ = other.phases_;
+    counts_ = other.counts_;
+    memory_ = other.memory_;
+    uploads_ = other.uploads_;
+  }
+
+  // A handful of names each, so a search beats a map
+  static Entry& findEntry(std::vector<Entry>& entries,
+                          const std::string& name) {
+    for (Entry& entry : entries) {
+      if (entry.name == name) {
+        return entry;
+      }
+    }
+
+    entries.emplace_back();
+    entries.back().name = name;
+    return entries.back();
+  }
+
+  static void writeTable(std::ostream& outputStream, const std::string& title,
+                         const std::vector<Entry>& entries, double unit,
+                         int precision, bool showCount) {
+    if (entries.empty()) {
+      return;
+    }
+
+    size_t nameWidth = 0;
+    for (const Entry& entry : entries) {
+      nameWidth = std::max(nameWidth, entry.name.size());
+    }
+
+    outputStream << "  " << title << ":" << std::endl;
+    for (const Entry& entry : entries) {
+      outputStream << "    " << std::left << std::setw(nameWidth)
+                   << entry.name << std::right << std::setw(14)
+                   << std::setprecision(precision) << entry.value / unit;
+      if (showCount && entry.count > 1) {
+        outputStream << " (" << entry.count << " times)";
+      }
+      outputStream << std::endl;
+    }
+  }
+
+  static void writeJsonValues(std::ostream& outputStream,
+                              const std::vector<Entry>& entries) {
+    outputStream << "{";
+    for (size_t i = 0; i < entries.size(); ++i) {
+      outputStream << (i > 0 ? ", " : "") << "\"" << escape(entries[i].name)
+                   << "\": " << uint64_t(entries[i].value);
+    }
+    outputStream << "}";
+  }
+
+  static std::string escape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+      if (c == '"' || c == '\\') {
+        escaped += '\\';
+      }
+      escaped += c;
+    }
+
+    return escaped;
+  }
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+// Hands items from one thread to another through a single slot, without
+// locks: posting swaps the new item in, and taking swaps the slot empty. An
+// item that is not taken before the next one is posted is dropped, so the
+// receiver only ever sees the latest
+template <typename T>
+class Mailbox {
+ public:
+  static_assert(std::atomic<T*>::is_always_lock_free,
+                "Mailbox requires lock-free atomic pointers");
+
+  Mailbox() : slot_(nullptr) {
+  }
+
+  Mailbox(const Mailbox&) = delete;
+  Mailbox& operator=(const Mailbox&) = delete;
+
+  ~Mailbox() {
+    delete slot_.exchange(nullptr);
+  }
+
+  void post(std::unique_ptr<T> item) {
+    delete slot_.exchange(item.release(), std::memory_order_acq_rel);
+  }
+
+  // Null if nothing has been posted since the last take
+  std::unique_ptr<T> take() {
+    return std::unique_ptr<T>(
+        slot_.exchange(nullptr, std::memory_order_acq_rel));
+  }
+
+  bool isEmpty() const {
+    return slot_.load(std::memory_order_acquire) == nullptr;
+  }
+
+ private:
+  std::atomic<T*> slot_;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdexcept>
+#include <string>
+
+// Read-only memory mapping of a whole file; the contents stay valid for the
+// lifetime of the object
+class MappedFile {
+ public:
+  MappedFile(const std::string& filePath) {
+    int fileDescriptor = open(filePath.c_str(), O_RDONLY);
+    if (fileDescriptor < 0) {
+      throw std::runtime_error("Failed to open file for mapping: " + filePath);
+    }
+
+    struct stat fileStatus;
+    if (fstat(fileDescriptor, &fileStatus) != 0) {
+      close(fileDescriptor);
+      throw std::runtime_error("Failed to stat file for mapping: " + filePath);
+    }
+
+    size_ = fileStatus.st_size;
+
+    // mmap rejects zero-length mappings; an empty file is simply empty
+    if (size_ > 0) {
+      void* mapping =
+          mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+      if (mapping == MAP_FAILED) {
+        close(fileDescriptor);
+        throw std::runtime_error("Failed to map file: " + filePath);
+      }
+
+      data_ = static_cast<const char*>(mapping);
+      madvise(mapping, size_, MADV_SEQUENTIAL);
+    }
+
+    close(fileDescriptor);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+  }
+
+  const char* begin() const {
+    return data_;
+  }
+
+  const char* end() const {
+    return data_ + size_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
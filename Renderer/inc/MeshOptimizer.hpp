@@ -0,0 +1,295 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#include "Model.hpp"
+
+// Reorders a model's triangles for the GPU's post-transform vertex cache (Tom
+// Forsyth's linear-speed vertex cache optimisation), then renumbers its
+// vertices in the order the triangles first use them, so that vertex fetches
+// walk memory front to back; levels of detail are reordered too. The ACMR
+// (average cache miss ratio: transformed vertices per triangle) of a
+// simulated FIFO cache is recorded before and after
+class MeshOptimizer {
+ public:
+  // Size of the FIFO cache simulated for ACMR; typical of current hardware
+  static const unsigned SIMULATED_CACHE_SIZE = 16;
+
+  MeshOptimizer(Model& modelData) {
+    std::vector<uint32_t>& indices = modelData.getIndices();
+    const size_t vertexCount = modelData.getVertices().size() / 3;
+
+    acmrBefore_ = computeAcmr(indices, vertexCount);
+    for (size_t level = 0; level < modelData.getLevelOfDetailCount();
+         ++level) {
+      optimizeTriangleOrder(modelData.getLevelOfDetailIndices(level),
+                            vertexCount);
+    }
+    optimizeVertexOrder(modelData);
+    acmrAfter_ = computeAcmr(indices, vertexCount);
+
+    modelData.setVertexCacheOptimized(true);
+  }
+
+  float getAcmrBefore() const {
+    return acmrBefore_;
+  }
+
+  float getAcmrAfter() const {
+    return acmrAfter_;
+  }
+
+  static float computeAcmr(const std::vector<uint32_t>& indices,
+                           size_t vertexCount,
+                           unsigned cacheSize = SIMULATED_CACHE_SIZE) {
+    if (indices.empty()) {
+      return 0.0f;
+    }
+
+    // A vertex is cached if it entered the FIFO within the last cacheSize
+    // misses
+    std::vector<size_t> entryTime(vertexCount, 0);
+    size_t misses = 0;
+    for (uint32_t index : indices) {
+      if (entryTime[index] == 0 || misses - entryTime[index] >= cacheSize) {
+        ++misses;
+        entryTime[index] = misses;
+      }
+    }
+
+    return float(misses) / (indices.size() / 3);
+  }
+
+ private:
+  static const int MAX_CACHE_SIZE = 32;
+  static const int MAX_VALENCE_SCORED = 32;
+
+  float acmrBefore_;
+  float acmrAfter_;
+
+  static float computeVertexScore(int cachePosition,
+                                  unsigned remainingValence) {
+    if (remainingValence == 0) {
+      // No triangle left to use this vertex
+      return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+      if (cachePosition < 3) {
+        // Used by the last triangle; deliberately not the best choice, so
+        // that strips do not form
+        score = 0.75f;
+      } else {
+        const float scaler = 1.0f / (MAX_CACHE_SIZE - 3);
+        score = std::pow(1.0f - (cachePosition - 3) * scaler, 1.5f);
+      }
+    }
+
+    // Favour vertices with few triangles left, to clear them out of the way
+    score += 2.0f * std::pow(float(remainingValence), -0.5f);
+    return score;
+  }
+
+  static void optimizeTriangleOrder(std::vector<uint32_t>& indices,
+                                    size_t vertexCount) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+      return;
+    }
+
+    //// Tabulate the score function
+    float cacheScores[MAX_CACHE_SIZE + 1][MAX_VALENCE_SCORED + 1];
+    for (int position = -1; position < MAX_CACHE_SIZE; ++position) {
+      for (int valence = 0; valence <= MAX_VALENCE_SCORED; ++valence) {
+        cacheScores[position + 1][valence] =
+            computeVertexScore(position, valence);
+      }
+    }
+
+    auto score = [&](int cachePosition, unsigned remainingValence) {
+      if (remainingValence > MAX_VALENCE_SCORED) {
+        return computeVertexScore(cachePosition, remainingValence);
+      }
+
+      return cacheScores[cachePosition + 1][remainingValence];
+    };
+
+    //// Vertex to triangle adjacency, as offsets into one flat array; each
+    //// vertex's list shrinks as its triangles are emitted
+    std::vector<uint32_t> remainingValence(vertexCount, 0);
+    for (uint32_t index : indices) {
+      ++remainingValence[index];
+    }
+
+    std::vector<size_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < vertexCount; ++i) {
+      adjacencyOffsets[i + 1] = adjacencyOffsets[i] + remainingValence[i];
+    }
+
+    std::vector<uint32_t> adjacentTriangles(indices.size());
+    std::vector<size_t> fill(adjacencyOffsets.begin(),
+                             adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+      adjacentTriangles[fill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i) {
+      vertexScores[i] = score(-1, remainingValence[i]);
+    }
+
+    std::vector<bool> triangleEmitted(triangleCount, false);
+
+    std::vector<uint32_t> optimizedIndices;
+    optimizedIndices.reserve(indices.size());
+
+    std::vector<uint32_t> cache, nextCache;
+    cache.reserve(MAX_CACHE_SIZE + 3);
+    nextCache.reserve(MAX_CACHE_SIZE + 3);
+
+    long bestTriangle = -1;
+    size_t scanCursor = 0;
+    for (size_t emitted = 0; emitted < triangleCount; ++emitted) {
+      if (bestTriangle < 0) {
+        // Nothing adjacent to the cache is left; restart at the next triangle
+        // not yet emitted
+        while (triangleEmitted[scanCursor]) {
+          ++scanCursor;
+        }
+
+        bestTriangle = scanCursor;
+      }
+
+      const uint32_t* triangle = &indices[3 * bestTriangle];
+      optimizedIndices.insert(optimizedIndices.end(), triangle, triangle + 3);
+      triangleEmitted[bestTriangle] = true;
+
+      // Remove the triangle from its vertices' adjacency lists
+      for (int corner = 0; corner < 3; ++corner) {
+        const uint32_t vertex = triangle[corner];
+        uint32_t* begin = &adjacentTriangles[adjacencyOffsets[vertex]];
+        uint32_t* end = begin + remainingValence[vertex];
+        for (uint32_t* it = begin; it < end; ++it) {
+          if (*it == bestTriangle) {
+            *it = end[-1];
+            --remainingValence[vertex];
+            break;
+          }
+        }
+      }
+
+      //// The triangle's vertices move to the front of the cache
+      nextCache.clear();
+      for (int corner = 0; corner < 3; ++corner) {
+        // Degenerate triangles repeat a vertex
+        if (std::find(nextCache.begin(), nextCache.end(), triangle[corner]) ==
+            nextCache.end()) {
+          nextCache.push_back(triangle[corner]);
+        }
+      }
+
+      for (uint32_t vertex : cache) {
+        if (vertex != triangle[0] && vertex != triangle[1] &&
+            vertex != triangle[2]) {
+          nextCache.push_back(vertex);
+        }
+      }
+
+      for (size_t i = MAX_CACHE_SIZE; i < nextCache.size(); ++i) {
+        // Fell out of the cache
+        vertexScores[nextCache[i]] =
+            score(-1, remainingValence[nextCache[i]]);
+      }
+
+      if (nextCache.size() > MAX_CACHE_SIZE) {
+        nextCache.resize(MAX_CACHE_SIZE);
+      }
+
+      std::swap(cache, nextCache);
+      for (size_t i = 0; i < cache.size(); ++i) {
+        vertexScores[cache[i]] = score(i, remainingValence[cache[i]]);
+      }
+
+      //// Rescore the triangles touching the cache and pick the best one
+      bestTriangle = -1;
+      float bestScore = -1.0f;
+      for (uint32_t vertex : cache) {
+        const uint32_t* begin = &adjacentTriangles[adjacencyOffsets[vertex]];
+        const uint32_t* end = begin + remainingValence[vertex];
+        for (const uint32_t* it = begin; it < end; ++it) {
+          const uint32_t* candidate = &indices[3 * *it];
+          float candidateScore = vertexScores[candidate[0]] +
+                                 vertexScores[candidate[1]] +
+                                 vertexScores[candidate[2]];
+          if (candidateScore > bestScore) {
+            bestScore = candidateScore;
+            bestTriangle = *it;
+          }
+        }
+      }
+    }
+
+    indices.swap(optimizedIndices);
+  }
+
+  static void optimizeVertexOrder(Model& modelData) {
+    std::vector<uint32_t>& indices = modelData.getIndices();
+    std::vector<float>& vertices = modelData.getVertices();
+    const size_t vertexCount = vertices.size() / 3;
+
+    //// Number vertices in order of first use; unused ones go last
+    const uint32_t unassigned = UINT32_MAX;
+    std::vector<uint32_t> remap(vertexCount, unassigned);
+    uint32_t nextVertex = 0;
+    for (uint32_t& index : indices) {
+      if (remap[index] == unassigned) {
+        remap[index] = nextVertex++;
+      }
+
+      index = remap[index];
+    }
+
+    for (size_t i = 0; i < vertexCount; ++i) {
+      if (remap[i] == unassigned) {
+        remap[i] = nextVertex++;
+      }
+    }
+
+    // Coarser levels share the vertices
+    for (size_t level = 1; level < modelData.getLevelOfDetailCount();
+         ++level) {
+      for (uint32_t& index : modelData.getLevelOfDetailIndices(level)) {
+        index = remap[index];
+      }
+    }
+
+    std::vector<float> reorderedVertices(vertices.size());
+    for (size_t i = 0; i < vertexCount; ++i) {
+      std::copy(&vertices[3 * i], &vertices[3 * i] + 3,
+                &reorderedVertices[3 * remap[i]]);
+    }
+    vertices.swap(reorderedVertices);
+
+    // Colors and normals, where the model has them, move with their vertices
+    for (std::vector<float>* attributes :
+         {&modelData.getColors(), &modelData.getNormals()}) {
+      if (attributes->empty()) {
+        continue;
+      }
+
+      std::vector<float> reorderedAttributes(attributes->size());
+      for (size_t i = 0; i < vertexCount; ++i) {
+        std::copy(&(*attributes)[3 * i], &(*attributes)[3 * i] + 3,
+                  &reorderedAttributes[3 * remap[i]]);
+      }
+      attributes->swap(reorderedAttributes);
+    }
+
+    modelData.invalidateBounds();
+  }
+};
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Quadric error metric simplification (Garland and Heckbert). Edges collapse
+// onto one of their own endpoints, so every simplified level indexes the same
+// vertex array as the original mesh and only the index lists differ
+class MeshSimplifier {
+ public:
+  MeshSimplifier(const std::vector<float>& vertices)
+      : vertices_(vertices), vertexCount_(vertices.size() / 3) {
+  }
+
+  // Returns a triangle list with at most targetTriangleCount triangles, or as
+  // close to it as the collapses allowed by the flip check can get
+  std::vector<uint32_t> simplify(const std::vector<uint32_t>& indices,
+                                 size_t targetTriangleCount) const {
+    std::vector<uint32_t> currentIndices = indices;
+
+    // Each pass collapses a batch of the cheapest edges whose neighbourhoods
+    // do not overlap, then rebuilds the index list
+    while (currentIndices.size() / 3 > targetTriangleCount) {
+      size_t previousSize = currentIndices.size();
+      runCollapsePass(currentIndices, targetTriangleCount);
+
+      // Give up once a pass barely helps
+      if (currentIndices.size() > previousSize - previousSize / 50) {
+        break;
+      }
+    }
+
+    return currentIndices;
+  }
+
+ private:
+  // Symmetric 4x4 matrix, stored as its upper triangle
+  struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0,
+           cd = 0, d2 = 0;
+
+    void addPlane(double a, double b, double c, double d, double weight) {
+      a2 += weight * a * a;
+      ab += weight * a * b;
+      ac += weight * a * c;
+      ad += weight * a * d;
+      b2 += weight * b * b;
+      bc += weight * b * c;
+      bd += weight * b * d;
+      c2 += weight * c * c;
+      cd += weight * c * d;
+      d2 += weight * d * d;
+    }
+
+    void add(const Quadric& other) {
+      a2 += other.a2;
+      ab += other.ab;
+      ac += other.ac;
+      ad += other.ad;
+      b2 += other.b2;
+      bc += other.bc;
+      bd += other.bd;
+      c2 += other.c2;
+      cd += other.cd;
+      d2 += other.d2;
+    }
+
+    double evaluate(const float* p) const {
+      double x = p[0], y = p[1], z = p[2];
+      return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x +
+             b2 * y * y + 2 * bc * y * z + 2 * bd * y + c2 * z * z +
+             2 * cd * z + d2;
+    }
+  };
+
+  struct Collapse {
+    uint32_t from, to;
+    double cost;
+  };
+
+  // Boundary edges are held in place by planes this much heavier than the
+  // faces'
+  static constexpr double BOUNDARY_WEIGHT = 10.0;
+
+  const std::vector<float>& vertices_;
+  const size_t vertexCount_;
+
+  const float* position(uint32_t vertex) const {
+    return &vertices_[3 * vertex];
+  }
+
+  static void cross(const double* u, const double* v, double* result) {
+    result[0] = u[1] * v[2] - u[2] * v[1];
+    result[1] = u[2] * v[0] - u[0] * v[2];
+    result[2] = u[0] * v[1] - u[1] * v[0];
+  }
+
+  void computeNormal(uint32_t i0, uint32_t i1, uint32_t i2,
+                     double* normal) const {
+    const float *p0 = position(i0), *p1 = position(i1), *p2 = position(i2);
+    double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    cross(e1, e2, normal);
+  }
+
+  void runCollapsePass(std::vector<uint32_t>& indices,
+                       size_t targetTriangleCount) const {
+    const size_t triangleCount = indices.size() / 3;
+
+    //// Vertex to triangle adjacency, for the flip check
+    std::vector<uint32_t> adjacencyOffsets(vertexCount_ + 1, 0);
+    for (uint32_t index : indices) {
+      ++adjacencyOffsets[index + 1];
+    }
+    for (size_t i = 0; i < vertexCount_; ++i) {
+      adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+    }
+
+    std::vector<uint32_t> adjacentTriangles(indices.size());
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(),
+                               adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+      adjacentTriangles[fill[indices[i]]++] = i / 3;
+    }
+
+    //// Face quadrics, weighted by area
+    std::vector<Quadric> quadrics(vertexCount_);
+    for (size_t t = 0; t < triangleCount; ++t) {
+      const uint32_t* triangle = &indices[3 * t];
+      double normal[3];
+      computeNormal(triangle[0], triangle[1], triangle[2], normal);
+      double length = std::sqrt(normal[0] * normal[0] +
+                                normal[1] * normal[1] + normal[2] * normal[2]);
+      if (length == 0.0) {
+        continue;
+      }
+
+      double a = normal[0] / length, b = normal[1] / length,
+             c = normal[2] / length;
+      const float* p0 = position(triangle[0]);
+      double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+      for (int corner = 0; corner < 3; ++corner) {
+        quadrics[triangle[corner]].addPlane(a, b, c, d, length * 0.5);
+      }
+    }
+
+    //// Unique edges; an edge seen once lies on the boundary
+    std::vector<uint64_t> edges;
+    edges.reserve(indices.size());
+    for (size_t t = 0; t < triangleCount; ++t) {
+      for (int corner = 0; corner < 3; ++corner) {
+        uint32_t u = indices[3 * t + corner];
+        uint32_t v = indices[3 * t + (corner + 1) % 3];
+        if (u != v) {
+          edges.push_back(uint64_t(std::min(u, v)) << 32 | std::max(u, v));
+        }
+      }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    std::vector<Collapse> collapses;
+    collapses.reserve(edges.size() / 2);
+    for (size_t i = 0; i < edges.size();) {
+      size_t j = i + 1;
+      while (j < edges.size() && edges[j] == edges[i]) {
+        ++j;
+      }
+
+      uint32_t u = edges[i] >> 32, v = edges[i] & 0xffffffff;
+      if (j - i == 1) {
+        addBoundaryPlane(u, v, indices, adjacencyOffsets, adjacentTriangles,
+                         quadrics);
+      }
+
+      collapses.push_back(Collapse{u, v, 0.0});
+      i = j;
+    }
+
+    for (Collapse& collapse : collapses) {
+      Quadric combined = quadrics[collapse.from];
+      combined.add(quadrics[collapse.to]);
+
+      double costToTo = combined.evaluate(position(collapse.to));
+      double costToFrom = combined.evaluate(position(collapse.from));
+      if (costToFrom < costToTo) {
+        std::swap(collapse.from, collapse.to);
+        costToTo = costToFrom;
+      }
+
+      collapse.cost = costToTo;
+    }
+
+    std::sort(collapses.begin(), collapses.end(),
+              [](const Collapse& lhs, const Collapse& rhs) {
+                return lhs.cost < rhs.cost;
+              });
+
+    //// Collapse cheapest first; a vertex touched this pass is locked, so the
+    //// costs and flip checks of later collapses stay valid
+    std::vector<uint32_t> remap(vertexCount_);
+    for (size_t i = 0; i < vertexCount_; ++i) {
+      remap[i] = i;
+    }
+
+    std::vector<bool> locked(vertexCount_, false);
+
+    // Each collapse removes about two triangles; stop at the target, and
+    // never take more than a quarter of the edges in one pass
+    const size_t collapseBudget =
+        std::min((triangleCount - targetTriangleCount + 1) / 2,
+                 collapses.size() / 4 + 1);
+    size_t collapseCount = 0;
+    for (const Collapse& collapse : collapses) {
+      if (collapseCount >= collapseBudget) {
+        break;
+      }
+
+      if (locked[collapse.from] || locked[collapse.to] ||
+          flipsTriangle(collapse, indices, adjacencyOffsets,
+                        adjacentTriangles)) {
+        continue;
+      }
+
+      remap[collapse.from] = collapse.to;
+      lockNeighbourhood(collapse.from, indices, adjacencyOffsets,
+                        adjacentTriangles, locked);
+      lockNeighbourhood(collapse.to, indices, adjacencyOffsets,
+                        adjacentTriangles, locked);
+      ++collapseCount;
+    }
+
+    //// Rebuild the index list without the triangles that degenerated
+    size_t kept = 0;
+    for (size_t t = 0; t < triangleCount; ++t) {
+      uint32_t i0 = remap[indices[3 * t]], i1 = remap[indices[3 * t + 1]],
+               i2 = remap[indices[3 * t + 2]];
+      if (i0 != i1 && i1 != i2 && i0 != i2) {
+        indices[kept++] = i0;
+        indices[kept++] = i1;
+        indices[kept++] = i2;
+      }
+    }
+
+    indices.resize(kept);
+  }
+
+  void addBoundaryPlane(uint32_t u, uint32_t v,
+                        const std::vector<uint32_t>& indices,
+                        const std::vector<uint32_t>& adjacencyOffsets,
+                        const std::vector<uint32_t>& adjacentTriangles,
+                        std::vector<Quadric>& quadrics) const {
+    // Find the one triangle on this edge, for its normal
+    for (uint32_t k = adjacencyOffsets[u]; k < adjacencyOffsets[u + 1]; ++k) {
+      const uint32_t* triangle = &indices[3 * adjacentTriangles[k]];
+      if (triangle[0] != v && triangle[1] != v && triangle[2] != v) {
+        continue;
+      }
+
+      double normal[3];
+      computeNormal(triangle[0], triangle[1], triangle[2], normal);
+
+      // The plane through the edge, perpendicular to the face
+      const float *pu = position(u), *pv = position(v);
+      double edge[3] = {pv[0] - pu[0], pv[1] - pu[1], pv[2] - pu[2]};
+      double planeNormal[3];
+      cross(edge, normal, planeNormal);
+      double length = std::sqrt(planeNormal[0] * planeNormal[0] +
+                                planeNormal[1] * planeNormal[1] +
+                                planeNormal[2] * planeNormal[2]);
+      if (length == 0.0) {
+        return;
+      }
+
+      double edgeLength = std::sqrt(edge[0] * edge[0] + edge[1] * edge[1] +
+                                    edge[2] * edge[2]);
+      double a = planeNormal[0] / length, b = planeNormal[1] / length,
+             c = planeNormal[2] / length;
+      double d = -(a * pu[0] + b * pu[1] + c * pu[2]);
+      double weight = BOUNDARY_WEIGHT * edgeLength * edgeLength;
+      quadrics[u].addPlane(a, b, c, d, weight);
+      quadrics[v].addPlane(a, b, c, d, weight);
+      return;
+    }
+  }
+
+  // Whether moving collapse.from onto collapse.to turns any of the surviving
+  // triangles around it over
+  bool flipsTriangle(const Collapse& collapse,
+                     const std::vector<uint32_t>& indices,
+                     const std::vector<uint32_t>& adjacencyOffsets,
+                     const std::vector<uint32_t>& adjacentTriangles) const {
+    for (uint32_t k = adjacencyOffsets[collapse.from];
+         k < adjacencyOffsets[collapse.from + 1]; ++k) {
+      const uint32_t* triangle = &indices[3 * adjacentTriangles[k]];
+      if (triangle[0] == collapse.to || triangle[1] == collapse.to ||
+          triangle[2] == collapse.to) {
+        // Removed by the collapse
+        continue;
+      }
+
+      uint32_t moved[3];
+      for (int corner = 0; corner < 3; ++corner) {
+        moved[corner] =
+            triangle[corner] == collapse.from ? collapse.to : triangle[corner];
+      }
+
+      double before[3], after[3];
+      computeNormal(triangle[0], triangle[1], triangle[2], before);
+      computeNormal(moved[0], moved[1], moved[2], after);
+      if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <=
+          0.0) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void lockNeighbourhood(uint32_t vertex, const std::vector<uint32_t>& indices,
+                         const std::vector<uint32_t>& adjacencyOffsets,
+                         const std::vector<uint32_t>& adjacentTriangles,
+                         std::vector<bool>& locked) const {
+    for (uint32_t k = adjacencyOffsets[vertex];
+         k < adjacencyOffsets[vertex + 1]; ++k) {
+      const uint32_t* triangle = &indices[3 * adjacentTriangles[k]];
+      locked[triangle[0]] = locked[triangle[1]] = locked[triangle[2]] = true;
+    }
+  }
+};
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// A run of triangles small enough to cull as a unit. The bounding sphere and
+// normal cone are in the same space as the vertices they were built from
+struct Meshlet {
+  // Into the index list the meshlet was built from, in triangles
+  uint32_t triangleOffset;
+  uint32_t triangleCount;
+  uint32_t vertexCount;
+
+  float center[3];
+  float radius;
+
+  // Every triangle's normal is within the cone around coneAxis; a coneCutoff
+  // of 1 means the cone is too wide for the meshlet ever to face away
+  float coneAxis[3];
+  float coneCutoff;
+};
+
+// Partitions a triangle list into meshlets, growing each one through the
+// triangles that share its vertices so that it stays compact, then reorders
+// the list so that every meshlet's triangles are contiguous. Within a meshlet
+// the triangles keep their relative order, so a vertex cache optimized order
+// is mostly preserved
+class MeshletBuilder {
+ public:
+  static const uint32_t MAX_VERTEX_COUNT = 64;
+  static const uint32_t MAX_TRIANGLE_COUNT = 124;
+
+  MeshletBuilder(const std::vector<float>& vertices,
+                 std::vector<uint32_t>& indices) {
+    const size_t vertexCount = vertices.size() / 3;
+    const size_t triangleCount = indices.size() / 3;
+
+    //// Vertex to triangle adjacency
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t index : indices) {
+      ++adjacencyOffsets[index + 1];
+    }
+    for (size_t i = 0; i < vertexCount; ++i) {
+      adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+    }
+
+    std::vector<uint32_t> adjacentTriangles(indices.size());
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(),
+                               adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+      adjacentTriangles[fill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<bool> triangleAssigned(triangleCount, false);
+    std::vector<bool> vertexInMeshlet(vertexCount, false);
+
+    std::vector<uint32_t> meshletTriangles, meshletVertices, candidates;
+    meshletTriangles.reserve(MAX_TRIANGLE_COUNT);
+    meshletVertices.reserve(MAX_VERTEX_COUNT);
+
+    std::vector<uint32_t> orderedIndices;
+    orderedIndices.reserve(indices.size());
+
+    auto countNewVertices = [&](uint32_t triangle) {
+      const uint32_t* corners = &indices[3 * triangle];
+      uint32_t newVertices = 0;
+      for (int corner = 0; corner < 3; ++corner) {
+        // A degenerate triangle may repeat a vertex
+        if (!vertexInMeshlet[corners[corner]] &&
+            (corner == 0 || corners[corner] != corners[0]) &&
+            (corner < 2 || corners[corner] != corners[1])) {
+          ++newVertices;
+        }
+      }
+
+      return newVertices;
+    };
+
+    auto addTriangle = [&](uint32_t triangle) {
+      triangleAssigned[triangle] = true;
+      meshletTriangles.push_back(triangle);
+
+      for (int corner = 0; corner < 3; ++corner) {
+        const uint32_t vertex = indices[3 * triangle + corner];
+        if (vertexInMeshlet[vertex]) {
+          continue;
+        }
+
+        vertexInMeshlet[vertex] = true;
+        meshletVertices.push_back(vertex);
+        for (uint32_t k = adjacencyOffsets[vertex];
+             k < adjacencyOffsets[vertex + 1]; ++k) {
+          if (!triangleAssigned[adjacentTriangles[k]]) {
+            candidates.push_back(adjacentTriangles[k]);
+          }
+        }
+      }
+    };
+
+    size_t scanCursor = 0;
+    while (true) {
+      while (scanCursor < triangleCount && triangleAssigned[scanCursor]) {
+        ++scanCursor;
+      }
+
+      if (scanCursor == triangleCount) {
+        break;
+      }
+
+      addTriangle(scanCursor);
+
+      //// Grow through neighbouring triangles, preferring those that bring
+      //// the fewest new vertices, then the earliest
+      while (meshletTriangles.size() < MAX_TRIANGLE_COUNT) {
+        long bestTriangle = -1;
+        uint32_t bestNewVertices = 4;
+        size_t kept = 0;
+        for (uint32_t candidate : candidates) {
+          if (triangleAssigned[candidate]) {
+            continue;
+          }
+
+          candidates[kept++] = candidate;
+          uint32_t newVertices = countNewVertices(candidate);
+          if (meshletVertices.size() + newVertices > MAX_VERTEX_COUNT) {
+            continue;
+          }
+
+          if (newVertices < bestNewVertices ||
+              (newVertices == bestNewVertices && candidate < bestTriangle)) {
+            bestTriangle = candidate;
+            bestNewVertices = newVertices;
+          }
+        }
+        candidates.resize(kept);
+
+        // Nothing connected fits; take the next triangle in order instead,
+        // which keeps unconnected triangle soups from making tiny meshlets
+        if (bestTriangle < 0) {
+          while (scanCursor < triangleCount && triangleAssigned[scanCursor]) {
+            ++scanCursor;
+          }
+
+          if (scanCursor == triangleCount ||
+              meshletVertices.size() + countNewVertices(scanCursor) >
+                  MAX_VERTEX_COUNT) {
+            break;
+          }
+
+          bestTriangle = scanCursor;
+        }
+
+        addTriangle(bestTriangle);
+      }
+
+      //// Emit the meshlet
+      std::sort(meshletTriangles.begin(), meshletTriangles.end());
+
+      Meshlet meshlet;
+      meshlet.triangleOffset = orderedIndices.size() / 3;
+      meshlet.triangleCount = meshletTriangles.size();
+      meshlet.vertexCount = meshletVertices.size();
+      for (uint32_t triangle : meshletTriangles) {
+        orderedIndices.insert(orderedIndices.end(), &indices[3 * triangle],
+                              &indices[3 * triangle] + 3);
+      }
+
+      computeBounds(vertices, meshletVertices, meshlet);
+      computeCone(vertices, &orderedIndices[3 * meshlet.triangleOffset],
+                  meshlet.triangleCount, meshlet);
+      meshlets_.push_back(meshlet);
+
+      for (uint32_t vertex : meshletVertices) {
+        vertexInMeshlet[vertex] = false;
+      }
+      meshletTriangles.clear();
+      meshletVertices.clear();
+      candidates.clear();
+    }
+
+    indices.swap(orderedIndices);
+  }
+
+  const std::vector<Meshlet>& getMeshlets() const {
+    return meshlets_;
+  }
+
+ private:
+  std::vector<Meshlet> meshlets_;
+
+  // Sphere around the centre of the meshlet's box; not minimal, but close
+  static void computeBounds(const std::vector<float>& vertices,
+                            const std::vector<uint32_t>& meshletVertices,
+                            Meshlet& meshlet) {
+    float minimum[3], maximum[3];
+    for (int axis = 0; axis < 3; ++axis) {
+      minimum[axis] = maximum[axis] = vertices[3 * meshletVertices[0] + axis];
+    }
+
+    for (uint32_t vertex : meshletVertices) {
+      for (int axis = 0; axis < 3; ++axis) {
+        minimum[axis] = std::min(minimum[axis], vertices[3 * vertex + axis]);
+        maximum[axis] = std::max(maximum[axis], vertices[3 * vertex + axis]);
+      }
+    }
+
+    for (int axis = 0; axis < 3; ++axis) {
+      meshlet.center[axis] = 0.5f * (minimum[axis] + maximum[axis]);
+    }
+
+    float radiusSquared = 0.0f;
+    for (uint32_t vertex : meshletVertices) {
+      float distanceSquared = 0.0f;
+      for (int axis = 0; axis < 3; ++axis) {
+        float delta = vertices[3 * vertex + axis] - meshlet.center[axis];
+        distanceSquared += delta * delta;
+      }
+      radiusSquared = std::max(radiusSquared, distanceSquared);
+    }
+
+    meshlet.radius = std::sqrt(radiusSquared);
+  }
+
+  static void computeCone(const std::vector<float>& vertices,
+                          const uint32_t* triangles, uint32_t triangleCount,
+                          Meshlet& meshlet) {
+    //// Unit normals of the meshlet's triangles; degenerate ones face nowhere
+    std::vector<float> normals;
+    normals.reserve(3 * triangleCount);
+    float axis[3] = {0.0f, 0.0f, 0.0f};
+    for (uint32_t t = 0; t < triangleCount; ++t) {
+      const float* p0 = &vertices[3 * triangles[3 * t]];
+      const float* p1 = &vertices[3 * triangles[3 * t + 1]];
+      const float* p2 = &vertices[3 * triangles[3 * t + 2]];
+      float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+      float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+      float normal[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+                         e1[2] * e2[0] - e1[0] * e2[2],
+                         e1[0] * e2[1] - e1[1] * e2[0]};
+      float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                               normal[2] * normal[2]);
+      if (length == 0.0f) {
+        continue;
+      }
+
+      for (int i = 0; i < 3; ++i) {
+        normals.push_back(normal[i] / length);
+        axis[i] += normal[i] / length;
+      }
+    }
+
+    float axisLength =
+        std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (axisLength == 0.0f) {
+      meshlet.coneAxis[0] = meshlet.coneAxis[1] = 0.0f;
+      meshlet.coneAxis[2] = 1.0f;
+      meshlet.coneCutoff = 1.0f;
+      return;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+      meshlet.coneAxis[i] = axis[i] / axisLength;
+    }
+
+    //// The widest normal sets the cone's half angle; past a hemisphere the
+    //// meshlet can always be seen from somewhere
+    float minimumDot = 1.0f;
+    for (size_t i = 0; i < normals.size(); i += 3) {
+      float dot = normals[i] * meshlet.coneAxis[0] +
+                  normals[i + 1] * meshlet.coneAxis[1] +
+                  normals[i + 2] * meshlet.coneAxis[2];
+      minimumDot = std::min(minimumDot, dot);
+    }
+
+    meshlet.coneCutoff =
+        minimumDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minimumDot * minimumDot);
+  }
+};
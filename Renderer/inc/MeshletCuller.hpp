@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <Eigen/Dense>
+
+#include "MeshletBuilder.hpp"
+
+// Tests meshlets against the view frustum and their normal cones against the
+// eye. Everything happens in the meshlets' own space, whatever transformation
+// takes them to clip space: both tests survive affine transformations
+class MeshletCuller {
+ public:
+  // Consecutive triangles to draw
+  struct TriangleRange {
+    uint32_t triangleOffset;
+    uint32_t triangleCount;
+  };
+
+  MeshletCuller(const Eigen::Matrix4f& modelViewProjection,
+                bool cullBackfacing = true)
+      : cullBackfacing_(cullBackfacing) {
+    //// Frustum planes straight from the rows of the matrix (Gribb and
+    //// Hartmann): left, right, bottom, top, near, far
+    for (int plane = 0; plane < 6; ++plane) {
+      const float sign = plane % 2 == 0 ? 1.0f : -1.0f;
+      planes_[plane] = (modelViewProjection.row(3) +
+                        sign * modelViewProjection.row(plane / 2))
+                           .transpose();
+      planes_[plane] /= planes_[plane].head<3>().norm();
+    }
+
+    // The eye is the point that clip space puts at infinity straight ahead;
+    // in homogeneous coordinates, so that an orthographic eye is a direction
+    eye_ = modelViewProjection.inverse() * Eigen::Vector4f(0, 0, -1, 0);
+    eye_.normalize();
+  }
+
+  bool isVisible(const Meshlet& meshlet) const {
+    const Eigen::Vector3f center(meshlet.center[0], meshlet.center[1],
+                                 meshlet.center[2]);
+
+    for (const Eigen::Vector4f& plane : planes_) {
+      if (plane.head<3>().dot(center) + plane[3] < -meshlet.radius) {
+        return false;
+      }
+    }
+
+    if (!cullBackfacing_ || meshlet.coneCutoff >= 1.0f) {
+      return true;
+    }
+
+    // Backfacing when the direction from the eye to every point of the
+    // bounding sphere is within the cone's complement
+    const Eigen::Vector3f axis(meshlet.coneAxis[0], meshlet.coneAxis[1],
+                               meshlet.coneAxis[2]);
+    const Eigen::Vector3f view = eye_[3] * center - eye_.head<3>();
+    return view.dot(axis) <
+           meshlet.coneCutoff * view.norm() + meshlet.radius * eye_[3];
+  }
+
+  // The visible meshlets' triangles, with neighbouring meshlets merged into
+  // one range so that they are drawn together
+  void cull(const std::vector<Meshlet>& meshlets,
+            std::vector<TriangleRange>& visibleRanges) const {
+    visibleRanges.clear();
+    for (const Meshlet& meshlet : meshlets) {
+      if (!isVisible(meshlet)) {
+        continue;
+      }
+
+      if (!visibleRanges.empty() &&
+          visibleRanges.back().triangleOffset +
+                  visibleRanges.back().triangleCount ==
+              meshlet.triangleOffset) {
+        visibleRanges.back().triangleCount += meshlet.triangleCount;
+      } else {
+        visibleRanges.push_back(
+            TriangleRange{meshlet.triangleOffset, meshlet.triangleCount});
+      }
+    }
+  }
+
+ private:
+  bool cullBackfacing_;
+  Eigen::Vector4f planes_[6];
+  Eigen::Vector4f eye_;
+};
@@ -1,11 +1,24 @@
 #pragma once
 
+#include <algorithm>
 #include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
 #include <Eigen/Geometry>
 
+#include "ObjWriter.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 class Model {
  public:
   Model() {
+    uniformColor_ = std::vector<float>{1.0, 1.0, 1.0};
     displacement_ = std::vector<float>{0.0, 0.0, 0.0};
     scale_ = std::vector<float>{1.0, 1.0, 1.0};
     orientation_ = Eigen::Quaternion<float>::Identity();
@@ -27,78 +40,245 @@ class Model {
     if (newVertex.size() != 3)
       throw std::runtime_error("Vertices must contain 3 numbers");
 
-    for (float vertexValue : newVertex) {
-      vertices_.push_back(vertexValue);
+    addVertex(newVertex[0], newVertex[1], newVertex[2]);
+  }
+
+  void addVertex(float x, float y, float z) {
+    boundsValid_ = false;
+    normals_.clear();
+
+    vertices_.push_back(x);
+    vertices_.push_back(y);
+    vertices_.push_back(z);
+
+    // Once any vertex has its own color, every vertex needs one
+    if (!colors_.empty()) {
+      colors_.insert(colors_.end(), uniformColor_.begin(), uniformColor_.end());
     }
+  }
 
-    // todo: do better
-    // ... really, vertices should be a pair of lists;
-    // ... coupling the vertex position and colors
-    for (int i = 0; i < 3; ++i) {
-      colors_.push_back(1.0f);
+  void addVertex(float x, float y, float z, float r, float g, float b) {
+    boundsValid_ = false;
+    normals_.clear();
+
+    // Vertices added before the first colored one take the uniform color
+    if (colors_.empty()) {
+      colors_.reserve(vertices_.size() + 3);
+      for (size_t i = 0; i < vertices_.size(); i += 3) {
+        colors_.insert(colors_.end(), uniformColor_.begin(),
+                       uniformColor_.end());
+      }
     }
+
+    vertices_.push_back(x);
+    vertices_.push_back(y);
+    vertices_.push_back(z);
+
+    colors_.push_back(r);
+    colors_.push_back(g);
+    colors_.push_back(b);
   }
 
+  // Per-vertex colors; empty unless the model specifies them, in which case
+  // the uniform color applies to every vertex
   std::vector<float>& getColors() {
     return colors_;
   }
 
-  std::vector<std::vector<unsigned>>& getPolygons() {
-    return polygons_;
+  bool hasVertexColors() const {
+    return !colors_.empty();
+  }
+
+  // Per-vertex unit normals (see NormalGenerator); empty unless generated.
+  // Adding vertices or triangles discards them, and they are not written to
+  // OBJ files
+  std::vector<float>& getNormals() {
+    return normals_;
+  }
+
+  bool hasNormals() const {
+    return !normals_.empty();
+  }
+
+  std::vector<float> getUniformColor() const {
+    return uniformColor_;
+  }
+
+  void setUniformColor(const std::vector<float>& newUniformColor) {
+    if (newUniformColor.size() != 3)
+      throw std::runtime_error("Colors must contain 3 numbers");
+
+    uniformColor_ = newUniformColor;
+  }
+
+  // Triangles, as a flat list of vertex indices (3 per triangle)
+  std::vector<uint32_t>& getIndices() {
+    return indices_;
+  }
+
+  size_t getTriangleCount() const {
+    return indices_.size() / 3;
   }
 
+  // Bytes held by each container, counting the vector itself and its whole
+  // capacity, which growing one element at a time can leave well above its
+  // size. The rest of the model (name, transform, bounds) is otherBytes
+  struct MemoryUsage {
+    size_t vertexBytes;
+    size_t colorBytes;
+    size_t normalBytes;
+    size_t indexBytes;
+    size_t levelOfDetailBytes;
+    size_t otherBytes;
+
+    size_t getTotalBytes() const {
+      return vertexBytes + colorBytes + normalBytes + indexBytes +
+             levelOfDetailBytes + otherBytes;
+    }
+  };
+
+  MemoryUsage getMemoryUsage() const {
+    MemoryUsage memoryUsage;
+    memoryUsage.vertexBytes = getVectorBytes(vertices_);
+    memoryUsage.colorBytes = getVectorBytes(colors_);
+    memoryUsage.normalBytes = getVectorBytes(normals_);
+    memoryUsage.indexBytes = getVectorBytes(indices_);
+    memoryUsage.levelOfDetailBytes = getVectorBytes(levelsOfDetail_);
+    for (const std::vector<uint32_t>& levelIndices : levelsOfDetail_) {
+      memoryUsage.levelOfDetailBytes +=
+          levelIndices.capacity() * sizeof(uint32_t);
+    }
+
+    memoryUsage.otherBytes =
+        sizeof(Model) - sizeof(vertices_) - sizeof(colors_) -
+        sizeof(normals_) - sizeof(indices_) - sizeof(levelsOfDetail_) +
+        (uniformColor_.capacity() + displacement_.capacity() +
+         scale_.capacity()) *
+            sizeof(float);
+    return memoryUsage;
+  }
+
+  // Polygons with more than 3 vertices are triangulated as fans
   void addPolygon(const std::vector<unsigned>& newPolygon) {
+    if (newPolygon.size() < 3)
+      throw std::runtime_error("Polygons must contain at least 3 vertices");
+
     for (unsigned vertexIndex : newPolygon) {
-      if (vertexIndex >= vertices_.size()) {
+      if (vertexIndex >= vertices_.size() / 3) {
         throw std::runtime_error("Invalid vertex index specified");
       }
     }
 
-    polygons_.push_back(newPolygon);
+    vertexCacheOptimized_ = false;
+    levelsOfDetail_.clear();
+    normals_.clear();
+    for (unsigned i = 1; i + 1 < newPolygon.size(); ++i) {
+      indices_.push_back(newPolygon[0]);
+      indices_.push_back(newPolygon[i]);
+      indices_.push_back(newPolygon[i + 1]);
+    }
   }
 
-  std::vector<float> getCenter() const {
-    std::vector<float> center(3);
-    for (unsigned i = 0; i < vertices_.size(); ++i) {
-      center[i % 3] += vertices_[i];
+  void addTriangle(unsigned u1, unsigned u2, unsigned u3) {
+    unsigned vertexCount = vertices_.size() / 3;
+    if (u1 >= vertexCount || u2 >= vertexCount || u3 >= vertexCount) {
+      throw std::runtime_error("Invalid vertex index specified");
     }
 
-    float tmp = float(vertices_.size()) / 3.0f;
-    center[0] /= tmp;
-    center[1] /= tmp;
-    center[2] /= tmp;
+    vertexCacheOptimized_ = false;
+    levelsOfDetail_.clear();
+    normals_.clear();
 
-    return center;
+    indices_.push_back(u1);
+    indices_.push_back(u2);
+    indices_.push_back(u3);
   }
 
-  std::vector<float> getDimensions() const {
-    float minX = FLT_MAX, maxX = 0.0, minY = FLT_MAX, maxY = 0.0,
-          minZ = FLT_MAX, maxZ = 0.0;
-    for (unsigned i = 0; i < vertices_.size(); i += 3) {
-      float x = vertices_[i], y = vertices_[i + 1], z = vertices_[i + 2];
-      if (x < minX) {
-        minX = x;
-      }
-      if (x > maxX) {
-        maxX = x;
-      }
+  // Level 0 is the full mesh; coarser levels are simplified triangle lists
+  // over the same vertices (see MeshSimplifier). Changing the triangles
+  // discards them
+  size_t getLevelOfDetailCount() const {
+    return 1 + levelsOfDetail_.size();
+  }
 
-      if (y < minY) {
-        minY = y;
-      }
-      if (y > maxY) {
-        maxY = y;
-      }
+  std::vector<uint32_t>& getLevelOfDetailIndices(size_t level) {
+    if (level >= getLevelOfDetailCount())
+      throw std::runtime_error("Invalid level of detail specified");
 
-      if (z < minZ) {
-        minZ = z;
-      }
-      if (z > maxZ) {
-        maxZ = z;
+    return level == 0 ? indices_ : levelsOfDetail_[level - 1];
+  }
+
+  void addLevelOfDetail(const std::vector<uint32_t>& newLevelIndices) {
+    for (uint32_t vertexIndex : newLevelIndices) {
+      if (vertexIndex >= vertices_.size() / 3) {
+        throw std::runtime_error("Invalid vertex index specified");
       }
     }
 
-    return std::vector<float>{maxX - minX, maxY - minY, maxZ - minZ};
+    levelsOfDetail_.push_back(newLevelIndices);
+  }
+
+  // Picks the coarsest level that still has about one triangle for every
+  // TRIANGLE_PIXEL_AREA pixels the model covers on screen
+  size_t selectLevelOfDetail(float projectedRadiusInPixels) const {
+    const float TRIANGLE_PIXEL_AREA = 2.0f;
+    const float triangleBudget = 3.14159265f * projectedRadiusInPixels *
+                                 projectedRadiusInPixels / TRIANGLE_PIXEL_AREA;
+
+    size_t level = 0;
+    while (level + 1 < getLevelOfDetailCount() &&
+           levelsOfDetail_[level].size() / 3 >= triangleBudget) {
+      ++level;
+    }
+
+    return level;
+  }
+
+  // Radius of the model's bounding sphere, in world units; its scale applied
+  float getBoundingRadius() const {
+    std::vector<float> dimensions = getDimensions();
+    float radius = 0.5f * std::sqrt(dimensions[0] * dimensions[0] +
+                                    dimensions[1] * dimensions[1] +
+                                    dimensions[2] * dimensions[2]);
+    return radius * std::max(std::max(scale_[0], scale_[1]), scale_[2]);
+  }
+
+  // Whether the triangle and vertex order has been optimized for the GPU's
+  // vertex cache (see MeshOptimizer)
+  bool isVertexCacheOptimized() const {
+    return vertexCacheOptimized_;
+  }
+
+  void setVertexCacheOptimized(bool vertexCacheOptimized) {
+    vertexCacheOptimized_ = vertexCacheOptimized;
+  }
+
+  // The bounds and centroid are computed once and cached; adding a vertex
+  // invalidates them (as must anything that edits getVertices() in place)
+  std::vector<float> getCenter() const {
+    updateBounds();
+    return std::vector<float>(center_, center_ + 3);
+  }
+
+  std::vector<float> getMinimumBounds() const {
+    updateBounds();
+    return std::vector<float>(minimum_, minimum_ + 3);
+  }
+
+  std::vector<float> getMaximumBounds() const {
+    updateBounds();
+    return std::vector<float>(maximum_, maximum_ + 3);
+  }
+
+  std::vector<float> getDimensions() const {
+    updateBounds();
+    return std::vector<float>{maximum_[0] - minimum_[0],
+                              maximum_[1] - minimum_[1],
+                              maximum_[2] - minimum_[2]};
+  }
+
+  void invalidateBounds() {
+    boundsValid_ = false;
   }
 
   std::vector<float> getScale() const {
@@ -140,39 +320,43 @@ class Model {
     orientation_.normalize();
   }
 
-  // todo: figure out how to enforce a certain number of significant digits
-  void writeToFile(const std::string& filePath) {
-    std::ofstream outputFileStream(filePath);
-    if (outputFileStream.is_open()) {
-      outputFileStream << "o " << modelName_;
-
-      // Write vertices
-      for (unsigned i = 0; i < vertices_.size(); ++i) {
-        if (i == (vertices_.size() - 1)) {
-          outputFileStream << vertices_[i] << std::endl;
-        } else if (i % 3 == 0) {
-          outputFileStream << std::endl << "v " << vertices_[i] << " ";
-        } else {
-          outputFileStream << vertices_[i] << " ";
-        }
+  // Writes the model as OBJ; zero significant digits writes each number in
+  // the shortest form that reads back exactly
+  void writeToFile(const std::string& filePath,
+                   int significantDigits = 0) const {
+    ObjWriter objWriter(filePath, significantDigits);
+    objWriter.writeText("o " + modelName_ + "\n");
+
+    // Write vertices, followed by their colors if they have any
+    for (size_t i = 0; i < vertices_.size(); i += 3) {
+      objWriter.writeText("v");
+      for (size_t j = i; j < i + 3; ++j) {
+        objWriter.writeChar(' ');
+        objWriter.writeFloat(vertices_[j]);
       }
 
-      // Write ***1-indexed*** faces
-      for (std::vector<unsigned> polygon : polygons_) {
-        outputFileStream << "f ";
-        for (int i = 0; i < polygon.size(); ++i) {
-          outputFileStream << polygon[i] + 1;
-          if (i < polygon.size() - 1)
-            outputFileStream << " ";
+      if (!colors_.empty()) {
+        for (size_t j = i; j < i + 3; ++j) {
+          objWriter.writeChar(' ');
+          objWriter.writeFloat(colors_[j]);
         }
+      }
+
+      objWriter.writeChar('\n');
+    }
 
-        outputFileStream << std::endl;
+    // Write ***1-indexed*** faces
+    for (size_t i = 0; i < indices_.size(); i += 3) {
+      objWriter.writeChar('f');
+      for (size_t j = i; j < i + 3; ++j) {
+        objWriter.writeChar(' ');
+        objWriter.writeUnsigned(indices_[j] + 1ul);
       }
 
-      outputFileStream.close();
-    } else {
-      throw std::runtime_error("Failed to open model output file");
+      objWriter.writeChar('\n');
     }
+
+    objWriter.close();
   }
 
  private:
@@ -180,13 +364,109 @@ class Model {
 
   std::vector<float> vertices_;
   std::vector<float> colors_;
+  std::vector<float> uniformColor_;
+  std::vector<float> normals_;
 
-  std::vector<std::vector<unsigned>> polygons_;
+  std::vector<uint32_t> indices_;
+  std::vector<std::vector<uint32_t>> levelsOfDetail_;
+  bool vertexCacheOptimized_ = false;
 
   std::vector<float> displacement_;
   std::vector<float> scale_;
 
   Eigen::Quaternion<float> orientation_;
 
+  mutable bool boundsValid_ = false;
+  mutable float minimum_[3], maximum_[3], center_[3];
+
+  template <typename T>
+  static size_t getVectorBytes(const std::vector<T>& vector) {
+    return sizeof(vector) + vector.capacity() * sizeof(T);
+  }
+
+  void updateBounds() const {
+    if (boundsValid_) {
+      return;
+    }
+
+    const size_t vertexCount = vertices_.size() / 3;
+    double sum[3] = {0.0, 0.0, 0.0};
+    for (int i = 0; i < 3; ++i) {
+      minimum_[i] = vertexCount > 0 ? FLT_MAX : 0.0f;
+      maximum_[i] = vertexCount > 0 ? -FLT_MAX : 0.0f;
+    }
+
+    // Whole blocks of 8 vertices are reduced with vector instructions where
+    // the CPU has them; the remainder (or everything) falls through to scalar
+    size_t reducedVertexCount = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx")) {
+      reducedVertexCount = reduceBoundsAvx(sum);
+    }
+#endif
+
+    for (size_t i = reducedVertexCount * 3; i < vertices_.size(); ++i) {
+      minimum_[i % 3] = std::min(minimum_[i % 3], vertices_[i]);
+      maximum_[i % 3] = std::max(maximum_[i % 3], vertices_[i]);
+      sum[i % 3] += vertices_[i];
+    }
+
+    for (int i = 0; i < 3; ++i) {
+      center_[i] = vertexCount > 0 ? sum[i] / vertexCount : 0.0f;
+    }
+
+    boundsValid_ = true;
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  // Reduces 8 interleaved xyz vertices (24 floats, 3 registers) per
+  // iteration; lane j of register k always holds component (8k + j) % 3, so
+  // the lanes are folded back into components once at the end. Sums are
+  // accumulated in double precision. Returns the number of vertices reduced
+  __attribute__((target("avx"))) size_t reduceBoundsAvx(double sum[3]) const {
+    const size_t blockCount = vertices_.size() / 24;
+    const float* data = vertices_.data();
+
+    __m256 minima[3], maxima[3];
+    __m256d sums[6];
+    for (int k = 0; k < 3; ++k) {
+      minima[k] = _mm256_set1_ps(FLT_MAX);
+      maxima[k] = _mm256_set1_ps(-FLT_MAX);
+      sums[2 * k] = sums[2 * k + 1] = _mm256_setzero_pd();
+    }
+
+    for (size_t block = 0; block < blockCount; ++block) {
+      for (int k = 0; k < 3; ++k) {
+        __m256 values = _mm256_loadu_ps(data + block * 24 + k * 8);
+        minima[k] = _mm256_min_ps(minima[k], values);
+        maxima[k] = _mm256_max_ps(maxima[k], values);
+        sums[2 * k] = _mm256_add_pd(
+            sums[2 * k], _mm256_cvtps_pd(_mm256_castps256_ps128(values)));
+        sums[2 * k + 1] = _mm256_add_pd(
+            sums[2 * k + 1], _mm256_cvtps_pd(_mm256_extractf128_ps(values, 1)));
+      }
+    }
+
+    float laneMinima[24], laneMaxima[24];
+    double laneSums[24];
+    for (int k = 0; k < 3; ++k) {
+      _mm256_storeu_ps(laneMinima + k * 8, minima[k]);
+      _mm256_storeu_ps(laneMaxima + k * 8, maxima[k]);
+      _mm256_storeu_pd(laneSums + k * 8, sums[2 * k]);
+      _mm256_storeu_pd(laneSums + k * 8 + 4, sums[2 * k + 1]);
+    }
+
+    for (int lane = 0; lane < 24; ++lane) {
+      minimum_[lane % 3] = std::min(minimum_[lane % 3], laneMinima[lane]);
+      maximum_[lane % 3] = std::max(maximum_[lane % 3], laneMaxima[lane]);
+      sum[lane % 3] += laneSums[lane];
+    }
+
+    return blockCount * 8;
+  }
+#endif
+
   friend class ModelFactory;
+  friend class ModelCache;
+  friend class ModelCodec;
 };
\ No newline at end of file
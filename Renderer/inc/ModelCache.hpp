@@ -0,0 +1,342 @@
+#pragma once
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "MappedFile.hpp"
+#include "Model.hpp"
+
+// Binary copy of a parsed Model (.mdlbin), stored next to the OBJ file it was
+// parsed from, along with its normals and levels of detail. Every section is
+// contiguous and 8-byte aligned, so loading is a single mapping plus bulk
+// copies, with no parsing. The copies are needed because a Model owns its
+// geometry as vectors, which cannot adopt the mapping's memory. The cache is
+// only used while the source file's size and modification time match the
+// ones recorded in the header
+class ModelCache {
+ public:
+  static const uint32_t FORMAT_VERSION = 5;
+
+  ModelCache(const std::string& sourceFilePath)
+      : sourceFilePath_(sourceFilePath),
+        cacheFilePath_(sourceFilePath + ".mdlbin") {
+  }
+
+  std::string getCacheFilePath() const {
+    return cacheFilePath_;
+  }
+
+  // Returns false, leaving the model untouched, if there is no valid and
+  // up-to-date cache for the source file
+  bool load(Model& modelData) const {
+    Header expectedHeader;
+    if (!readSourceStatus(expectedHeader)) {
+      return false;
+    }
+
+    struct stat cacheStatus;
+    if (stat(cacheFilePath_.c_str(), &cacheStatus) != 0) {
+      return false;
+    }
+
+    MappedFile cacheFile(cacheFilePath_);
+    if (cacheFile.size() < sizeof(Header)) {
+      return false;
+    }
+
+    Header header;
+    memcpy(&header, cacheFile.begin(), sizeof(Header));
+    if (memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != FORMAT_VERSION ||
+        header.sourceSize != expectedHeader.sourceSize ||
+        header.sourceModificationTime !=
+            expectedHeader.sourceModificationTime) {
+      return false;
+    }
+
+    // No count can exceed the file's size, which keeps the payload size from
+    // overflowing
+    for (uint64_t count :
+         {header.nameLength, header.vertexCount, header.colorCount,
+          header.normalCount, header.triangleCount, header.levelOfDetailCount,
+          header.levelOfDetailIndexCount}) {
+      if (count > cacheFile.size()) {
+        return false;
+      }
+    }
+
+    const uint64_t payloadSize = getPayloadSize(header);
+    if (cacheFile.size() != sizeof(Header) + payloadSize) {
+      return false;
+    }
+
+    const char* payload = cacheFile.begin() + sizeof(Header);
+    if (computeChecksum(payload, payloadSize) != header.checksum) {
+      return false;
+    }
+
+    //// Check the counts against each other before touching the model
+    if ((header.colorCount != 0 && header.colorCount != header.vertexCount) ||
+        (header.normalCount != 0 &&
+         header.normalCount != header.vertexCount)) {
+      return false;
+    }
+
+    // Levels of detail: their index counts, then all their indices
+    const uint64_t* levelIndexCounts = reinterpret_cast<const uint64_t*>(
+        payload + getLevelOfDetailOffset(header));
+    uint64_t levelIndexTotal = 0;
+    for (uint64_t level = 0; level < header.levelOfDetailCount; ++level) {
+      if (levelIndexCounts[level] >
+          header.levelOfDetailIndexCount - levelIndexTotal) {
+        return false;
+      }
+      levelIndexTotal += levelIndexCounts[level];
+    }
+    if (levelIndexTotal != header.levelOfDetailIndexCount) {
+      return false;
+    }
+
+    // Every index must name a vertex, as the OBJ parsers ensure; a stale or
+    // edited cache could otherwise hand any index on to the GPU
+    const char* levelIndices = payload + getLevelOfDetailOffset(header) +
+                               header.levelOfDetailCount * sizeof(uint64_t);
+    if (!areIndicesInRange(payload + getIndexOffset(header),
+                           header.triangleCount * 3, header.vertexCount) ||
+        !areIndicesInRange(levelIndices, header.levelOfDetailIndexCount,
+                           header.vertexCount)) {
+      return false;
+    }
+
+    const char* cursor = payload;
+    modelData.setName(std::string(cursor, header.nameLength));
+    modelData.setUniformColor(std::vector<float>(
+        header.uniformColor, header.uniformColor + 3));
+    modelData.setVertexCacheOptimized(
+        (header.flags & FLAG_VERTEX_CACHE_OPTIMIZED) != 0);
+    cursor += align(header.nameLength);
+
+    modelData.vertices_.resize(header.vertexCount * 3);
+    memcpy(modelData.vertices_.data(), cursor,
+           header.vertexCount * 3 * sizeof(float));
+    cursor += align(header.vertexCount * 3 * sizeof(float));
+    modelData.invalidateBounds();
+
+    modelData.colors_.resize(header.colorCount * 3);
+    memcpy(modelData.colors_.data(), cursor,
+           header.colorCount * 3 * sizeof(float));
+    cursor += align(header.colorCount * 3 * sizeof(float));
+
+    modelData.normals_.resize(header.normalCount * 3);
+    memcpy(modelData.normals_.data(), cursor,
+           header.normalCount * 3 * sizeof(float));
+    cursor += align(header.normalCount * 3 * sizeof(float));
+
+    modelData.indices_.resize(header.triangleCount * 3);
+    memcpy(modelData.indices_.data(), cursor,
+           header.triangleCount * 3 * sizeof(uint32_t));
+    cursor += align(header.triangleCount * 3 * sizeof(uint32_t));
+
+    cursor += header.levelOfDetailCount * sizeof(uint64_t);
+    modelData.levelsOfDetail_.resize(header.levelOfDetailCount);
+    for (uint64_t level = 0; level < header.levelOfDetailCount; ++level) {
+      std::vector<uint32_t>& levelIndices = modelData.levelsOfDetail_[level];
+      levelIndices.resize(levelIndexCounts[level]);
+      memcpy(levelIndices.data(), cursor,
+             levelIndices.size() * sizeof(uint32_t));
+      cursor += levelIndices.size() * sizeof(uint32_t);
+    }
+
+    return true;
+  }
+
+  void store(const Model& modelData) const {
+    Header header;
+    if (!readSourceStatus(header)) {
+      throw std::runtime_error("Failed to stat model source file: " +
+                               sourceFilePath_);
+    }
+
+    const std::string& name = modelData.modelName_;
+    header.nameLength = name.size();
+    header.vertexCount = modelData.vertices_.size() / 3;
+    header.colorCount = modelData.colors_.size() / 3;
+    header.normalCount = modelData.normals_.size() / 3;
+    header.triangleCount = modelData.indices_.size() / 3;
+    header.levelOfDetailCount = modelData.levelsOfDetail_.size();
+    for (const std::vector<uint32_t>& levelIndices :
+         modelData.levelsOfDetail_) {
+      header.levelOfDetailIndexCount += levelIndices.size();
+    }
+    std::copy(modelData.uniformColor_.begin(), modelData.uniformColor_.end(),
+              header.uniformColor);
+    if (modelData.isVertexCacheOptimized()) {
+      header.flags |= FLAG_VERTEX_CACHE_OPTIMIZED;
+    }
+
+    //// Lay the payload out in memory first; it is checksummed as a whole
+    std::vector<char> payload(getPayloadSize(header), 0);
+    char* cursor = payload.data();
+
+    memcpy(cursor, name.data(), name.size());
+    cursor += align(name.size());
+
+    memcpy(cursor, modelData.vertices_.data(),
+           modelData.vertices_.size() * sizeof(float));
+    cursor += align(modelData.vertices_.size() * sizeof(float));
+
+    memcpy(cursor, modelData.colors_.data(),
+           modelData.colors_.size() * sizeof(float));
+    cursor += align(modelData.colors_.size() * sizeof(float));
+
+    memcpy(cursor, modelData.normals_.data(),
+           modelData.normals_.size() * sizeof(float));
+    cursor += align(modelData.normals_.size() * sizeof(float));
+
+    memcpy(cursor, modelData.indices_.data(),
+           modelData.indices_.size() * sizeof(uint32_t));
+    cursor += align(modelData.indices_.size() * sizeof(uint32_t));
+
+    for (const std::vector<uint32_t>& levelIndices :
+         modelData.levelsOfDetail_) {
+      uint64_t levelIndexCount = levelIndices.size();
+      memcpy(cursor, &levelIndexCount, sizeof(levelIndexCount));
+      cursor += sizeof(levelIndexCount);
+    }
+
+    for (const std::vector<uint32_t>& levelIndices :
+         modelData.levelsOfDetail_) {
+      memcpy(cursor, levelIndices.data(),
+             levelIndices.size() * sizeof(uint32_t));
+      cursor += levelIndices.size() * sizeof(uint32_t);
+    }
+
+    header.checksum = computeChecksum(payload.data(), payload.size());
+
+    // Write to a temporary file and rename it into place, so that a reader
+    // never maps a partially written cache
+    const std::string temporaryFilePath = cacheFilePath_ + ".tmp";
+    std::ofstream outputFileStream(temporaryFilePath, std::ios::binary);
+    if (!outputFileStream.is_open()) {
+      throw std::runtime_error("Failed to open model cache output file");
+    }
+
+    outputFileStream.write(reinterpret_cast<const char*>(&header),
+                           sizeof(Header));
+    outputFileStream.write(payload.data(), payload.size());
+    outputFileStream.close();
+    if (!outputFileStream) {
+      std::remove(temporaryFilePath.c_str());
+      throw std::runtime_error("Failed to write model cache output file");
+    }
+
+    if (std::rename(temporaryFilePath.c_str(), cacheFilePath_.c_str()) != 0) {
+      std::remove(temporaryFilePath.c_str());
+      throw std::runtime_error("Failed to move model cache into place");
+    }
+  }
+
+ private:
+  static const uint32_t FLAG_VERTEX_CACHE_OPTIMIZED = 1 << 0;
+
+  static constexpr char MAGIC[8] = {'M', 'D', 'L', 'B', 'I', 'N', '\0', '\0'};
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t sourceSize;
+    int64_t sourceModificationTime;
+    uint64_t nameLength;
+    uint64_t vertexCount;
+    uint64_t colorCount;
+    uint64_t normalCount;
+    uint64_t triangleCount;
+    uint64_t levelOfDetailCount;
+    uint64_t levelOfDetailIndexCount;
+    float uniformColor[3];
+    uint32_t flags;
+    uint64_t checksum;
+
+    Header() {
+      memcpy(magic, MAGIC, sizeof(magic));
+      version = FORMAT_VERSION;
+      headerSize = sizeof(Header);
+      sourceSize = 0;
+      sourceModificationTime = 0;
+      nameLength = vertexCount = colorCount = normalCount = 0;
+      triangleCount = 0;
+      levelOfDetailCount = levelOfDetailIndexCount = 0;
+      uniformColor[0] = uniformColor[1] = uniformColor[2] = 1.0f;
+      flags = 0;
+      checksum = 0;
+    }
+  };
+
+  std::string sourceFilePath_;
+  std::string cacheFilePath_;
+
+  bool readSourceStatus(Header& header) const {
+    struct stat sourceStatus;
+    if (stat(sourceFilePath_.c_str(), &sourceStatus) != 0) {
+      return false;
+    }
+
+    header.sourceSize = sourceStatus.st_size;
+    header.sourceModificationTime =
+        int64_t(sourceStatus.st_mtim.tv_sec) * 1000000000 +
+        sourceStatus.st_mtim.tv_nsec;
+    return true;
+  }
+
+  static uint64_t align(uint64_t size) {
+    return (size + 7) & ~uint64_t(7);
+  }
+
+  // Where the triangles' indices start in the payload
+  static uint64_t getIndexOffset(const Header& header) {
+    return align(header.nameLength) +
+           align(header.vertexCount * 3 * sizeof(float)) +
+           align(header.colorCount * 3 * sizeof(float)) +
+           align(header.normalCount * 3 * sizeof(float));
+  }
+
+  // Where the levels of detail's index counts start in the payload
+  static uint64_t getLevelOfDetailOffset(const Header& header) {
+    return getIndexOffset(header) +
+           align(header.triangleCount * 3 * sizeof(uint32_t));
+  }
+
+  static bool areIndicesInRange(const char* data, uint64_t indexCount,
+                                uint64_t vertexCount) {
+    const uint32_t* indices = reinterpret_cast<const uint32_t*>(data);
+    return indexCount == 0 ||
+           *std::max_element(indices, indices + indexCount) < vertexCount;
+  }
+
+  static uint64_t getPayloadSize(const Header& header) {
+    return getLevelOfDetailOffset(header) +
+           header.levelOfDetailCount * sizeof(uint64_t) +
+           align(header.levelOfDetailIndexCount * sizeof(uint32_t));
+  }
+
+  // FNV-1a over 64-bit words; the payload is always a multiple of 8 bytes
+  static uint64_t computeChecksum(const char* data, uint64_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint64_t i = 0; i < size; i += 8) {
+      uint64_t word;
+      memcpy(&word, data + i, sizeof(word));
+      hash = (hash ^ word) * 1099511628211ull;
+    }
+
+    return hash;
+  }
+};
@@ -0,0 +1,634 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "MappedFile.hpp"
+#include "Model.hpp"
+
+// Compressed model file (.mdlz) for archiving models, at a fraction of the
+// size of their OBJ text. Positions are quantized within the model's bounding
+// box and stored as varint residuals from a prediction: the parallelogram
+// across the edge a vertex was reached by, or else the previous vertex.
+// Triangles are coded against the 15 most recent edges and 14 most recent
+// vertices, which adjacent triangles mostly reuse, so a typical triangle
+// takes a single byte. Vertices are renumbered in the order triangles first
+// use them, which is what lets a new vertex be coded without its index.
+//
+// Triangle order and winding are kept, though a triangle may start at a
+// different corner. Colors are kept to 8 bits; levels of detail are not kept
+class ModelCodec {
+ public:
+  static constexpr uint32_t FORMAT_VERSION = 1;
+  static constexpr unsigned DEFAULT_POSITION_BITS = 16;
+  static constexpr unsigned MAX_POSITION_BITS = 24;
+
+  static bool isCompressedModelFile(const std::string& filePath) {
+    const std::string extension = ".mdlz";
+    return filePath.size() >= extension.size() &&
+           filePath.compare(filePath.size() - extension.size(),
+                            extension.size(), extension) == 0;
+  }
+
+  // Where a model's compressed copy goes: x.obj becomes x.mdlz
+  static std::string getCompressedFilePath(const std::string& modelFilePath) {
+    size_t extensionStart = modelFilePath.find_last_of('.');
+    size_t directoryEnd = modelFilePath.find_last_of('/');
+    if (extensionStart == std::string::npos ||
+        (directoryEnd != std::string::npos && extensionStart < directoryEnd)) {
+      return modelFilePath + ".mdlz";
+    }
+
+    return modelFilePath.substr(0, extensionStart) + ".mdlz";
+  }
+
+  // How far, in model units, a decoded position can be from the original:
+  // half a step on each axis, plus the rounding of the decoded coordinate to
+  // single precision
+  static double getMaximumError(Model& model,
+                                unsigned positionBits = DEFAULT_POSITION_BITS) {
+    std::vector<float> minimumBounds = model.getMinimumBounds();
+    std::vector<float> maximumBounds = model.getMaximumBounds();
+    double squaredError = 0.0;
+    for (int axis = 0; axis < 3; ++axis) {
+      double extent = getExtent(minimumBounds[axis], maximumBounds[axis]);
+      double halfStep = extent / getStepCount(positionBits) / 2;
+      double largest = std::max(std::fabs(double(minimumBounds[axis])),
+                                std::fabs(minimumBounds[axis] + extent));
+      double halfUlp =
+          std::ldexp(double(FLT_EPSILON),
+                     std::max(std::ilogb(largest), FLT_MIN_EXP - 1)) /
+          2;
+      squaredError += (halfStep + halfUlp) * (halfStep + halfUlp);
+    }
+
+    return std::sqrt(squaredError);
+  }
+
+  static std::vector<char> encode(
+      const Model& modelData, unsigned positionBits = DEFAULT_POSITION_BITS) {
+    if (positionBits < 1 || positionBits > MAX_POSITION_BITS) {
+      throw std::runtime_error(
+          "Failed to compress model: positions must take 1 to 24 bits");
+    }
+
+    const std::vector<float>& vertices = modelData.vertices_;
+    const std::vector<uint32_t>& indices = modelData.indices_;
+    const size_t vertexCount = vertices.size() / 3;
+
+    Header header;
+    header.positionBits = positionBits;
+    header.nameLength = modelData.modelName_.size();
+    header.vertexCount = vertexCount;
+    header.triangleCount = indices.size() / 3;
+    std::copy(modelData.uniformColor_.begin(), modelData.uniformColor_.end(),
+              header.uniformColor);
+    if (!modelData.colors_.empty()) {
+      header.flags |= FLAG_VERTEX_COLORS;
+    }
+    if (modelData.isVertexCacheOptimized()) {
+      header.flags |= FLAG_VERTEX_CACHE_OPTIMIZED;
+    }
+
+    //// Bounds, in which positions are quantized
+    float maximumBounds[3];
+    std::fill(header.minimumBounds, header.minimumBounds + 3, FLT_MAX);
+    std::fill(maximumBounds, maximumBounds + 3, -FLT_MAX);
+    for (size_t i = 0; i < vertices.size(); ++i) {
+      header.minimumBounds[i % 3] =
+          std::min(header.minimumBounds[i % 3], vertices[i]);
+      maximumBounds[i % 3] = std::max(maximumBounds[i % 3], vertices[i]);
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+      if (vertexCount == 0) {
+        header.minimumBounds[axis] = maximumBounds[axis] = 0.0f;
+      }
+      header.dimensions[axis] =
+          getExtent(header.minimumBounds[axis], maximumBounds[axis]);
+    }
+
+    //// Connectivity, numbering vertices as triangles first use them
+    std::vector<uint32_t> newVertexIds(vertexCount, NO_VERTEX);
+    std::vector<uint32_t> oldVertexIds;
+    std::vector<Predictor> predictors;
+    oldVertexIds.reserve(vertexCount);
+    predictors.reserve(vertexCount);
+
+    std::vector<char> connectivity;
+    connectivity.reserve(indices.size());
+    History history;
+    uint32_t lastVertex = 0;
+
+    for (size_t triangle = 0; triangle < header.triangleCount; ++triangle) {
+      const uint32_t* corners = &indices[3 * triangle];
+      for (int corner = 0; corner < 3; ++corner) {
+        if (corners[corner] >= vertexCount) {
+          throw std::runtime_error(
+              "Failed to compress model: an index is out of range");
+        }
+      }
+
+      //// Look for a rotation of the triangle whose first edge is one that
+      //// a previous triangle had, the other way around
+      int edgeSlot = -1, rotation = 0;
+      for (; rotation < 3 && edgeSlot < 0; ++rotation) {
+        uint32_t x = newVertexIds[corners[rotation]];
+        uint32_t y = newVertexIds[corners[(rotation + 1) % 3]];
+        if (x != NO_VERTEX && y != NO_VERTEX) {
+          edgeSlot = history.findEdge(y, x);
+        }
+      }
+
+      if (edgeSlot >= 0) {
+        --rotation;
+        const Edge edge = history.getEdge(edgeSlot);
+        const uint32_t z = corners[(rotation + 2) % 3];
+
+        uint8_t vertexCode;
+        int vertexSlot;
+        if (newVertexIds[z] == NO_VERTEX) {
+          vertexCode = 0;
+          newVertexIds[z] = oldVertexIds.size();
+          oldVertexIds.push_back(z);
+          predictors.push_back(Predictor{edge.a, edge.b, edge.opposite});
+        } else if ((vertexSlot = history.findVertex(newVertexIds[z])) >= 0) {
+          vertexCode = vertexSlot + 1;
+        } else {
+          vertexCode = EXPLICIT_VERTEX_CODE;
+        }
+
+        connectivity.push_back(char(((edgeSlot + 1) << 4) | vertexCode));
+        if (vertexCode == EXPLICIT_VERTEX_CODE) {
+          writeVarint(connectivity,
+                      zigzag(int64_t(newVertexIds[z]) - lastVertex));
+          lastVertex = newVertexIds[z];
+        }
+
+        history.pushEdge(Edge{edge.a, newVertexIds[z], edge.b});
+        history.pushEdge(Edge{newVertexIds[z], edge.b, edge.a});
+        history.pushVertex(newVertexIds[z]);
+      } else {
+        connectivity.push_back(0);
+
+        uint32_t triangleVertices[3];
+        for (int corner = 0; corner < 3; ++corner) {
+          const uint32_t vertex = corners[corner];
+          int vertexSlot;
+          if (newVertexIds[vertex] == NO_VERTEX) {
+            writeVarint(connectivity, 0);
+            newVertexIds[vertex] = oldVertexIds.size();
+            oldVertexIds.push_back(vertex);
+            predictors.push_back(Predictor{NO_VERTEX, 0, 0});
+          } else if ((vertexSlot = history.findVertex(newVertexIds[vertex])) >=
+                     0) {
+            writeVarint(connectivity, vertexSlot + 1);
+          } else {
+            writeVarint(connectivity,
+                        EXPLICIT_VERTEX_CODE +
+                            zigzag(int64_t(newVertexIds[vertex]) - lastVertex));
+            lastVertex = newVertexIds[vertex];
+          }
+          triangleVertices[corner] = newVertexIds[vertex];
+        }
+
+        pushTriangle(history, triangleVertices);
+      }
+    }
+
+    // Vertices no triangle uses go last, in their original order
+    for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+      if (newVertexIds[vertex] == NO_VERTEX) {
+        newVertexIds[vertex] = oldVertexIds.size();
+        oldVertexIds.push_back(vertex);
+        predictors.push_back(Predictor{NO_VERTEX, 0, 0});
+      }
+    }
+
+    //// Positions, as residuals from their predictions. Quantized in double
+    //// precision, so that only the half step is lost
+    const double stepCount = getStepCount(positionBits);
+    std::vector<int32_t> quantizedPositions(3 * vertexCount);
+    std::vector<char> positions;
+    positions.reserve(3 * vertexCount * 2);
+    for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+      const float* position = &vertices[3 * oldVertexIds[vertex]];
+      for (int axis = 0; axis < 3; ++axis) {
+        double step =
+            header.dimensions[axis] > 0.0f
+                ? (double(position[axis]) - header.minimumBounds[axis]) /
+                      header.dimensions[axis] * stepCount
+                : 0.0;
+        int32_t quantized =
+            int32_t(std::fmin(std::fmax(step + 0.5, 0.0), stepCount));
+        quantizedPositions[3 * vertex + axis] = quantized;
+        writeVarint(positions,
+                    zigzag(int64_t(quantized) -
+                           predict(quantizedPositions, predictors, vertex,
+                                   axis)));
+      }
+    }
+
+    //// Colors, 8 bits to a channel
+    std::vector<char> colors;
+    if (header.flags & FLAG_VERTEX_COLORS) {
+      colors.resize(3 * vertexCount);
+      for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+        for (int channel = 0; channel < 3; ++channel) {
+          float color = modelData.colors_[3 * oldVertexIds[vertex] + channel];
+          colors[3 * vertex + channel] =
+              char(uint8_t(std::fmin(std::fmax(color, 0.0f), 1.0f) * 255 +
+                           0.5f));
+        }
+      }
+    }
+
+    header.connectivitySize = connectivity.size();
+    header.positionSize = positions.size();
+
+    std::vector<char> encoded(sizeof(Header) + header.nameLength +
+                              connectivity.size() + positions.size() +
+                              colors.size());
+    char* cursor = encoded.data();
+    memcpy(cursor, &header, sizeof(Header));
+    cursor += sizeof(Header);
+    memcpy(cursor, modelData.modelName_.data(), header.nameLength);
+    cursor += header.nameLength;
+    memcpy(cursor, connectivity.data(), connectivity.size());
+    cursor += connectivity.size();
+    memcpy(cursor, positions.data(), positions.size());
+    cursor += positions.size();
+    memcpy(cursor, colors.data(), colors.size());
+    return encoded;
+  }
+
+  static Model decode(const char* begin, const char* end) {
+    Header header;
+    if (size_t(end - begin) < sizeof(Header)) {
+      throw std::runtime_error("Corrupt compressed model: truncated header");
+    }
+    memcpy(&header, begin, sizeof(Header));
+    if (memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != FORMAT_VERSION) {
+      throw std::runtime_error(
+          "Not a compressed model, or one of an unsupported version");
+    }
+
+    // No size or count can exceed the file's size, which keeps the sum of
+    // the section sizes from wrapping around
+    const uint64_t fileSize = end - begin;
+    for (uint64_t size :
+         {header.nameLength, header.vertexCount, header.triangleCount,
+          header.connectivitySize, header.positionSize}) {
+      if (size > fileSize) {
+        throw std::runtime_error("Corrupt compressed model: bad header");
+      }
+    }
+
+    const uint64_t vertexCount = header.vertexCount;
+    const uint64_t colorSize =
+        header.flags & FLAG_VERTEX_COLORS ? 3 * vertexCount : 0;
+    // Every triangle takes at least a byte of connectivity and every vertex
+    // three of positions, which bounds what a corrupt header can allocate
+    if (header.positionBits < 1 || header.positionBits > MAX_POSITION_BITS ||
+        vertexCount >= NO_VERTEX ||
+        header.triangleCount > header.connectivitySize ||
+        vertexCount > header.positionSize / 3 ||
+        fileSize != sizeof(Header) + header.nameLength +
+                        header.connectivitySize + header.positionSize +
+                        colorSize) {
+      throw std::runtime_error("Corrupt compressed model: bad header");
+    }
+
+    Model modelData;
+    const char* cursor = begin + sizeof(Header);
+    modelData.setName(std::string(cursor, header.nameLength));
+    modelData.setUniformColor(
+        std::vector<float>(header.uniformColor, header.uniformColor + 3));
+    modelData.setVertexCacheOptimized(
+        (header.flags & FLAG_VERTEX_CACHE_OPTIMIZED) != 0);
+    cursor += header.nameLength;
+
+    //// Connectivity
+    std::vector<uint32_t>& indices = modelData.indices_;
+    indices.resize(3 * header.triangleCount);
+    std::vector<Predictor> predictors;
+    predictors.reserve(vertexCount);
+
+    const char* connectivityEnd = cursor + header.connectivitySize;
+    History history;
+    uint32_t lastVertex = 0;
+    uint32_t nextVertex = 0;
+    for (uint64_t triangle = 0; triangle < header.triangleCount; ++triangle) {
+      if (cursor == connectivityEnd) {
+        throw std::runtime_error("Corrupt compressed model: truncated");
+      }
+
+      uint32_t* triangleVertices = &indices[3 * triangle];
+      const uint8_t code = *cursor++;
+      if (code >> 4) {
+        const Edge edge = history.getEdge((code >> 4) - 1);
+        const uint8_t vertexCode = code & 0xF;
+
+        uint32_t z;
+        if (vertexCode == 0) {
+          z = nextVertex++;
+          predictors.push_back(Predictor{edge.a, edge.b, edge.opposite});
+        } else if (vertexCode != EXPLICIT_VERTEX_CODE) {
+          z = history.getVertex(vertexCode - 1);
+        } else {
+          z = lastVertex = lastVertex + unzigzag(readVarint(cursor,
+                                                            connectivityEnd));
+        }
+
+        triangleVertices[0] = edge.b;
+        triangleVertices[1] = edge.a;
+        triangleVertices[2] = z;
+        history.pushEdge(Edge{edge.a, z, edge.b});
+        history.pushEdge(Edge{z, edge.b, edge.a});
+        history.pushVertex(z);
+      } else {
+        for (int corner = 0; corner < 3; ++corner) {
+          const uint64_t reference = readVarint(cursor, connectivityEnd);
+          if (reference == 0) {
+            triangleVertices[corner] = nextVertex++;
+            predictors.push_back(Predictor{NO_VERTEX, 0, 0});
+          } else if (reference < EXPLICIT_VERTEX_CODE) {
+            triangleVertices[corner] = history.getVertex(reference - 1);
+          } else {
+            triangleVertices[corner] = lastVertex =
+                lastVertex + unzigzag(reference - EXPLICIT_VERTEX_CODE);
+          }
+        }
+
+        pushTriangle(history, triangleVertices);
+      }
+
+      if (nextVertex > vertexCount || triangleVertices[0] >= nextVertex ||
+          triangleVertices[1] >= nextVertex ||
+          triangleVertices[2] >= nextVertex) {
+        throw std::runtime_error(
+            "Corrupt compressed model: a vertex is out of range");
+      }
+    }
+    if (cursor != connectivityEnd) {
+      throw std::runtime_error("Corrupt compressed model: bad connectivity");
+    }
+    predictors.resize(vertexCount, Predictor{NO_VERTEX, 0, 0});
+
+    //// Positions
+    const char* positionsEnd = cursor + header.positionSize;
+    std::vector<int32_t> quantizedPositions(3 * vertexCount);
+    std::vector<float>& vertices = modelData.vertices_;
+    vertices.resize(3 * vertexCount);
+    double stepSize[3];
+    for (int axis = 0; axis < 3; ++axis) {
+      stepSize[axis] =
+          header.dimensions[axis] / getStepCount(header.positionBits);
+    }
+    for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+      for (int axis = 0; axis < 3; ++axis) {
+        int32_t quantized = int32_t(
+            uint32_t(predict(quantizedPositions, predictors, vertex, axis)) +
+            uint32_t(unzigzag(readVarint(cursor, positionsEnd))));
+        quantizedPositions[3 * vertex + axis] = quantized;
+        vertices[3 * vertex + axis] =
+            float(header.minimumBounds[axis] + quantized * stepSize[axis]);
+      }
+    }
+    if (cursor != positionsEnd) {
+      throw std::runtime_error("Corrupt compressed model: bad positions");
+    }
+    modelData.invalidateBounds();
+
+    //// Colors
+    std::vector<float>& colors = modelData.colors_;
+    colors.resize(colorSize);
+    for (uint64_t i = 0; i < colorSize; ++i) {
+      colors[i] = uint8_t(cursor[i]) / 255.0f;
+    }
+
+    return modelData;
+  }
+
+  static void write(const Model& modelData, const std::string& filePath,
+                    unsigned positionBits = DEFAULT_POSITION_BITS) {
+    std::vector<char> encoded = encode(modelData, positionBits);
+
+    std::ofstream outputFileStream(filePath, std::ios::binary);
+    if (!outputFileStream.is_open()) {
+      throw std::runtime_error("Failed to open compressed model file: " +
+                               filePath);
+    }
+
+    outputFileStream.write(encoded.data(), encoded.size());
+    outputFileStream.close();
+    if (!outputFileStream) {
+      std::remove(filePath.c_str());
+      throw std::runtime_error("Failed to write compressed model file: " +
+                               filePath);
+    }
+  }
+
+  static Model read(const std::string& filePath) {
+    MappedFile modelFile(filePath);
+    return decode(modelFile.begin(), modelFile.end());
+  }
+
+ private:
+  static constexpr uint32_t FLAG_VERTEX_COLORS = 1 << 0;
+  static constexpr uint32_t FLAG_VERTEX_CACHE_OPTIMIZED = 1 << 1;
+
+  static constexpr char MAGIC[8] = {'M', 'D', 'L', 'Z', '\0', '\0', '\0', '\0'};
+
+  static constexpr uint32_t NO_VERTEX = UINT32_MAX;
+
+  // Vertex codes up to this one name a slot of the recent vertices
+  static constexpr uint8_t EXPLICIT_VERTEX_CODE = 15;
+
+  static constexpr unsigned EDGE_SLOT_COUNT = 15;
+  static constexpr unsigned VERTEX_SLOT_COUNT = 14;
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t positionBits;
+    uint64_t nameLength;
+    uint64_t vertexCount;
+    uint64_t triangleCount;
+    uint64_t connectivitySize;
+    uint64_t positionSize;
+    float minimumBounds[3];
+    float dimensions[3];
+    float uniformColor[3];
+    uint32_t flags;
+
+    Header() {
+      memcpy(magic, MAGIC, sizeof(magic));
+      version = FORMAT_VERSION;
+      positionBits = DEFAULT_POSITION_BITS;
+      nameLength = vertexCount = triangleCount = 0;
+      connectivitySize = positionSize = 0;
+      std::fill(minimumBounds, minimumBounds + 3, 0.0f);
+      std::fill(dimensions, dimensions + 3, 0.0f);
+      std::fill(uniformColor, uniformColor + 3, 1.0f);
+      flags = 0;
+    }
+  };
+
+  // A directed edge, and the third vertex of the triangle it came from
+  struct Edge {
+    uint32_t a;
+    uint32_t b;
+    uint32_t opposite;
+  };
+
+  // The parallelogram a + b - c, or the previous vertex if a is NO_VERTEX
+  struct Predictor {
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+  };
+
+  // Recently coded edges and vertices, newest in slot 0. Encoder and decoder
+  // update theirs identically, so slots can stand in for vertex indices
+  class History {
+   public:
+    History() : edgeCount_(0), vertexCount_(0) {
+    }
+
+    int findEdge(uint32_t a, uint32_t b) const {
+      unsigned slotCount = std::min(edgeCount_, EDGE_SLOT_COUNT);
+      for (unsigned slot = 0; slot < slotCount; ++slot) {
+        const Edge& edge = edges_[(edgeCount_ - 1 - slot) % RING_SIZE];
+        if (edge.a == a && edge.b == b) {
+          return slot;
+        }
+      }
+
+      return -1;
+    }
+
+    int findVertex(uint32_t vertex) const {
+      unsigned slotCount = std::min(vertexCount_, VERTEX_SLOT_COUNT);
+      for (unsigned slot = 0; slot < slotCount; ++slot) {
+        if (vertices_[(vertexCount_ - 1 - slot) % RING_SIZE] == vertex) {
+          return slot;
+        }
+      }
+
+      return -1;
+    }
+
+    Edge getEdge(unsigned slot) const {
+      if (slot >= std::min(edgeCount_, EDGE_SLOT_COUNT)) {
+        throw std::runtime_error("Corrupt compressed model: bad edge");
+      }
+
+      return edges_[(edgeCount_ - 1 - slot) % RING_SIZE];
+    }
+
+    uint32_t getVertex(uint64_t slot) const {
+      if (slot >= std::min(vertexCount_, VERTEX_SLOT_COUNT)) {
+        throw std::runtime_error("Corrupt compressed model: bad vertex");
+      }
+
+      return vertices_[(vertexCount_ - 1 - slot) % RING_SIZE];
+    }
+
+    void pushEdge(const Edge& edge) {
+      edges_[edgeCount_++ % RING_SIZE] = edge;
+    }
+
+    void pushVertex(uint32_t vertex) {
+      vertices_[vertexCount_++ % RING_SIZE] = vertex;
+    }
+
+   private:
+    static constexpr unsigned RING_SIZE = 16;
+
+    Edge edges_[RING_SIZE];
+    uint32_t vertices_[RING_SIZE];
+    unsigned edgeCount_;
+    unsigned vertexCount_;
+  };
+
+  static double getStepCount(unsigned positionBits) {
+    return double((uint32_t(1) << positionBits) - 1);
+  }
+
+  // Rounded up where single precision would leave the maximum past the
+  // minimum plus the extent, so that every position quantizes within it
+  static float getExtent(float minimum, float maximum) {
+    float extent = maximum - minimum;
+    if (double(minimum) + extent < maximum) {
+      extent = std::nextafter(extent, FLT_MAX);
+    }
+    return extent;
+  }
+
+  static void pushTriangle(History& history, const uint32_t* vertices) {
+    for (int corner = 0; corner < 3; ++corner) {
+      history.pushEdge(Edge{vertices[corner], vertices[(corner + 1) % 3],
+                            vertices[(corner + 2) % 3]});
+      history.pushVertex(vertices[corner]);
+    }
+  }
+
+  // Every vertex a predictor refers to comes before the one it predicts.
+  // Wraps around rather than overflowing on corrupt positions
+  static int32_t predict(const std::vector<int32_t>& quantizedPositions,
+                         const std::vector<Predictor>& predictors,
+                         uint32_t vertex, int axis) {
+    const Predictor& predictor = predictors[vertex];
+    if (predictor.a == NO_VERTEX) {
+      return vertex > 0 ? quantizedPositions[3 * (vertex - 1) + axis] : 0;
+    }
+
+    return int32_t(uint32_t(quantizedPositions[3 * predictor.a + axis]) +
+                   uint32_t(quantizedPositions[3 * predictor.b + axis]) -
+                   uint32_t(quantizedPositions[3 * predictor.c + axis]));
+  }
+
+  static uint64_t zigzag(int64_t value) {
+    return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+  }
+
+  static int64_t unzigzag(uint64_t value) {
+    return int64_t(value >> 1) ^ -int64_t(value & 1);
+  }
+
+  // LEB128: seven bits to a byte, low bits first
+  static void writeVarint(std::vector<char>& output, uint64_t value) {
+    while (value >= 0x80) {
+      output.push_back(char(value | 0x80));
+      value >>= 7;
+    }
+    output.push_back(char(value));
+  }
+
+  static uint64_t readVarint(const char*& cursor, const char* end) {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      if (cursor == end) {
+        throw std::runtime_error("Corrupt compressed model: truncated");
+      }
+
+      uint8_t byte = *cursor++;
+      value |= uint64_t(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) {
+        return value;
+      }
+    }
+
+    throw std::runtime_error("Corrupt compressed model: bad varint");
+  }
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "Model.hpp"
+
+// Writes models to disk on a background thread, so that the render loop keeps
+// drawing while a large model is exported. The model is snapshotted when the
+// export starts; later edits to it do not affect the file
+class ModelExporter {
+ public:
+  ModelExporter() : exporting_(false) {
+  }
+
+  ModelExporter(const ModelExporter&) = delete;
+  ModelExporter& operator=(const ModelExporter&) = delete;
+
+  ~ModelExporter() {
+    if (exportThread_.joinable()) {
+      exportThread_.join();
+    }
+  }
+
+  bool isExporting() const {
+    return exporting_;
+  }
+
+  // Returns false, without starting anything, if the previous export is
+  // still running
+  bool exportModel(const Model& modelData, const std::string& filePath,
+                   int significantDigits = 0) {
+    if (exporting_) {
+      return false;
+    }
+
+    if (exportThread_.joinable()) {
+      exportThread_.join();
+    }
+
+    exporting_ = true;
+    std::shared_ptr<const Model> snapshot = std::make_shared<Model>(modelData);
+    exportThread_ = std::thread([this, snapshot, filePath, significantDigits] {
+      try {
+        snapshot->writeToFile(filePath, significantDigits);
+        std::cout << "Wrote model to " << filePath << std::endl;
+      } catch (const std::exception& exception) {
+        std::cerr << "Failed to export model: " << exception.what()
+                  << std::endl;
+      }
+
+      exporting_ = false;
+    });
+
+    return true;
+  }
+
+ private:
+  std::atomic<bool> exporting_;
+  std::thread exportThread_;
+};
@@ -1,24 +1,195 @@
 #pragma once
 
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "LoadStatistics.hpp"
+#include "MappedFile.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "ModelCache.hpp"
+#include "ModelCodec.hpp"
 #include "Model.hpp"
+#include "NormalGenerator.hpp"
+#include "ThreadPool.hpp"
 
 class ModelFactory {
  public:
-  ModelFactory(const std::string& modelDataFilePath) {
-    // Load the data from the file into a data structure
-    std::ifstream modelDataFileStream(modelDataFilePath);
-    model_ = loadModel(modelDataFileStream);
+  enum MODEL_LOAD_MODE { STREAM, MAPPED, PARALLEL };
+
+  // What the post-processing reports goes to logStream, and where the time
+  // went to getLoadStatistics
+  ModelFactory(const std::string& modelDataFilePath,
+               MODEL_LOAD_MODE modelLoadMode = STREAM,
+               bool useModelCache = false, bool optimizeVertexCache = false,
+               bool generateLevelsOfDetail = false,
+               bool generateNormals = false,
+               std::ostream& logStream = std::cout)
+      : logStream_(&logStream) {
+    ModelCache modelCache(modelDataFilePath);
+    bool loadedFromCache = false;
+    if (useModelCache) {
+      LoadStatistics::ScopedTimer timer(loadStatistics_, "cache load");
+      loadedFromCache = modelCache.load(model_);
+    }
+    if (!loadedFromCache) {
+      parseModelFile(modelDataFilePath, modelLoadMode);
+    }
+
+    //// Post-processing that the cache may already hold the results of
+    bool modelChanged = false;
+    if (generateLevelsOfDetail && model_.getLevelOfDetailCount() == 1) {
+      LoadStatistics::ScopedTimer timer(loadStatistics_, "levels of detail");
+      generateModelLevelsOfDetail();
+      modelChanged = true;
+    }
+
+    // New levels of detail have not been reordered yet
+    if (optimizeVertexCache &&
+        (!model_.isVertexCacheOptimized() || modelChanged)) {
+      LoadStatistics::ScopedTimer timer(loadStatistics_,
+                                        "vertex cache optimization");
+      optimizeModel();
+      modelChanged = true;
+    }
+
+    if (generateNormals && !model_.hasNormals()) {
+      LoadStatistics::ScopedTimer timer(loadStatistics_, "normals");
+      NormalGenerator normalGenerator(model_.getVertices(),
+                                      model_.getIndices());
+      model_.getNormals().swap(normalGenerator.getNormals());
+      modelChanged = true;
+    }
+
+    if (useModelCache && (!loadedFromCache || modelChanged)) {
+      LoadStatistics::ScopedTimer timer(loadStatistics_, "cache store");
+      storeModel(modelCache);
+    }
+
+    loadStatistics_.addCount("vertices", model_.getVertices().size() / 3);
+    loadStatistics_.addCount("triangles", model_.getTriangleCount());
+    loadStatistics_.setModelMemory(model_);
   }
 
   Model getModel() const {
     return model_;
   }
 
+  // Moves the model out instead of copying it, leaving the factory's empty
+  Model takeModel() {
+    return std::move(model_);
+  }
+
+  const LoadStatistics& getLoadStatistics() const {
+    return loadStatistics_;
+  }
+
  private:
+  static const unsigned MAX_LEVEL_OF_DETAIL_COUNT = 8;
+  static const size_t MIN_LEVEL_OF_DETAIL_TRIANGLE_COUNT = 256;
+
   Model model_;
+  std::ostream* logStream_;
+  LoadStatistics loadStatistics_;
+
+  void parseModelFile(const std::string& modelDataFilePath,
+                      MODEL_LOAD_MODE modelLoadMode) {
+    // Compressed models are decoded the same way whichever loader is asked
+    // for
+    if (ModelCodec::isCompressedModelFile(modelDataFilePath)) {
+      LoadStatistics::ScopedTimer timer(loadStatistics_, "decode");
+      model_ = ModelCodec::read(modelDataFilePath);
+      return;
+    }
+
+    // Reading the file is part of parsing: the stream loader reads as it
+    // goes, and a mapped file is paged in as the parser first touches it
+    switch (modelLoadMode) {
+      case STREAM: {
+        // Load the data from the file into a data structure
+        LoadStatistics::ScopedTimer timer(loadStatistics_, "open");
+        std::ifstream modelDataFileStream(modelDataFilePath);
+        timer.startPhase("parse");
+        model_ = loadModel(modelDataFileStream);
+        break;
+      }
+      case MAPPED: {
+        // Parse the data in place, straight out of the page cache
+        std::unique_ptr<MappedFile> modelDataFile = mapModelFile(
+            modelDataFilePath);
+        LoadStatistics::ScopedTimer timer(loadStatistics_, "parse");
+        model_ = parseModel(modelDataFile->begin(), modelDataFile->end());
+        break;
+      }
+      case PARALLEL: {
+        std::unique_ptr<MappedFile> modelDataFile = mapModelFile(
+            modelDataFilePath);
+        model_ = parseModelInParallel(modelDataFile->begin(),
+                                      modelDataFile->end());
+        break;
+      }
+      default:
+        throw std::runtime_error("Unrecognized model load mode");
+    }
+  }
+
+  std::unique_ptr<MappedFile> mapModelFile(const std::string& filePath) {
+    LoadStatistics::ScopedTimer timer(loadStatistics_, "map");
+    return std::unique_ptr<MappedFile>(new MappedFile(filePath));
+  }
+
+  // Each level halves the triangle count of the one before it
+  void generateModelLevelsOfDetail() {
+    MeshSimplifier meshSimplifier(model_.getVertices());
+    std::vector<uint32_t> levelIndices = model_.getIndices();
+
+    *logStream_ << "Levels of detail (triangles): "
+                << levelIndices.size() / 3;
+    while (model_.getLevelOfDetailCount() < MAX_LEVEL_OF_DETAIL_COUNT &&
+           levelIndices.size() / 3 > MIN_LEVEL_OF_DETAIL_TRIANGLE_COUNT) {
+      std::vector<uint32_t> nextLevelIndices =
+          meshSimplifier.simplify(levelIndices, levelIndices.size() / 6);
+
+      // Stop once the flip check blocks most collapses
+      if (nextLevelIndices.size() > levelIndices.size() * 3 / 4) {
+        break;
+      }
+
+      model_.addLevelOfDetail(nextLevelIndices);
+      levelIndices.swap(nextLevelIndices);
+      *logStream_ << " " << levelIndices.size() / 3;
+    }
+    *logStream_ << std::endl;
+  }
+
+  void optimizeModel() {
+    MeshOptimizer meshOptimizer(model_);
+    *logStream_ << "Vertex cache ACMR: " << meshOptimizer.getAcmrBefore()
+                << " before optimization, " << meshOptimizer.getAcmrAfter()
+                << " after" << std::endl;
+  }
+
+  void storeModel(const ModelCache& modelCache) const {
+    // A missing cache only costs the next launch a reparse
+    try {
+      modelCache.store(model_);
+    } catch (const std::exception& exception) {
+      std::cerr << "Warning: " << exception.what() << std::endl;
+    }
+  }
 
   Model loadModel(std::ifstream& fileStream) {
     Model modelData;
+    ModelRecordSink recordSink(modelData);
 
     if (!fileStream.good()) {
       throw std::runtime_error(
@@ -37,54 +208,411 @@ class ModelFactory {
       char c = nextLine[0];
       switch (c) {
         case 'o': {
-          modelData.setName(&nextLine[2]);
+          // Parsed like the other loaders' names, without a trailing '\r'
+          parseLine(recordSink, nextLine.data(),
+                    nextLine.data() + nextLine.size());
           break;
         }
         case 'v': {
           std::stringstream ss(nextLine);
           char c;
-          float f1, f2, f3;
+          float f1, f2, f3, r, g, b;
           if (!(ss >> c >> f1 >> f2 >> f3)) {
             // Could be 'vt' entry; skip
             break;
           }
 
+          // Optionally followed by a color
+          if (ss >> r >> g >> b) {
+            modelData.addVertex(f1, f2, f3, r, g, b);
+            break;
+          }
+
           modelData.addVertex(std::vector<float>{f1, f2, f3});
           break;
         }
-        // todo: add support for faces with vertex counts > 4
         case 'f': {
-          std::stringstream ss(nextLine);
-          char c;
-          unsigned u1, u2, u3, u4;
+          // Fan triangulated by the same parser as the other loaders, so
+          // that every loader builds the same model from a file
+          parseLine(recordSink, nextLine.data(),
+                    nextLine.data() + nextLine.size());
+          break;
+        }
+        default:
+          // todo?
+          // throw std::runtime_error(fileFormatErrorMessage);
+          break;
+      }
+    }
 
-          //// Check if the face is a polygon, if so, convert to two triangles
-          if ((ss >> c >> u1 >> u2 >> u3 >> u4)) {
-            // Subtract by 1; the data is 1-indexed
-            modelData.addPolygon(std::vector<unsigned>{u1 - 1, u2 - 1, u3 - 1});
-            modelData.addPolygon(std::vector<unsigned>{u1 - 1, u3 - 1, u4 - 1});
-            break;
-          }
+    recordFaceCounts(recordSink);
+    return modelData;
+  }
 
-          // Reset string stream
-          ss.str(nextLine);
-          ss.clear();
+  // Faces as the file has them, and how many of those had to be
+  // triangulated; the parsers triangulate as they go, so that takes no time
+  // of its own
+  struct FaceCounter {
+    uint64_t faceCount = 0;
+    uint64_t triangulatedFaceCount = 0;
 
-          if ((ss >> c >> u1 >> u2 >> u3)) {
-            // Subtract by 1; the data is 1-indexed
-            modelData.addPolygon(std::vector<unsigned>{u1 - 1, u2 - 1, u3 - 1});
-            break;
+    void countFace(unsigned vertexCount) {
+      ++faceCount;
+      triangulatedFaceCount += vertexCount > 3;
+    }
+  };
+
+  void recordFaceCounts(const FaceCounter& faceCounter) {
+    loadStatistics_.addCount("faces", faceCounter.faceCount);
+    loadStatistics_.addCount("faces triangulated",
+                             faceCounter.triangulatedFaceCount);
+  }
+
+  // Receives parsed records straight into a Model
+  class ModelRecordSink : public FaceCounter {
+   public:
+    ModelRecordSink(Model& modelData) : modelData_(modelData) {
+    }
+
+    void setName(const std::string& name) {
+      modelData_.setName(name);
+    }
+
+    void addVertex(float x, float y, float z) {
+      modelData_.addVertex(x, y, z);
+    }
+
+    void addVertex(float x, float y, float z, float r, float g, float b) {
+      modelData_.addVertex(x, y, z, r, g, b);
+    }
+
+    unsigned resolveIndex(long index) {
+      // OBJ indices are 1-indexed; negative indices count back from the most
+      // recently declared vertex
+      const long vertexCount = modelData_.vertices_.size() / 3;
+      long resolvedIndex = index > 0 ? index - 1 : vertexCount + index;
+      if (index == 0 || resolvedIndex < 0 || resolvedIndex >= vertexCount) {
+        throw std::runtime_error("Invalid vertex index specified");
+      }
+
+      return resolvedIndex;
+    }
+
+    void addTriangle(unsigned u1, unsigned u2, unsigned u3) {
+      modelData_.addTriangle(u1, u2, u3);
+    }
+
+   private:
+    Model& modelData_;
+  };
+
+  // Buffers the records of one chunk of the file; indices that depend on the
+  // vertices declared in earlier chunks are fixed up when the chunks are merged
+  class ChunkRecordSink : public FaceCounter {
+   public:
+    std::string name;
+    bool hasName = false;
+
+    // Holds only the vertices (and colors) of the chunk
+    Model modelData;
+    std::vector<int64_t> triangleIndices;
+
+    // How far forward of the chunk's own vertices an absolute index reaches,
+    // and how far back before them a relative index reaches; the merge checks
+    // both against the number of vertices in earlier chunks
+    int64_t maxForwardReach = -1;
+    int64_t maxBackwardReach = 0;
+
+    // Relative indices are stored biased by this, so that the merge can tell
+    // them apart and add the vertex offset of the chunk
+    static constexpr int64_t RELATIVE_INDEX_BIAS = int64_t(1) << 62;
+
+    void setName(const std::string& newName) {
+      name = newName;
+      hasName = true;
+    }
+
+    void addVertex(float x, float y, float z) {
+      modelData.addVertex(x, y, z);
+    }
+
+    void addVertex(float x, float y, float z, float r, float g, float b) {
+      modelData.addVertex(x, y, z, r, g, b);
+    }
+
+    int64_t resolveIndex(long index) {
+      const int64_t vertexCount = modelData.vertices_.size() / 3;
+      if (index == 0) {
+        throw std::runtime_error("Invalid vertex index specified");
+      }
+
+      if (index > 0) {
+        maxForwardReach = std::max(maxForwardReach, index - 1 - vertexCount);
+        return index - 1;
+      }
+
+      maxBackwardReach = std::max(maxBackwardReach, -(vertexCount + index));
+      return RELATIVE_INDEX_BIAS + vertexCount + index;
+    }
+
+    void addTriangle(int64_t u1, int64_t u2, int64_t u3) {
+      triangleIndices.push_back(u1);
+      triangleIndices.push_back(u2);
+      triangleIndices.push_back(u3);
+    }
+  };
+
+  // Parses OBJ data held in memory without any per-line allocation; faces with
+  // any number of vertices are triangulated as fans
+  Model parseModel(const char* begin, const char* end) {
+    Model modelData;
+    ModelRecordSink recordSink(modelData);
+    parseRecords(begin, end, recordSink);
+
+    recordFaceCounts(recordSink);
+    return modelData;
+  }
+
+  // Splits the data at line boundaries, parses the chunks concurrently and
+  // merges them in file order, so the result matches parseModel exactly
+  Model parseModelInParallel(const char* begin, const char* end) {
+    ThreadPool threadPool;
+    LoadStatistics::ScopedTimer timer(loadStatistics_, "parse chunks");
+
+    // Keep chunks large enough that scheduling overhead stays negligible
+    const size_t minimumChunkSize = 1 << 20;
+    size_t chunkCount = std::min<size_t>(
+        threadPool.getThreadCount() * 4, (end - begin) / minimumChunkSize);
+    chunkCount = std::max<size_t>(chunkCount, 1);
+
+    std::vector<const char*> chunkBoundaries(chunkCount + 1, end);
+    chunkBoundaries[0] = begin;
+    for (size_t i = 1; i < chunkCount; ++i) {
+      const char* boundary = begin + (end - begin) * i / chunkCount;
+      boundary = std::max(boundary, chunkBoundaries[i - 1]);
+
+      const char* lineEnd =
+          static_cast<const char*>(memchr(boundary, '\n', end - boundary));
+      chunkBoundaries[i] = lineEnd == nullptr ? end : lineEnd + 1;
+    }
+
+    std::vector<ChunkRecordSink> chunks(chunkCount);
+    threadPool.parallelFor(chunkCount, [&](size_t i) {
+      parseRecords(chunkBoundaries[i], chunkBoundaries[i + 1], chunks[i]);
+    });
+
+    // The merge is timed apart, as it copies everything once more
+    timer.startPhase("merge chunks");
+
+    //// Prefix sums give each chunk's position in the merged model
+    std::vector<size_t> vertexOffsets(chunkCount + 1, 0),
+        triangleOffsets(chunkCount + 1, 0);
+    FaceCounter faceCounter;
+    for (size_t i = 0; i < chunkCount; ++i) {
+      const ChunkRecordSink& chunk = chunks[i];
+      faceCounter.faceCount += chunk.faceCount;
+      faceCounter.triangulatedFaceCount += chunk.triangulatedFaceCount;
+      const int64_t vertexOffset = vertexOffsets[i];
+      if (chunk.maxForwardReach >= vertexOffset ||
+          chunk.maxBackwardReach > vertexOffset) {
+        throw std::runtime_error("Invalid vertex index specified");
+      }
+
+      vertexOffsets[i + 1] =
+          vertexOffset + chunk.modelData.vertices_.size() / 3;
+      triangleOffsets[i + 1] =
+          triangleOffsets[i] + chunk.triangleIndices.size() / 3;
+    }
+
+    Model modelData;
+    bool hasVertexColors = false;
+    for (const ChunkRecordSink& chunk : chunks) {
+      if (chunk.hasName) {
+        modelData.setName(chunk.name);
+      }
+
+      hasVertexColors = hasVertexColors || chunk.modelData.hasVertexColors();
+    }
+
+    modelData.vertices_.resize(vertexOffsets[chunkCount] * 3);
+    modelData.invalidateBounds();
+    if (hasVertexColors) {
+      modelData.colors_.resize(vertexOffsets[chunkCount] * 3);
+    }
+    modelData.indices_.resize(triangleOffsets[chunkCount] * 3);
+
+    threadPool.parallelFor(chunkCount, [&](size_t i) {
+      ChunkRecordSink& chunk = chunks[i];
+      const Model& chunkModelData = chunk.modelData;
+      std::copy(chunkModelData.vertices_.begin(),
+                chunkModelData.vertices_.end(),
+                modelData.vertices_.begin() + vertexOffsets[i] * 3);
+
+      // Chunks without colors of their own take the uniform color, as they
+      // would have when parsed sequentially
+      if (hasVertexColors && chunkModelData.hasVertexColors()) {
+        std::copy(chunkModelData.colors_.begin(), chunkModelData.colors_.end(),
+                  modelData.colors_.begin() + vertexOffsets[i] * 3);
+      } else if (hasVertexColors) {
+        for (size_t j = vertexOffsets[i]; j < vertexOffsets[i + 1]; ++j) {
+          std::copy(modelData.uniformColor_.begin(),
+                    modelData.uniformColor_.end(),
+                    modelData.colors_.begin() + j * 3);
+        }
+      }
+
+      uint32_t* indices = &modelData.indices_[triangleOffsets[i] * 3];
+      for (int64_t index : chunk.triangleIndices) {
+        if (index >= ChunkRecordSink::RELATIVE_INDEX_BIAS / 2) {
+          index -= ChunkRecordSink::RELATIVE_INDEX_BIAS;
+          index += vertexOffsets[i];
+        }
+
+        *indices++ = index;
+      }
+    });
+
+    recordFaceCounts(faceCounter);
+    return modelData;
+  }
+
+  template <typename RecordSink>
+  static void parseRecords(const char* begin, const char* end,
+                           RecordSink& recordSink) {
+    const char* cursor = begin;
+    while (cursor < end) {
+      const char* lineEnd =
+          static_cast<const char*>(memchr(cursor, '\n', end - cursor));
+      if (lineEnd == nullptr) {
+        lineEnd = end;
+      }
+
+      parseLine(recordSink, cursor, lineEnd);
+      cursor = lineEnd + 1;
+    }
+  }
+
+  template <typename RecordSink>
+  static void parseLine(RecordSink& recordSink, const char* cursor,
+                        const char* lineEnd) {
+    const std::string fileFormatErrorMessage =
+        "invalid model specification file format";
+
+    if (lineEnd - cursor < 2 || !isBlank(cursor[1])) {
+      // Blank line, or a multi-character keyword such as 'vt' or 'vn'; skip
+      return;
+    }
+
+    switch (*cursor) {
+      case 'o': {
+        const char* nameBegin = cursor + 2;
+        const char* nameEnd = lineEnd;
+        if (nameEnd > nameBegin && nameEnd[-1] == '\r') {
+          --nameEnd;
+        }
+
+        recordSink.setName(
+            std::string(nameBegin, std::max(nameBegin, nameEnd)));
+        break;
+      }
+      case 'v': {
+        float f1, f2, f3;
+        cursor += 1;
+        if (!parseFloat(cursor, lineEnd, f1) ||
+            !parseFloat(cursor, lineEnd, f2) ||
+            !parseFloat(cursor, lineEnd, f3)) {
+          // Malformed vertex; skip, as the stream loader does
+          break;
+        }
+
+        // Optionally followed by a color
+        float r, g, b;
+        if (parseFloat(cursor, lineEnd, r) && parseFloat(cursor, lineEnd, g) &&
+            parseFloat(cursor, lineEnd, b)) {
+          recordSink.addVertex(f1, f2, f3, r, g, b);
+          break;
+        }
+
+        recordSink.addVertex(f1, f2, f3);
+        break;
+      }
+      case 'f': {
+        cursor += 1;
+
+        // Triangulate as a fan around the first vertex, without buffering the
+        // whole polygon
+        long index;
+        decltype(recordSink.resolveIndex(0)) first = 0, previous = 0;
+        unsigned polygonSize = 0;
+        while (parseIndex(cursor, lineEnd, index)) {
+          auto resolvedIndex = recordSink.resolveIndex(index);
+          if (polygonSize == 0) {
+            first = resolvedIndex;
+          } else if (polygonSize >= 2) {
+            recordSink.addTriangle(first, previous, resolvedIndex);
           }
 
+          previous = resolvedIndex;
+          ++polygonSize;
+        }
+
+        if (polygonSize < 3) {
           throw std::runtime_error(fileFormatErrorMessage);
         }
-        default:
-          // todo?
-          // throw std::runtime_error(fileFormatErrorMessage);
-          break;
+        recordSink.countFace(polygonSize);
+        break;
       }
+      default:
+        break;
     }
+  }
 
-    return modelData;
+  static bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+  }
+
+  static void skipBlanks(const char*& cursor, const char* lineEnd) {
+    while (cursor < lineEnd && isBlank(*cursor)) {
+      ++cursor;
+    }
+  }
+
+  static bool parseFloat(const char*& cursor, const char* lineEnd,
+                         float& value) {
+    skipBlanks(cursor, lineEnd);
+
+    // from_chars does not accept an explicit plus sign
+    if (cursor < lineEnd && *cursor == '+') {
+      ++cursor;
+    }
+
+    std::from_chars_result result = std::from_chars(cursor, lineEnd, value);
+    if (result.ec != std::errc()) {
+      return false;
+    }
+
+    cursor = result.ptr;
+    return true;
+  }
+
+  // Parses the vertex index of a face element, skipping any '/vt/vn' suffix
+  static bool parseIndex(const char*& cursor, const char* lineEnd,
+                         long& index) {
+    skipBlanks(cursor, lineEnd);
+    if (cursor == lineEnd) {
+      return false;
+    }
+
+    std::from_chars_result result = std::from_chars(cursor, lineEnd, index);
+    if (result.ec != std::errc()) {
+      throw std::runtime_error("invalid model specification file format");
+    }
+
+    cursor = result.ptr;
+    while (cursor < lineEnd && !isBlank(*cursor)) {
+      ++cursor;
+    }
+
+    return true;
   }
 };
\ No newline at end of file
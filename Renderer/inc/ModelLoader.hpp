@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "LoadStatistics.hpp"
+#include "Mailbox.hpp"
+#include "Model.hpp"
+#include "ModelFactory.hpp"
+
+// Loads models on a background thread, so that the render loop keeps
+// drawing while a large model is parsed. Each loaded model is handed over
+// whole through a mailbox; the loader never touches it again. It is not
+// immutable: the render thread owns it from then on, and places it with
+// translate and scale as it would any model
+class ModelLoader {
+ public:
+  struct LoadedModel {
+    Model model;
+    std::string filePath;
+
+    // Milliseconds
+    double loadTime;
+
+    // The factory's, then the whole load
+    LoadStatistics loadStatistics;
+  };
+
+  ModelLoader() : loading_(false) {
+  }
+
+  ModelLoader(const ModelLoader&) = delete;
+  ModelLoader& operator=(const ModelLoader&) = delete;
+
+  ~ModelLoader() {
+    wait();
+  }
+
+  bool isLoading() const {
+    return loading_;
+  }
+
+  // Returns false, without starting anything, if the previous load is still
+  // running. Takes the same options as ModelFactory
+  bool load(const std::string& filePath,
+            ModelFactory::MODEL_LOAD_MODE modelLoadMode =
+                ModelFactory::MODEL_LOAD_MODE::STREAM,
+            bool useModelCache = false, bool optimizeVertexCache = false,
+            bool generateLevelsOfDetail = false,
+            bool generateNormals = false) {
+    if (loading_) {
+      return false;
+    }
+
+    wait();
+
+    loading_ = true;
+    loadThread_ = std::thread([this, filePath, modelLoadMode, useModelCache,
+                               optimizeVertexCache, generateLevelsOfDetail,
+                               generateNormals] {
+      try {
+        std::chrono::steady_clock::time_point loadStart =
+            std::chrono::steady_clock::now();
+        ModelFactory modelFactory(filePath, modelLoadMode, useModelCache,
+                                  optimizeVertexCache,
+                                  generateLevelsOfDetail, generateNormals);
+
+        std::unique_ptr<LoadedModel> loadedModel(new LoadedModel);
+        LoadStatistics& loadStatistics = loadedModel->loadStatistics;
+        loadStatistics = modelFactory.getLoadStatistics();
+        loadedModel->model = modelFactory.takeModel();
+        loadedModel->filePath = filePath;
+        loadedModel->loadTime =
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - loadStart)
+                .count();
+        loadStatistics.addTime("load total", loadedModel->loadTime);
+        mailbox_.post(std::move(loadedModel));
+      } catch (const std::exception& exception) {
+        std::cerr << "Failed to load model: " << exception.what()
+                  << std::endl;
+      }
+
+      // Only once the model is in the mailbox, so that a reader who sees
+      // the load finished will find it there
+      loading_ = false;
+    });
+
+    return true;
+  }
+
+  // The most recently loaded model, once; null if none has arrived since the
+  // last call
+  std::unique_ptr<LoadedModel> takeLoadedModel() {
+    return mailbox_.take();
+  }
+
+  bool hasLoadedModel() const {
+    return !mailbox_.isEmpty();
+  }
+
+  // Blocks until the current load, if any, has finished
+  void wait() {
+    if (loadThread_.joinable()) {
+      loadThread_.join();
+    }
+  }
+
+ private:
+  std::atomic<bool> loading_;
+  std::thread loadThread_;
+  Mailbox<LoadedModel> mailbox_;
+};
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "ThreadPool.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Smooth vertex normals: each vertex's is the sum of the normals of the
+// triangles around it, weighted by their areas (the cross product of two
+// edges, unnormalized, is twice the area), then normalized. Vertices that no
+// triangle uses, or whose triangles cancel out, get a zero normal.
+//
+// Nothing is scattered into shared sums, so the threads need no atomics:
+//   1. Each triangle's area-weighted normal is computed on its own.
+//   2. The vertex to triangle adjacency is built in compressed sparse row
+//      form, by sorting the triangle corners by vertex in two stable steps:
+//      chunks of corners scatter into buckets of vertices, each chunk into
+//      the ranges a prefix sum over every chunk's counts set aside for it,
+//      then each bucket is counting sorted on its own.
+//   3. Each vertex gathers its triangles' normals; with AVX2, 8 vertices at
+//      a time, masking off the lanes of vertices with fewer triangles.
+// Every sum is taken in triangle order whatever the thread count or
+// instruction set, so the normals always come out the same
+class NormalGenerator {
+ public:
+  NormalGenerator(const std::vector<float>& vertices,
+                  const std::vector<uint32_t>& indices,
+                  unsigned threadCount = std::thread::hardware_concurrency())
+      : threadPool_(threadCount) {
+    const size_t vertexCount = vertices.size() / 3;
+    const size_t triangleCount = indices.size() / 3;
+    if (indices.size() > UINT32_MAX) {
+      throw std::runtime_error("Too many triangles to generate normals for");
+    }
+
+    //// Area-weighted triangle normals, padded to 4 floats so that gathering
+    //// one only touches one cache line
+    std::vector<float> triangleNormals(4 * triangleCount);
+    forEachChunk(triangleCount, [&](size_t, size_t begin, size_t end) {
+      for (size_t triangle = begin; triangle < end; ++triangle) {
+        const float* corner = &vertices[3 * indices[3 * triangle]];
+        const float* second = &vertices[3 * indices[3 * triangle + 1]];
+        const float* third = &vertices[3 * indices[3 * triangle + 2]];
+
+        float edge1[3], edge2[3];
+        for (int i = 0; i < 3; ++i) {
+          edge1[i] = second[i] - corner[i];
+          edge2[i] = third[i] - corner[i];
+        }
+        for (int i = 0; i < 3; ++i) {
+          int j = (i + 1) % 3, k = (i + 2) % 3;
+          triangleNormals[4 * triangle + i] =
+              edge1[j] * edge2[k] - edge1[k] * edge2[j];
+        }
+        triangleNormals[4 * triangle + 3] = 0.0f;
+      }
+    });
+
+    buildAdjacency(indices, vertexCount);
+
+    //// Gather; whole blocks of 8 vertices with vector instructions where
+    //// the CPU has them (and the offsets fit their signed 32-bit lanes),
+    //// the rest of each chunk (or everything) in scalar
+    normals_.resize(vertices.size());
+    bool useAvx2 = false;
+#if defined(__x86_64__) || defined(__i386__)
+    useAvx2 = __builtin_cpu_supports("avx2") &&
+              triangleNormals.size() <= INT32_MAX;
+#endif
+    forEachChunk(vertexCount, [&](size_t, size_t begin, size_t end) {
+      size_t vertex = begin;
+#if defined(__x86_64__) || defined(__i386__)
+      if (useAvx2) {
+        vertex = gatherNormalsAvx2(begin, end, triangleNormals);
+      }
+#endif
+      for (; vertex < end; ++vertex) {
+        float sum[3] = {0.0f, 0.0f, 0.0f};
+        for (uint32_t i = adjacencyOffsets_[vertex];
+             i < adjacencyOffsets_[vertex + 1]; ++i) {
+          uint32_t triangle = adjacentTriangles_[i];
+          for (int k = 0; k < 3; ++k) {
+            sum[k] += triangleNormals[4 * triangle + k];
+          }
+        }
+
+        float length =
+            std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+        for (int k = 0; k < 3; ++k) {
+          normals_[3 * vertex + k] = length > 0.0f ? sum[k] / length : 0.0f;
+        }
+      }
+    });
+  }
+
+  // 3 floats per vertex
+  std::vector<float>& getNormals() {
+    return normals_;
+  }
+
+ private:
+  // Up to 256 buckets
+  static const unsigned BUCKET_BITS = 8;
+
+  // Keeps the scheduling overhead negligible
+  static const size_t MINIMUM_CHUNK_SIZE = 1 << 15;
+
+  ThreadPool threadPool_;
+  std::vector<float> normals_;
+
+  // The triangles around vertex v are adjacentTriangles_[adjacencyOffsets_[v]]
+  // up to adjacentTriangles_[adjacencyOffsets_[v + 1]]
+  std::vector<uint32_t> adjacencyOffsets_;
+  std::vector<uint32_t> adjacentTriangles_;
+
+  // Splits [0, count) into up to 4 chunks per thread and calls
+  // body(chunk, begin, end) on each; the same count always gives the same
+  // chunks
+  template <typename Body>
+  void forEachChunk(size_t count, const Body& body) {
+    const size_t chunkCount = getChunkCount(count);
+    threadPool_.parallelFor(chunkCount, [&](size_t chunk) {
+      body(chunk, count * chunk / chunkCount, count * (chunk + 1) / chunkCount);
+    });
+  }
+
+  size_t getChunkCount(size_t count) const {
+    return std::max<size_t>(
+        std::min<size_t>(threadPool_.getThreadCount() * 4,
+                         count / MINIMUM_CHUNK_SIZE),
+        1);
+  }
+
+  void buildAdjacency(const std::vector<uint32_t>& indices,
+                      size_t vertexCount) {
+    const size_t cornerCount = indices.size();
+    const size_t chunkCount = getChunkCount(cornerCount);
+    adjacencyOffsets_.assign(vertexCount + 1, 0);
+    adjacentTriangles_.resize(cornerCount);
+    if (vertexCount == 0) {
+      return;
+    }
+
+    //// Bucket the corners by the top BUCKET_BITS of their vertex index
+    unsigned vertexBits = 0;
+    while (vertexBits < 32 && (uint64_t(1) << vertexBits) < vertexCount) {
+      ++vertexBits;
+    }
+    const unsigned bucketShift =
+        vertexBits > BUCKET_BITS ? vertexBits - BUCKET_BITS : 0;
+    const size_t bucketCount = ((vertexCount - 1) >> bucketShift) + 1;
+
+    // Each chunk's count of every bucket, then where its corners in that
+    // bucket go: after the same bucket's in earlier chunks, and after every
+    // earlier bucket's
+    std::vector<uint32_t> bucketOffsets(chunkCount * bucketCount, 0);
+    forEachChunk(cornerCount, [&](size_t chunk, size_t begin, size_t end) {
+      uint32_t* chunkCounts = &bucketOffsets[chunk * bucketCount];
+      for (size_t corner = begin; corner < end; ++corner) {
+        ++chunkCounts[indices[corner] >> bucketShift];
+      }
+    });
+
+    std::vector<uint32_t> bucketStarts(bucketCount + 1);
+    uint32_t offset = 0;
+    for (size_t bucket = 0; bucket < bucketCount; ++bucket) {
+      bucketStarts[bucket] = offset;
+      for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+        uint32_t count = bucketOffsets[chunk * bucketCount + bucket];
+        bucketOffsets[chunk * bucketCount + bucket] = offset;
+        offset += count;
+      }
+    }
+    bucketStarts[bucketCount] = offset;
+
+    std::vector<uint32_t> bucketedCorners(cornerCount);
+    forEachChunk(cornerCount, [&](size_t chunk, size_t begin, size_t end) {
+      uint32_t* chunkOffsets = &bucketOffsets[chunk * bucketCount];
+      for (size_t corner = begin; corner < end; ++corner) {
+        bucketedCorners[chunkOffsets[indices[corner] >> bucketShift]++] =
+            corner;
+      }
+    });
+
+    //// Counting sort each bucket's corners by vertex. A bucket only
+    //// touches its own vertices' offsets, few enough to stay in cache, and
+    //// its corners are in order, so reading their vertices streams too
+    threadPool_.parallelFor(bucketCount, [&](size_t bucket) {
+      const size_t firstVertex = bucket << bucketShift;
+      const size_t endVertex =
+          std::min<size_t>((bucket + 1) << bucketShift, vertexCount);
+      const uint32_t begin = bucketStarts[bucket];
+      const uint32_t end = bucketStarts[bucket + 1];
+
+      for (uint32_t i = begin; i < end; ++i) {
+        ++adjacencyOffsets_[indices[bucketedCorners[i]]];
+      }
+
+      uint32_t vertexOffset = begin;
+      for (size_t vertex = firstVertex; vertex < endVertex; ++vertex) {
+        uint32_t count = adjacencyOffsets_[vertex];
+        adjacencyOffsets_[vertex] = vertexOffset;
+        vertexOffset += count;
+      }
+
+      // Filling each vertex's triangles moves its offset on to the next
+      // vertex's, so they are moved back afterwards
+      for (uint32_t i = begin; i < end; ++i) {
+        uint32_t corner = bucketedCorners[i];
+        adjacentTriangles_[adjacencyOffsets_[indices[corner]]++] = corner / 3;
+      }
+      for (size_t vertex = endVertex - 1; vertex > firstVertex; --vertex) {
+        adjacencyOffsets_[vertex] = adjacencyOffsets_[vertex - 1];
+      }
+      adjacencyOffsets_[firstVertex] = begin;
+    });
+    adjacencyOffsets_[vertexCount] = cornerCount;
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  // Sums 8 vertices' triangle normals at once, a triangle per lane per
+  // iteration, for as many iterations as the vertex with the most triangles
+  // needs. Returns the first vertex not done
+  __attribute__((target("avx2"))) size_t gatherNormalsAvx2(
+      size_t begin, size_t end, const std::vector<float>& triangleNormals) {
+    const int* adjacentTriangles =
+        reinterpret_cast<const int*>(adjacentTriangles_.data());
+    const __m256 zero = _mm256_setzero_ps();
+
+    size_t vertex = begin;
+    for (; vertex + 8 <= end; vertex += 8) {
+      __m256i first = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(&adjacencyOffsets_[vertex]));
+      __m256i last = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(&adjacencyOffsets_[vertex + 1]));
+      __m256i counts = _mm256_sub_epi32(last, first);
+
+      alignas(32) uint32_t laneCounts[8];
+      _mm256_store_si256(reinterpret_cast<__m256i*>(laneCounts), counts);
+      const uint32_t maximumCount =
+          *std::max_element(laneCounts, laneCounts + 8);
+
+      __m256 sums[3] = {zero, zero, zero};
+      for (uint32_t i = 0; i < maximumCount; ++i) {
+        __m256i step = _mm256_set1_epi32(i);
+        __m256i mask = _mm256_cmpgt_epi32(counts, step);
+        __m256i triangles = _mm256_mask_i32gather_epi32(
+            _mm256_setzero_si256(), adjacentTriangles,
+            _mm256_add_epi32(first, step), mask, 4);
+        __m256i normalOffsets = _mm256_slli_epi32(triangles, 2);
+        for (int k = 0; k < 3; ++k) {
+          sums[k] = _mm256_add_ps(
+              sums[k],
+              _mm256_mask_i32gather_ps(zero, triangleNormals.data() + k,
+                                       normalOffsets,
+                                       _mm256_castsi256_ps(mask), 4));
+        }
+      }
+
+      // Dividing by a zero length is masked off to a zero normal
+      __m256 length = _mm256_sqrt_ps(_mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(sums[0], sums[0]),
+                        _mm256_mul_ps(sums[1], sums[1])),
+          _mm256_mul_ps(sums[2], sums[2])));
+      __m256 nonZero = _mm256_cmp_ps(length, zero, _CMP_GT_OQ);
+
+      alignas(32) float components[3][8];
+      for (int k = 0; k < 3; ++k) {
+        _mm256_store_ps(components[k],
+                        _mm256_and_ps(_mm256_div_ps(sums[k], length), nonZero));
+      }
+      for (int lane = 0; lane < 8; ++lane) {
+        for (int k = 0; k < 3; ++k) {
+          normals_[3 * (vertex + lane) + k] = components[k][lane];
+        }
+      }
+    }
+
+    return vertex;
+  }
+#endif
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Formats OBJ records with std::to_chars into a large buffer, which is handed
+// to the kernel with a handful of write calls instead of one per number
+class ObjWriter {
+ public:
+  // Zero significant digits writes the shortest representation that reads
+  // back as the same float
+  ObjWriter(const std::string& filePath, int significantDigits = 0)
+      : significantDigits_(significantDigits), buffer_(BUFFER_SIZE) {
+    if (significantDigits < 0 || significantDigits > 32) {
+      throw std::runtime_error(
+          "The number of significant digits must be between 0 and 32");
+    }
+
+    fileDescriptor_ =
+        open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fileDescriptor_ < 0) {
+      throw std::runtime_error("Failed to open model output file");
+    }
+  }
+
+  ObjWriter(const ObjWriter&) = delete;
+  ObjWriter& operator=(const ObjWriter&) = delete;
+
+  ~ObjWriter() {
+    if (fileDescriptor_ >= 0) {
+      ::close(fileDescriptor_);
+    }
+  }
+
+  void writeText(const std::string& text) {
+    reserve(text.size());
+    memcpy(&buffer_[used_], text.data(), text.size());
+    used_ += text.size();
+  }
+
+  void writeChar(char c) {
+    reserve(1);
+    buffer_[used_++] = c;
+  }
+
+  void writeFloat(float value) {
+    reserve(MAX_NUMBER_LENGTH);
+    char* first = &buffer_[used_];
+    char* last = first + MAX_NUMBER_LENGTH;
+
+    std::to_chars_result result =
+        significantDigits_ > 0
+            ? std::to_chars(first, last, value, std::chars_format::general,
+                            significantDigits_)
+            : std::to_chars(first, last, value);
+    used_ = result.ptr - &buffer_[0];
+  }
+
+  void writeUnsigned(unsigned long value) {
+    reserve(MAX_NUMBER_LENGTH);
+    char* first = &buffer_[used_];
+    std::to_chars_result result =
+        std::to_chars(first, first + MAX_NUMBER_LENGTH, value);
+    used_ = result.ptr - &buffer_[0];
+  }
+
+  void close() {
+    flush();
+    if (::close(fileDescriptor_) != 0) {
+      fileDescriptor_ = -1;
+      throw std::runtime_error("Failed to close model output file");
+    }
+
+    fileDescriptor_ = -1;
+  }
+
+ private:
+  static const size_t BUFFER_SIZE = 4 << 20;
+
+  // Enough for any float at the precisions to_chars supports here
+  static const size_t MAX_NUMBER_LENGTH = 64;
+
+  int fileDescriptor_;
+  int significantDigits_;
+  std::vector<char> buffer_;
+  size_t used_ = 0;
+
+  void reserve(size_t length) {
+    if (used_ + length > buffer_.size()) {
+      flush();
+      if (length > buffer_.size()) {
+        buffer_.resize(length);
+      }
+    }
+  }
+
+  void flush() {
+    size_t written = 0;
+    while (written < used_) {
+      ssize_t result =
+          ::write(fileDescriptor_, &buffer_[written], used_ - written);
+      if (result < 0 && errno == EINTR) {
+        continue;
+      }
+
+      if (result <= 0) {
+        throw std::runtime_error("Failed to write model output file");
+      }
+
+      written += result;
+    }
+
+    used_ = 0;
+  }
+};
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <Eigen/Geometry>
+
+#include "Model.hpp"
+#include "ModelFactory.hpp"
+
+// Instances of models, each placed by its own transformation. A model listed
+// more than once is loaded once and shared by all of its instances, so that
+// it can be uploaded once and drawn with a single instanced call.
+//
+// Scene files list one instance per line; blank lines and lines starting with
+// '#' are skipped. Model paths are relative to the scene file:
+//   <model path> <x> <y> <z> [<scale> [<degrees> <axis x> <axis y> <axis z>]]
+class Scene {
+ public:
+  // One model and where its instances go
+  struct SceneMesh {
+    Model model;
+
+    // Model to scene space, column major as GL takes them
+    std::vector<Eigen::Matrix4f> instanceTransforms;
+  };
+
+  Scene() {
+    displacement_ = std::vector<float>{0.0, 0.0, 0.0};
+    scale_ = std::vector<float>{1.0, 1.0, 1.0};
+    orientation_ = Eigen::Quaternion<float>::Identity();
+  }
+
+  Scene(const std::string& sceneFilePath,
+        ModelFactory::MODEL_LOAD_MODE modelLoadMode =
+            ModelFactory::MODEL_LOAD_MODE::STREAM,
+        bool useModelCache = false, bool optimizeVertexCache = false)
+      : Scene() {
+    std::ifstream sceneFileStream(sceneFilePath);
+    if (!sceneFileStream.is_open()) {
+      throw std::runtime_error("Failed to open scene file: " + sceneFilePath);
+    }
+
+    const size_t directoryEnd = sceneFilePath.find_last_of('/');
+    const std::string directory =
+        directoryEnd == std::string::npos
+            ? ""
+            : sceneFilePath.substr(0, directoryEnd + 1);
+
+    std::map<std::string, size_t> meshIndices;
+    std::string line;
+    while (std::getline(sceneFileStream, line)) {
+      std::istringstream lineStream(line);
+      std::string modelFilePath;
+      if (!(lineStream >> modelFilePath) || modelFilePath[0] == '#') {
+        continue;
+      }
+
+      Eigen::Affine3f instanceTransform = parseInstanceTransform(lineStream);
+
+      if (modelFilePath[0] != '/') {
+        modelFilePath = directory + modelFilePath;
+      }
+
+      auto meshIndex = meshIndices.find(modelFilePath);
+      if (meshIndex == meshIndices.end()) {
+        ModelFactory modelFactory(modelFilePath, modelLoadMode, useModelCache,
+                                  optimizeVertexCache);
+        meshes_.push_back(SceneMesh{modelFactory.takeModel(), {}});
+        meshIndex =
+            meshIndices.emplace(modelFilePath, meshes_.size() - 1).first;
+      }
+
+      meshes_[meshIndex->second].instanceTransforms.push_back(
+          instanceTransform.matrix());
+    }
+
+    if (meshes_.empty()) {
+      throw std::runtime_error("The scene does not contain any instances");
+    }
+
+    updateBounds();
+  }
+
+  std::vector<SceneMesh>& getMeshes() {
+    return meshes_;
+  }
+
+  size_t getInstanceCount() const {
+    size_t instanceCount = 0;
+    for (const SceneMesh& mesh : meshes_) {
+      instanceCount += mesh.instanceTransforms.size();
+    }
+
+    return instanceCount;
+  }
+
+  //// Bounds of every instance, in scene space
+  std::vector<float> getCenter() const {
+    return std::vector<float>{(minimumBounds_[0] + maximumBounds_[0]) / 2,
+                              (minimumBounds_[1] + maximumBounds_[1]) / 2,
+                              (minimumBounds_[2] + maximumBounds_[2]) / 2};
+  }
+
+  std::vector<float> getDimensions() const {
+    return std::vector<float>{maximumBounds_[0] - minimumBounds_[0],
+                              maximumBounds_[1] - minimumBounds_[1],
+                              maximumBounds_[2] - minimumBounds_[2]};
+  }
+
+  //// Placement of the whole scene, as for a single model
+  std::vector<float> getScale() const {
+    return scale_;
+  }
+
+  void scale(const std::vector<float>& proportions) {
+    scale_[0] *= proportions[0];
+    scale_[1] *= proportions[1];
+    scale_[2] *= proportions[2];
+  }
+
+  std::vector<float> getDisplacement() const {
+    return displacement_;
+  }
+
+  void translate(const std::vector<float>& delta) {
+    if (delta.size() != 3)
+      throw std::runtime_error(
+          "Failed to translate scene: the given delta must contain 3 "
+          "dimensions");
+
+    Eigen::Matrix<float, 3, 1> relativeDelta;
+    relativeDelta << delta[0], delta[1], delta[2];
+    relativeDelta = orientation_.toRotationMatrix() * relativeDelta;
+
+    displacement_[0] += relativeDelta[0];
+    displacement_[1] += relativeDelta[1];
+    displacement_[2] += relativeDelta[2];
+  }
+
+  Eigen::Quaternion<float> getOrientation() const {
+    return orientation_;
+  }
+
+  void rotate(const Eigen::Quaternion<float>& delta) {
+    orientation_ = delta * orientation_;
+    orientation_.normalize();
+  }
+
+ private:
+  std::vector<SceneMesh> meshes_;
+
+  float minimumBounds_[3];
+  float maximumBounds_[3];
+
+  std::vector<float> displacement_;
+  std::vector<float> scale_;
+  Eigen::Quaternion<float> orientation_;
+
+  static Eigen::Affine3f parseInstanceTransform(
+      std::istringstream& lineStream) {
+    float x, y, z;
+    if (!(lineStream >> x >> y >> z)) {
+      throw std::runtime_error("Invalid scene instance position specified");
+    }
+
+    Eigen::Affine3f instanceTransform(Eigen::Translation3f(x, y, z));
+
+    float scale;
+    if (!(lineStream >> scale)) {
+      return instanceTransform;
+    }
+
+    float degrees, axisX, axisY, axisZ;
+    if (lineStream >> degrees) {
+      if (!(lineStream >> axisX >> axisY >> axisZ)) {
+        throw std::runtime_error("Invalid scene instance rotation specified");
+      }
+
+      Eigen::Vector3f axis(axisX, axisY, axisZ);
+      if (axis.norm() == 0.0f) {
+        throw std::runtime_error("Invalid scene instance rotation specified");
+      }
+
+      instanceTransform.rotate(
+          Eigen::AngleAxisf(degrees * 3.14159265f / 180, axis.normalized()));
+    }
+
+    instanceTransform.scale(scale);
+    return instanceTransform;
+  }
+
+  // Transforms each model's box by each of its instances' transformations
+  void updateBounds() {
+    std::fill(minimumBounds_, minimumBounds_ + 3, FLT_MAX);
+    std::fill(maximumBounds_, maximumBounds_ + 3, -FLT_MAX);
+
+    for (SceneMesh& mesh : meshes_) {
+      if (mesh.model.getVertices().empty()) {
+        continue;
+      }
+
+      std::vector<float> minimum = mesh.model.getMinimumBounds();
+      std::vector<float> maximum = mesh.model.getMaximumBounds();
+      for (const Eigen::Matrix4f& instanceTransform :
+           mesh.instanceTransforms) {
+        for (int corner = 0; corner < 8; ++corner) {
+          Eigen::Vector4f point(corner & 1 ? maximum[0] : minimum[0],
+                                corner & 2 ? maximum[1] : minimum[1],
+                                corner & 4 ? maximum[2] : minimum[2], 1.0f);
+          point = instanceTransform * point;
+          for (int axis = 0; axis < 3; ++axis) {
+            minimumBounds_[axis] = std::min(minimumBounds_[axis], point[axis]);
+            maximumBounds_[axis] = std::max(maximumBounds_[axis], point[axis]);
+          }
+        }
+      }
+    }
+
+    // Scenes of empty models have no extent
+    if (minimumBounds_[0] > maximumBounds_[0]) {
+      std::fill(minimumBounds_, minimumBounds_ + 3, 0.0f);
+      std::fill(maximumBounds_, maximumBounds_ + 3, 0.0f);
+    }
+  }
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A linked GLSL program. Attribute locations are bound before linking, so
+// that vertex array setup does not have to look them up
+class ShaderProgram {
+ public:
+  ShaderProgram(const std::string& vertexShaderSource,
+                const std::string& fragmentShaderSource,
+                const std::vector<std::pair<GLuint, std::string>>&
+                    attributeLocations = {}) {
+    GLuint vertexShader =
+        compileShader(GL_VERTEX_SHADER, vertexShaderSource, "vertex");
+    GLuint fragmentShader;
+    try {
+      fragmentShader =
+          compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource, "fragment");
+    } catch (...) {
+      glDeleteShader(vertexShader);
+      throw;
+    }
+
+    program_ = glCreateProgram();
+    glAttachShader(program_, vertexShader);
+    glAttachShader(program_, fragmentShader);
+    for (const std::pair<GLuint, std::string>& attributeLocation :
+         attributeLocations) {
+      glBindAttribLocation(program_, attributeLocation.first,
+                           attributeLocation.second.c_str());
+    }
+    glLinkProgram(program_);
+
+    // The program keeps what it needs once linked
+    glDetachShader(program_, vertexShader);
+    glDetachShader(program_, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint linked;
+    glGetProgramiv(program_, GL_LINK_STATUS, &linked);
+    if (!linked) {
+      std::string infoLog = getProgramInfoLog(program_);
+      glDeleteProgram(program_);
+      throw std::runtime_error("Failed to link shader program: " + infoLog);
+    }
+  }
+
+  ShaderProgram(const ShaderProgram&) = delete;
+  ShaderProgram& operator=(const ShaderProgram&) = delete;
+
+  ~ShaderProgram() {
+    glDeleteProgram(program_);
+  }
+
+  GLuint getProgram() const {
+    return program_;
+  }
+
+  void use() const {
+    glUseProgram(program_);
+  }
+
+  GLint getUniformLocation(const std::string& name) const {
+    return glGetUniformLocation(program_, name.c_str());
+  }
+
+  // Has the named uniform block read from the buffer bound to the given
+  // uniform buffer binding point
+  void bindUniformBlock(const std::string& name, GLuint binding) const {
+    GLuint blockIndex = glGetUniformBlockIndex(program_, name.c_str());
+    if (blockIndex == GL_INVALID_INDEX) {
+      throw std::runtime_error("The shader program has no uniform block " +
+                               name);
+    }
+
+    glUniformBlockBinding(program_, blockIndex, binding);
+  }
+
+ private:
+  GLuint program_;
+
+  static GLuint compileShader(GLenum type, const std::string& source,
+                              const std::string& description) {
+    GLuint shader = glCreateShader(type);
+    const char* sourceText = source.c_str();
+    glShaderSource(shader, 1, &sourceText, NULL);
+    glCompileShader(shader);
+
+    GLint compiled;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+      GLint logLength = 0;
+      glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
+      std::string infoLog(std::max(logLength, 1), '\0');
+      glGetShaderInfoLog(shader, infoLog.size(), NULL, &infoLog[0]);
+      glDeleteShader(shader);
+      throw std::runtime_error("Failed to compile " + description +
+                               " shader: " + infoLog.c_str());
+    }
+
+    return shader;
+  }
+
+  static std::string getProgramInfoLog(GLuint program) {
+    GLint logLength = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+    std::string infoLog(std::max(logLength, 1), '\0');
+    glGetProgramInfoLog(program, infoLog.size(), NULL, &infoLog[0]);
+    return infoLog.c_str();
+  }
+};
@@ -0,0 +1,577 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <Eigen/Geometry>
+
+#include "Model.hpp"
+#include "ThreadPool.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Draws models on the CPU, for machines without a GPU, the way the VBO viewer
+// draws them: through the same matrices, with the same fog, either in
+// wireframe or with flat shaded faces. A frame goes through three passes, each
+// spread over the thread pool:
+//   1. the vertices are transformed, in chunks
+//   2. the triangles are clipped to the near plane, set up, and binned into
+//      the screen tiles they overlap, each chunk into bins of its own
+//   3. each tile is rasterized by one task, which walks the bins in triangle
+//      order, so that frames do not depend on the number of threads
+// Tiles share no pixels, so no pixel is ever written by two threads
+class SoftwareRasterizer {
+ public:
+  enum RENDER_MODE { WIREFRAME, FLAT };
+
+  static const int TILE_SIZE = 64;
+
+  SoftwareRasterizer(int width, int height, ThreadPool& threadPool)
+      : width_(width), height_(height), threadPool_(threadPool) {
+    if (width <= 0 || height <= 0) {
+      throw std::runtime_error("The image to rasterize must not be empty");
+    }
+
+    tileColumnCount_ = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tileRowCount_ = (height + TILE_SIZE - 1) / TILE_SIZE;
+    colorBuffer_.resize(size_t(width) * height);
+    depthBuffer_.resize(size_t(width) * height);
+
+    chunkCount_ = threadPool.getThreadCount() * TRIANGLE_CHUNKS_PER_THREAD;
+    setupTriangles_.resize(chunkCount_);
+    bins_.assign(chunkCount_, std::vector<std::vector<uint32_t>>(
+                                  tileColumnCount_ * tileRowCount_));
+
+#if defined(__x86_64__) || defined(__i386__)
+    useAvx_ = __builtin_cpu_supports("avx");
+#endif
+  }
+
+  SoftwareRasterizer(const SoftwareRasterizer&) = delete;
+  SoftwareRasterizer& operator=(const SoftwareRasterizer&) = delete;
+
+  int getWidth() const {
+    return width_;
+  }
+
+  int getHeight() const {
+    return height_;
+  }
+
+  // To black, and to the far plane
+  void clear() {
+    std::fill(colorBuffer_.begin(), colorBuffer_.end(), 0);
+    std::fill(depthBuffer_.begin(), depthBuffer_.end(), 1.0f);
+  }
+
+  void draw(Model& model, const Eigen::Matrix4f& modelMatrix,
+            const Eigen::Matrix4f& viewMatrix,
+            const Eigen::Matrix4f& projectionMatrix, RENDER_MODE renderMode) {
+    renderMode_ = renderMode;
+
+    transformVertices(model, modelMatrix, viewMatrix, projectionMatrix);
+
+    const std::vector<uint32_t>& indices = model.getIndices();
+    const size_t triangleCount = indices.size() / 3;
+    const size_t chunkSize = (triangleCount + chunkCount_ - 1) / chunkCount_;
+    threadPool_.parallelFor(chunkCount_, [&](size_t chunk) {
+      size_t firstTriangle = std::min(chunk * chunkSize, triangleCount);
+      size_t endTriangle = std::min(firstTriangle + chunkSize, triangleCount);
+      setupChunk(chunk, indices.data() + 3 * firstTriangle,
+                 endTriangle - firstTriangle);
+    });
+
+    threadPool_.parallelFor(tileColumnCount_ * tileRowCount_,
+                            [this](size_t tile) { rasterizeTile(tile); });
+  }
+
+  // Pixels as 0x00BBGGRR, from the top row down
+  const std::vector<uint32_t>& getPixels() const {
+    return colorBuffer_;
+  }
+
+  // As a binary PPM
+  void writePpm(const std::string& filePath) const {
+    std::ofstream outputStream(filePath, std::ios::binary);
+    if (!outputStream) {
+      throw std::runtime_error("Failed to open " + filePath);
+    }
+
+    outputStream << "P6\n" << width_ << " " << height_ << "\n255\n";
+    std::vector<char> row(3 * size_t(width_));
+    for (int y = 0; y < height_; ++y) {
+      const uint32_t* pixels = &colorBuffer_[size_t(y) * width_];
+      for (int x = 0; x < width_; ++x) {
+        row[3 * x] = char(pixels[x] & 0xff);
+        row[3 * x + 1] = char((pixels[x] >> 8) & 0xff);
+        row[3 * x + 2] = char((pixels[x] >> 16) & 0xff);
+      }
+      outputStream.write(row.data(), row.size());
+    }
+
+    if (!outputStream) {
+      throw std::runtime_error("Failed to write " + filePath);
+    }
+  }
+
+ private:
+  // The VBO viewer's fog, over the depth the model matrix alone gives
+  static constexpr float FOG_START = 10.0f;
+  static constexpr float FOG_END = 11.0f;
+
+  // Flat shaded faces keep this much of their color however they face the
+  // eye
+  static constexpr float AMBIENT = 0.2f;
+
+  // Wireframe edges are drawn over the pixels whose centers are within this
+  // distance of them, so that they come out a pixel wide, as GL draws lines
+  static constexpr float WIRE_HALF_WIDTH = 0.5f;
+
+  static const unsigned NEAR_OUTCODE = 1 << 4;
+
+  static const size_t VERTEX_CHUNK_SIZE = 1 << 14;
+  static const unsigned TRIANGLE_CHUNKS_PER_THREAD = 4;
+
+  struct TransformedVertex {
+    float clipPosition[4];
+    float eyePosition[3];
+
+    // In pixels, with y down the screen; only for vertices in front of the
+    // near plane
+    float screenPosition[3];
+
+    // Already fogged
+    float color[3];
+  };
+
+  // A triangle ready to rasterize. Its edge functions are positive inside,
+  // and in wireframe are scaled to give the distance in pixels from each
+  // edge. Its depth is a plane over the screen
+  struct SetupTriangle {
+    float edgeA[3];
+    float edgeB[3];
+    float edgeC[3];
+    float depthA;
+    float depthB;
+    float depthC;
+    uint32_t color;
+
+    // Pixels whose centers may be covered; the maxima are exclusive
+    int minimumX;
+    int minimumY;
+    int maximumX;
+    int maximumY;
+
+    // Which edges the pixel centers exactly on them belong to, so that
+    // triangles sharing an edge do not both cover those pixels
+    bool ownsEdge[3];
+  };
+
+  int width_;
+  int height_;
+  int tileColumnCount_;
+  int tileRowCount_;
+  ThreadPool& threadPool_;
+  bool useAvx_ = false;
+  RENDER_MODE renderMode_ = WIREFRAME;
+
+  std::vector<uint32_t> colorBuffer_;
+  std::vector<float> depthBuffer_;
+
+  // Kept from frame to frame, so that their storage is only allocated once
+  std::vector<TransformedVertex> transformedVertices_;
+  size_t chunkCount_;
+  std::vector<std::vector<SetupTriangle>> setupTriangles_;
+
+  // For each chunk of triangles and each tile, the chunk's set up triangles
+  // that overlap the tile
+  std::vector<std::vector<std::vector<uint32_t>>> bins_;
+
+  void transformVertices(Model& model, const Eigen::Matrix4f& modelMatrix,
+                         const Eigen::Matrix4f& viewMatrix,
+                         const Eigen::Matrix4f& projectionMatrix) {
+    const std::vector<float>& vertices = model.getVertices();
+    const std::vector<float>& colors = model.getColors();
+    const std::vector<float> uniformColor = model.getUniformColor();
+    const size_t vertexCount = vertices.size() / 3;
+    transformedVertices_.resize(vertexCount);
+
+    const Eigen::Matrix4f modelView = viewMatrix * modelMatrix;
+    const Eigen::Matrix4f modelViewProjection = projectionMatrix * modelView;
+
+    const size_t chunkCount =
+        (vertexCount + VERTEX_CHUNK_SIZE - 1) / VERTEX_CHUNK_SIZE;
+    threadPool_.parallelFor(chunkCount, [&](size_t chunk) {
+      size_t endVertex =
+          std::min((chunk + 1) * VERTEX_CHUNK_SIZE, vertexCount);
+      for (size_t i = chunk * VERTEX_CHUNK_SIZE; i < endVertex; ++i) {
+        Eigen::Vector4f position(vertices[3 * i], vertices[3 * i + 1],
+                                 vertices[3 * i + 2], 1.0f);
+        Eigen::Vector4f clipPosition = modelViewProjection * position;
+        Eigen::Vector4f eyePosition = modelView * position;
+        float fogDepth = -modelMatrix.row(2).dot(position);
+        float fog = std::min(
+            std::max((FOG_END - fogDepth) / (FOG_END - FOG_START), 0.0f),
+            1.0f);
+
+        TransformedVertex& vertex = transformedVertices_[i];
+        const float* color =
+            colors.empty() ? uniformColor.data() : &colors[3 * i];
+        for (int k = 0; k < 3; ++k) {
+          vertex.clipPosition[k] = clipPosition[k];
+          vertex.eyePosition[k] = eyePosition[k];
+          vertex.color[k] = color[k] * fog;
+        }
+        vertex.clipPosition[3] = clipPosition[3];
+        if (clipPosition[3] > 0.0f) {
+          toScreen(vertex.clipPosition, vertex.screenPosition);
+        }
+      }
+    });
+  }
+
+  void toScreen(const float* clipPosition, float* screenPosition) const {
+    screenPosition[0] =
+        (clipPosition[0] / clipPosition[3] + 1.0f) * 0.5f * width_;
+    screenPosition[1] =
+        (1.0f - clipPosition[1] / clipPosition[3]) * 0.5f * height_;
+    screenPosition[2] = clipPosition[2] / clipPosition[3];
+  }
+
+  // Which planes of the view volume a clip space position is beyond, one bit
+  // each; the near plane is NEAR_OUTCODE
+  static unsigned getOutcode(const float* clipPosition) {
+    const float w = clipPosition[3];
+    return (clipPosition[0] < -w) | (clipPosition[0] > w) << 1 |
+           (clipPosition[1] < -w) << 2 | (clipPosition[1] > w) << 3 |
+           (clipPosition[2] < -w) << 4 | (clipPosition[2] > w) << 5;
+  }
+
+  // Triangles take the color of their last vertex, as with
+  // glShadeModel(GL_FLAT); flat shaded faces are also lit from the eye
+  uint32_t getTriangleColor(const TransformedVertex* corners[3]) const {
+    float shade = 1.0f;
+    if (renderMode_ == FLAT) {
+      Eigen::Map<const Eigen::Vector3f> p0(corners[0]->eyePosition);
+      Eigen::Map<const Eigen::Vector3f> p1(corners[1]->eyePosition);
+      Eigen::Map<const Eigen::Vector3f> p2(corners[2]->eyePosition);
+      Eigen::Vector3f normal = (p1 - p0).cross(p2 - p0);
+      float length = normal.norm();
+      float facing = length > 0.0f ? std::fabs(normal[2]) / length : 1.0f;
+      shade = AMBIENT + (1.0f - AMBIENT) * facing;
+    }
+
+    uint32_t color = 0;
+    for (int k = 0; k < 3; ++k) {
+      float channel = std::min(std::max(corners[2]->color[k] * shade, 0.0f),
+                               1.0f);
+      color |= uint32_t(channel * 255.0f + 0.5f) << (8 * k);
+    }
+
+    return color;
+  }
+
+  void setupChunk(size_t chunk, const uint32_t* indices,
+                  size_t triangleCount) {
+    std::vector<SetupTriangle>& triangles = setupTriangles_[chunk];
+    triangles.clear();
+    for (std::vector<uint32_t>& bin : bins_[chunk]) {
+      bin.clear();
+    }
+
+    for (size_t triangle = 0; triangle < triangleCount; ++triangle) {
+      const TransformedVertex* corners[3];
+      unsigned outcodes[3];
+      for (int k = 0; k < 3; ++k) {
+        corners[k] = &transformedVertices_[indices[3 * triangle + k]];
+        outcodes[k] = getOutcode(corners[k]->clipPosition);
+      }
+
+      // Wholly beyond one of the planes
+      if (outcodes[0] & outcodes[1] & outcodes[2]) {
+        continue;
+      }
+
+      //// Only the near plane is clipped against; the others are left to
+      //// the tiles' bounds, and the far plane to the depth test
+      if (!((outcodes[0] | outcodes[1] | outcodes[2]) & NEAR_OUTCODE)) {
+        setupTriangle(chunk, corners[0]->screenPosition,
+                      corners[1]->screenPosition, corners[2]->screenPosition,
+                      corners);
+        continue;
+      }
+
+      float polygon[4][3];
+      int polygonSize = 0;
+      for (int k = 0; k < 3; ++k) {
+        const float* from = corners[k]->clipPosition;
+        const float* to = corners[(k + 1) % 3]->clipPosition;
+        float fromDistance = from[2] + from[3];
+        float toDistance = to[2] + to[3];
+        if (fromDistance >= 0.0f) {
+          toScreen(from, polygon[polygonSize++]);
+        }
+        if ((fromDistance >= 0.0f) != (toDistance >= 0.0f)) {
+          float t = fromDistance / (fromDistance - toDistance);
+          float clipPosition[4];
+          for (int axis = 0; axis < 4; ++axis) {
+            clipPosition[axis] = from[axis] + t * (to[axis] - from[axis]);
+          }
+          toScreen(clipPosition, polygon[polygonSize++]);
+        }
+      }
+
+      for (int k = 1; k + 1 < polygonSize; ++k) {
+        setupTriangle(chunk, polygon[0], polygon[k], polygon[k + 1], corners);
+      }
+    }
+  }
+
+  // Sets up and bins the triangle between three screen positions, which is
+  // the one between the corners or, clipped, a part of it
+  void setupTriangle(size_t chunk, const float* a, const float* b,
+                     const float* c, const TransformedVertex* corners[3]) {
+    float x[3] = {a[0], b[0], c[0]};
+    float y[3] = {a[1], b[1], c[1]};
+    float z[3] = {a[2], b[2], c[2]};
+
+    // Wound one way, so that the inside is where every edge function is
+    // positive
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (!(area != 0.0f)) {
+      return;
+    }
+    if (area < 0.0f) {
+      std::swap(x[1], x[2]);
+      std::swap(y[1], y[2]);
+      std::swap(z[1], z[2]);
+      area = -area;
+    }
+
+    //// The pixels whose centers the bounds cover, within the image; the
+    //// wireframe reaches a little outside the triangle
+    SetupTriangle triangle;
+    const float margin = renderMode_ == WIREFRAME ? WIRE_HALF_WIDTH : 0.0f;
+    float minimumX =
+        std::max(std::min({x[0], x[1], x[2]}) - margin, -1.0f);
+    float maximumX =
+        std::min(std::max({x[0], x[1], x[2]}) + margin, width_ + 1.0f);
+    float minimumY =
+        std::max(std::min({y[0], y[1], y[2]}) - margin, -1.0f);
+    float maximumY =
+        std::min(std::max({y[0], y[1], y[2]}) + margin, height_ + 1.0f);
+    triangle.minimumX = std::max(int(std::ceil(minimumX - 0.5f)), 0);
+    triangle.maximumX =
+        std::min(int(std::floor(maximumX - 0.5f)) + 1, width_);
+    triangle.minimumY = std::max(int(std::ceil(minimumY - 0.5f)), 0);
+    triangle.maximumY =
+        std::min(int(std::floor(maximumY - 0.5f)) + 1, height_);
+    if (triangle.minimumX >= triangle.maximumX ||
+        triangle.minimumY >= triangle.maximumY) {
+      return;
+    }
+
+    //// Each edge function is computed from the edge's end points in one
+    //// order, whichever triangle it belongs to, and negated as the
+    //// triangle's winding needs. Triangles sharing an edge then get exactly
+    //// opposite values along it, and no pixel center falls between them
+    for (int k = 0; k < 3; ++k) {
+      int first = k;
+      int second = (k + 1) % 3;
+      bool reversed = x[second] < x[first] ||
+                      (x[second] == x[first] && y[second] < y[first]);
+      if (reversed) {
+        std::swap(first, second);
+      }
+
+      float edgeA = y[first] - y[second];
+      float edgeB = x[second] - x[first];
+      if (renderMode_ == WIREFRAME) {
+        float inverseLength =
+            1.0f / std::sqrt(edgeA * edgeA + edgeB * edgeB);
+        edgeA *= inverseLength;
+        edgeB *= inverseLength;
+      }
+      float edgeC = -(edgeA * x[first] + edgeB * y[first]);
+
+      float sign = reversed ? -1.0f : 1.0f;
+      triangle.edgeA[k] = sign * edgeA;
+      triangle.edgeB[k] = sign * edgeB;
+      triangle.edgeC[k] = sign * edgeC;
+      triangle.ownsEdge[k] =
+          triangle.edgeA[k] > 0.0f ||
+          (triangle.edgeA[k] == 0.0f && triangle.edgeB[k] > 0.0f);
+    }
+
+    float dx1 = x[1] - x[0], dy1 = y[1] - y[0], dz1 = z[1] - z[0];
+    float dx2 = x[2] - x[0], dy2 = y[2] - y[0], dz2 = z[2] - z[0];
+    triangle.depthA = (dz1 * dy2 - dz2 * dy1) / area;
+    triangle.depthB = (dx1 * dz2 - dx2 * dz1) / area;
+    triangle.depthC = z[0] - triangle.depthA * x[0] - triangle.depthB * y[0];
+    triangle.color = getTriangleColor(corners);
+
+    std::vector<SetupTriangle>& triangles = setupTriangles_[chunk];
+    std::vector<std::vector<uint32_t>>& bins = bins_[chunk];
+    const uint32_t index = triangles.size();
+    triangles.push_back(triangle);
+    for (int tileY = triangle.minimumY / TILE_SIZE;
+         tileY <= (triangle.maximumY - 1) / TILE_SIZE; ++tileY) {
+      for (int tileX = triangle.minimumX / TILE_SIZE;
+           tileX <= (triangle.maximumX - 1) / TILE_SIZE; ++tileX) {
+        bins[tileY * tileColumnCount_ + tileX].push_back(index);
+      }
+    }
+  }
+
+  void rasterizeTile(size_t tile) {
+    const int tileX = tile % tileColumnCount_ * TILE_SIZE;
+    const int tileY = tile / tileColumnCount_ * TILE_SIZE;
+    const int tileEndX = std::min(tileX + TILE_SIZE, width_);
+    const int tileEndY = std::min(tileY + TILE_SIZE, height_);
+
+    for (size_t chunk = 0; chunk < chunkCount_; ++chunk) {
+      const std::vector<SetupTriangle>& triangles = setupTriangles_[chunk];
+      for (uint32_t index : bins_[chunk][tile]) {
+        const SetupTriangle& triangle = triangles[index];
+        const int startX = std::max(triangle.minimumX, tileX);
+        const int endX = std::min(triangle.maximumX, tileEndX);
+        const int endY = std::min(triangle.maximumY, tileEndY);
+        for (int y = std::max(triangle.minimumY, tileY); y < endY; ++y) {
+#if defined(__x86_64__) || defined(__i386__)
+          if (useAvx_) {
+            rasterizeSpanAvx(triangle, y, startX, endX);
+            continue;
+          }
+#endif
+          rasterizeSpan(triangle, y, startX, endX);
+        }
+      }
+    }
+  }
+
+  // Depth tests and writes the pixels of one row, from startX up to endX,
+  // that the triangle covers, or in wireframe that lie on its edges
+  void rasterizeSpan(const SetupTriangle& triangle, int y, int startX,
+                     int endX) {
+    // Terms are added in the same order as the vector version, so that both
+    // cover the same pixels
+    const float pixelY = y + 0.5f;
+    float edgeRow[3];
+    for (int k = 0; k < 3; ++k) {
+      edgeRow[k] = triangle.edgeB[k] * pixelY + triangle.edgeC[k];
+    }
+    const float depthRowStart = triangle.depthB * pixelY + triangle.depthC;
+    float* depthRow = &depthBuffer_[size_t(y) * width_];
+    uint32_t* colorRow = &colorBuffer_[size_t(y) * width_];
+
+    for (int x = startX; x < endX; ++x) {
+      const float pixelX = x + 0.5f;
+
+      bool covered = true;
+      float innermostEdge = INFINITY;
+      float nearestEdge = INFINITY;
+      for (int k = 0; k < 3; ++k) {
+        float edge = triangle.edgeA[k] * pixelX + edgeRow[k];
+        covered = covered &&
+                  (edge > 0.0f || (edge == 0.0f && triangle.ownsEdge[k]));
+        innermostEdge = std::min(innermostEdge, edge);
+        nearestEdge = std::min(nearestEdge, std::fabs(edge));
+      }
+      if (renderMode_ == WIREFRAME) {
+        covered = innermostEdge > -WIRE_HALF_WIDTH &&
+                  nearestEdge < WIRE_HALF_WIDTH;
+      }
+      if (!covered) {
+        continue;
+      }
+
+      float depth = triangle.depthA * pixelX + depthRowStart;
+      if (depth < depthRow[x]) {
+        depthRow[x] = depth;
+        colorRow[x] = triangle.color;
+      }
+    }
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  // The same, 8 pixels at a time. Loads and stores are masked to the span,
+  // so that pixels of neighbouring tiles are never touched
+  __attribute__((target("avx"))) void rasterizeSpanAvx(
+      const SetupTriangle& triangle, int y, int startX, int endX) {
+    const float pixelY = y + 0.5f;
+    float* depthRow = &depthBuffer_[size_t(y) * width_];
+    float* colorRow = reinterpret_cast<float*>(&colorBuffer_[0]) +
+                      size_t(y) * width_;
+
+    const __m256 laneOffsets =
+        _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 spanEnd = _mm256_set1_ps(float(endX));
+    const __m256 wireHalfWidth = _mm256_set1_ps(WIRE_HALF_WIDTH);
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+    const __m256 color =
+        _mm256_castsi256_ps(_mm256_set1_epi32(int32_t(triangle.color)));
+
+    __m256 edgeA[3], edgeRow[3], ownsEdge[3];
+    for (int k = 0; k < 3; ++k) {
+      edgeA[k] = _mm256_set1_ps(triangle.edgeA[k]);
+      edgeRow[k] = _mm256_set1_ps(triangle.edgeB[k] * pixelY +
+                                  triangle.edgeC[k]);
+      ownsEdge[k] = _mm256_castsi256_ps(
+          _mm256_set1_epi32(triangle.ownsEdge[k] ? -1 : 0));
+    }
+    const __m256 depthA = _mm256_set1_ps(triangle.depthA);
+    const __m256 depthRowStart =
+        _mm256_set1_ps(triangle.depthB * pixelY + triangle.depthC);
+
+    for (int x = startX; x < endX; x += 8) {
+      __m256 pixelX = _mm256_add_ps(_mm256_set1_ps(float(x)), laneOffsets);
+      __m256 mask = _mm256_cmp_ps(pixelX, spanEnd, _CMP_LT_OQ);
+
+      __m256 covered = mask;
+      __m256 innermostEdge = _mm256_set1_ps(INFINITY);
+      __m256 nearestEdge = innermostEdge;
+      for (int k = 0; k < 3; ++k) {
+        __m256 edge = _mm256_add_ps(_mm256_mul_ps(edgeA[k], pixelX),
+                                    edgeRow[k]);
+        __m256 inside = _mm256_or_ps(
+            _mm256_cmp_ps(edge, zero, _CMP_GT_OQ),
+            _mm256_and_ps(_mm256_cmp_ps(edge, zero, _CMP_EQ_OQ), ownsEdge[k]));
+        covered = _mm256_and_ps(covered, inside);
+        innermostEdge = _mm256_min_ps(innermostEdge, edge);
+        nearestEdge =
+            _mm256_min_ps(nearestEdge, _mm256_andnot_ps(signBit, edge));
+      }
+      if (renderMode_ == WIREFRAME) {
+        mask = _mm256_and_ps(
+            mask,
+            _mm256_and_ps(
+                _mm256_cmp_ps(innermostEdge,
+                              _mm256_sub_ps(zero, wireHalfWidth), _CMP_GT_OQ),
+                _mm256_cmp_ps(nearestEdge, wireHalfWidth, _CMP_LT_OQ)));
+      } else {
+        mask = covered;
+      }
+      if (_mm256_testz_ps(mask, mask)) {
+        continue;
+      }
+
+      __m256 depth =
+          _mm256_add_ps(_mm256_mul_ps(depthA, pixelX), depthRowStart);
+      __m256 storedDepth =
+          _mm256_maskload_ps(depthRow + x, _mm256_castps_si256(mask));
+      mask = _mm256_and_ps(mask,
+                           _mm256_cmp_ps(depth, storedDepth, _CMP_LT_OQ));
+
+      _mm256_maskstore_ps(depthRow + x, _mm256_castps_si256(mask), depth);
+      _mm256_maskstore_ps(colorRow + x, _mm256_castps_si256(mask), color);
+    }
+  }
+#endif
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads; parallelFor blocks until every task it
+// submitted has finished, and rethrows the first exception a task threw
+class ThreadPool {
+ public:
+  ThreadPool(unsigned threadCount = std::thread::hardware_concurrency()) {
+    if (threadCount == 0) {
+      threadCount = 1;
+    }
+
+    for (unsigned i = 0; i < threadCount; ++i) {
+      workers_.emplace_back([this] { runWorker(); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+
+    taskAvailable_.notify_all();
+    for (std::thread& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  unsigned getThreadCount() const {
+    return workers_.size();
+  }
+
+  void submit(const std::function<void()>& task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push(task);
+    }
+
+    taskAvailable_.notify_one();
+  }
+
+  void parallelFor(size_t count, const std::function<void(size_t)>& body) {
+    std::mutex doneMutex;
+    std::condition_variable done;
+    size_t remaining = count;
+    std::exception_ptr firstException;
+
+    for (size_t i = 0; i < count; ++i) {
+      submit([&, i] {
+        std::exception_ptr exception;
+        try {
+          body(i);
+        } catch (...) {
+          exception = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(doneMutex);
+        if (exception && !firstException) {
+          firstException = exception;
+        }
+
+        if (--remaining == 0) {
+          done.notify_one();
+        }
+      });
+    }
+
+    std::unique_lock<std::mutex> lock(doneMutex);
+    done.wait(lock, [&] { return remaining == 0; });
+
+    if (firstException) {
+      std::rethrow_exception(firstException);
+    }
+  }
+
+ private:
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable taskAvailable_;
+  bool stopping_ = false;
+
+  void runWorker() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        taskAvailable_.wait(lock,
+                            [this] { return stopping_ || !tasks_.empty(); });
+        if (tasks_.empty()) {
+          return;
+        }
+
+        task = std::move(tasks_.front());
+        tasks_.pop();
+      }
+
+      task();
+    }
+  }
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+#include <Eigen/Geometry>
+
+#include "Camera.hpp"
+#include "Model.hpp"
+#include "Transforms.hpp"
+
+// The model, view and projection matrices, and their product, in a uniform
+// buffer that shaders declare as
+//   layout(std140) uniform Transforms {
+//     mat4 model;
+//     mat4 view;
+//     mat4 projection;
+//     mat4 modelViewProjection;
+//   };
+// The matrices are built on the CPU by Transforms, and only rebuilt and
+// uploaded when the model or camera has moved since the last update
+class TransformBlock {
+ public:
+  static const GLuint BINDING = 0;
+
+  TransformBlock() {
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+    glBufferData(GL_UNIFORM_BUFFER, 4 * sizeof(Eigen::Matrix4f), NULL,
+                 GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, buffer_);
+  }
+
+  TransformBlock(const TransformBlock&) = delete;
+  TransformBlock& operator=(const TransformBlock&) = delete;
+
+  ~TransformBlock() {
+    glDeleteBuffers(1, &buffer_);
+  }
+
+  void update(Model& model, const Camera& camera) {
+    std::vector<float> modelState = getModelState(model);
+    std::vector<float> cameraState = getCameraState(camera);
+    if (modelState == modelState_ && cameraState == cameraState_) {
+      return;
+    }
+
+    if (modelState != modelState_) {
+      modelMatrix_ = Transforms::buildModelMatrix(model);
+      modelState_ = modelState;
+    }
+
+    if (cameraState != cameraState_) {
+      viewMatrix_ = Transforms::buildViewMatrix(camera);
+      projectionMatrix_ = Transforms::buildProjectionMatrix(camera);
+      cameraState_ = cameraState;
+    }
+
+    modelViewProjectionMatrix_ = projectionMatrix_ * viewMatrix_ * modelMatrix_;
+
+    // Column major, as std140 lays out a mat4
+    const Eigen::Matrix4f matrices[4] = {modelMatrix_, viewMatrix_,
+                                         projectionMatrix_,
+                                         modelViewProjectionMatrix_};
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(matrices), matrices);
+  }
+
+  const Eigen::Matrix4f& getModelMatrix() const {
+    return modelMatrix_;
+  }
+
+  const Eigen::Matrix4f& getModelViewProjectionMatrix() const {
+    return modelViewProjectionMatrix_;
+  }
+
+ private:
+  GLuint buffer_;
+
+  // What the matrices were last built from; empty until the first update
+  std::vector<float> modelState_;
+  std::vector<float> cameraState_;
+
+  Eigen::Matrix4f modelMatrix_;
+  Eigen::Matrix4f viewMatrix_;
+  Eigen::Matrix4f projectionMatrix_;
+  Eigen::Matrix4f modelViewProjectionMatrix_;
+
+  static std::vector<float> getModelState(Model& model) {
+    std::vector<float> state = model.getDisplacement();
+    Eigen::Quaternion<float> orientation = model.getOrientation();
+    state.insert(state.end(), orientation.coeffs().data(),
+                 orientation.coeffs().data() + 4);
+
+    std::vector<float> scale = model.getScale();
+    std::vector<float> center = model.getCenter();
+    state.insert(state.end(), scale.begin(), scale.end());
+    state.insert(state.end(), center.begin(), center.end());
+    return state;
+  }
+
+  static std::vector<float> getCameraState(const Camera& camera) {
+    std::vector<float> state = camera.getDisplacement();
+    Eigen::Quaternion<float> orientation = camera.getOrientation();
+    state.insert(state.end(), orientation.coeffs().data(),
+                 orientation.coeffs().data() + 4);
+    state.push_back(camera.getCameraProjectionMode());
+    return state;
+  }
+};
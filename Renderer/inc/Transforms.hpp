@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <Eigen/Geometry>
+
+#include "Camera.hpp"
+#include "Model.hpp"
+
+// Builds the model, view and projection matrices that place things exactly
+// as the fixed function viewers do: the camera's translation and rotation
+// follow the projection, and the model (or a whole Scene) is scaled about its
+// center. Needs no GL, so that renderers without one place models the same
+// way
+class Transforms {
+ public:
+  // The viewing volume the fixed function viewers set up with glOrtho and
+  // glFrustum
+  static constexpr float NEAR_PLANE = 8.0f;
+  static constexpr float FAR_PLANE = 100.0f;
+
+  template <typename Placed>
+  static Eigen::Matrix4f buildModelMatrix(Placed& model) {
+    std::vector<float> displacement = model.getDisplacement();
+    std::vector<float> scale = model.getScale();
+    std::vector<float> center = model.getCenter();
+
+    Eigen::Affine3f transform(Eigen::Translation3f(
+        displacement[0], displacement[1], displacement[2]));
+    transform.rotate(model.getOrientation());
+    transform.scale(Eigen::Vector3f(scale[0], scale[1], scale[2]));
+    transform.translate(Eigen::Vector3f(-center[0], -center[1], -center[2]));
+    return transform.matrix();
+  }
+
+  static Eigen::Matrix4f buildViewMatrix(const Camera& camera) {
+    std::vector<float> displacement = camera.getDisplacement();
+
+    Eigen::Affine3f transform(Eigen::Translation3f(
+        displacement[0], displacement[1], displacement[2]));
+    transform.rotate(camera.getOrientation());
+    return transform.matrix();
+  }
+
+  // The unit square at the near plane, as glOrtho(-1, 1, -1, 1, ...) and
+  // glFrustum(-1, 1, -1, 1, ...) build it
+  static Eigen::Matrix4f buildProjectionMatrix(const Camera& camera) {
+    const float depth = FAR_PLANE - NEAR_PLANE;
+
+    Eigen::Matrix4f projection = Eigen::Matrix4f::Zero();
+    if (camera.getCameraProjectionMode() ==
+        Camera::CAMERA_PROJECTION_MODE::PERSPECTIVE) {
+      projection(0, 0) = NEAR_PLANE;
+      projection(1, 1) = NEAR_PLANE;
+      projection(2, 2) = -(FAR_PLANE + NEAR_PLANE) / depth;
+      projection(2, 3) = -2 * FAR_PLANE * NEAR_PLANE / depth;
+      projection(3, 2) = -1.0f;
+    } else {
+      projection(0, 0) = 1.0f;
+      projection(1, 1) = 1.0f;
+      projection(2, 2) = -2 / depth;
+      projection(2, 3) = -(FAR_PLANE + NEAR_PLANE) / depth;
+      projection(3, 3) = 1.0f;
+    }
+
+    return projection;
+  }
+};
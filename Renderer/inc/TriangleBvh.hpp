@@ -0,0 +1,576 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include <Eigen/Geometry>
+
+#include "Model.hpp"
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+// Bounding volume hierarchy over a model's triangles, for picking and other
+// ray queries. It is built as a binary tree, splitting where the surface area
+// heuristic (SAH) puts them, over binned triangle centroids, then collapsed
+// into a tree of 4 children per node. Nodes sit in one flat array, the root
+// first, each holding its children's boxes as a structure of arrays, so that
+// a ray is tested against all four boxes at once with vector instructions.
+// Leaves are ranges of a copy of the triangles, stored in leaf order in the
+// form the ray test wants them
+//
+// The hierarchy holds its own copy of the geometry; it has to be rebuilt if
+// the model's vertices or triangles change
+class TriangleBvh {
+ public:
+  static const uint32_t NO_TRIANGLE = 0xffffffff;
+
+  // Distances are in multiples of the ray's direction, and the triangle is
+  // the model's. The hit point is
+  //   (1 - u - v) * corner 0 + u * corner 1 + v * corner 2
+  struct Hit {
+    uint32_t triangle = NO_TRIANGLE;
+    float distance = INFINITY;
+    float u = 0.0f;
+    float v = 0.0f;
+  };
+
+  // Children of a node; inner children index the node array, and leaves
+  // are triangleCounts[i] triangles from children[i] on. Unused slots hold
+  // EMPTY_CHILD
+  struct Node {
+    float minimumX[4];
+    float minimumY[4];
+    float minimumZ[4];
+    float maximumX[4];
+    float maximumY[4];
+    float maximumZ[4];
+    uint32_t children[4];
+    uint32_t triangleCounts[4];
+  };
+
+  static const uint32_t EMPTY_CHILD = 0xffffffff;
+
+  TriangleBvh(Model& model) {
+    const std::vector<float>& vertices = model.getVertices();
+    const std::vector<uint32_t>& indices = model.getIndices();
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount >= NO_TRIANGLE) {
+      throw std::runtime_error(
+          "Failed to build bounding volume hierarchy: too many triangles");
+    }
+
+    //// Bounds and centroids of every triangle, which is all the build
+    //// looks at
+    std::vector<BuildTriangle> buildTriangles(triangleCount);
+    for (size_t triangle = 0; triangle < triangleCount; ++triangle) {
+      BuildTriangle& buildTriangle = buildTriangles[triangle];
+      for (int corner = 0; corner < 3; ++corner) {
+        buildTriangle.bounds.extend(
+            Eigen::Map<const Eigen::Vector3f>(
+                &vertices[3 * indices[3 * triangle + corner]]));
+      }
+      buildTriangle.centroid =
+          (buildTriangle.bounds.minimum + buildTriangle.bounds.maximum) / 2;
+      buildTriangle.index = triangle;
+    }
+
+    std::vector<BinaryNode> binaryNodes;
+    binaryNodes.reserve(triangleCount > 0 ? 2 * triangleCount - 1 : 0);
+    if (triangleCount > 0) {
+      buildBinaryNode(buildTriangles, 0, triangleCount, 0, binaryNodes);
+    }
+
+    //// The triangles in leaf order, ready for the ray test
+    triangles_.resize(triangleCount);
+    for (size_t i = 0; i < triangleCount; ++i) {
+      uint32_t triangle = buildTriangles[i].index;
+      Eigen::Map<const Eigen::Vector3f> corner0(
+          &vertices[3 * indices[3 * triangle]]);
+      Eigen::Map<const Eigen::Vector3f> corner1(
+          &vertices[3 * indices[3 * triangle + 1]]);
+      Eigen::Map<const Eigen::Vector3f> corner2(
+          &vertices[3 * indices[3 * triangle + 2]]);
+      Eigen::Map<Eigen::Vector3f>(triangles_[i].corner) = corner0;
+      Eigen::Map<Eigen::Vector3f>(triangles_[i].edge1) = corner1 - corner0;
+      Eigen::Map<Eigen::Vector3f>(triangles_[i].edge2) = corner2 - corner0;
+      triangles_[i].index = triangle;
+    }
+
+    if (triangleCount > 0) {
+      nodes_.reserve(binaryNodes.size() / 2 + 1);
+      collapseBinaryNode(binaryNodes, 0);
+      sahCost_ = binaryNodes[0].cost;
+    }
+  }
+
+  size_t getTriangleCount() const {
+    return triangles_.size();
+  }
+
+  size_t getNodeCount() const {
+    return nodes_.size();
+  }
+
+  // Bytes taken by the nodes and triangles
+  size_t getMemorySize() const {
+    return nodes_.size() * sizeof(Node) + triangles_.size() * sizeof(Triangle);
+  }
+
+  // Expected cost of a ray through the binary tree before it was collapsed,
+  // in triangle tests, as the SAH estimates it
+  float getSahCost() const {
+    return sahCost_;
+  }
+
+  const std::vector<Node>& getNodes() const {
+    return nodes_;
+  }
+
+  // Finds the nearest triangle the ray hits between 0 and maxDistance;
+  // returns false, and leaves hit alone, if there is none
+  bool intersect(const Eigen::Vector3f& origin,
+                 const Eigen::Vector3f& direction, Hit& hit,
+                 float maxDistance = INFINITY) const {
+    Hit nearestHit;
+    nearestHit.distance = maxDistance;
+    traverse<false>(origin, direction, nearestHit);
+    if (nearestHit.triangle == NO_TRIANGLE) {
+      return false;
+    }
+
+    hit = nearestHit;
+    return true;
+  }
+
+  // Whether the ray hits any triangle between 0 and maxDistance, as for
+  // visibility; stops at the first one found
+  bool isOccluded(const Eigen::Vector3f& origin,
+                  const Eigen::Vector3f& direction,
+                  float maxDistance = INFINITY) const {
+    Hit anyHit;
+    anyHit.distance = maxDistance;
+    return traverse<true>(origin, direction, anyHit);
+  }
+
+ private:
+  static const unsigned BIN_COUNT = 16;
+  static const unsigned MAX_LEAF_TRIANGLE_COUNT = 8;
+
+  // Deeper nodes become leaves whatever they hold, which bounds the
+  // traversal stack
+  static const unsigned MAX_DEPTH = 64;
+  static const unsigned STACK_SIZE = 3 * MAX_DEPTH + 4;
+
+  // Costs of visiting a node and of testing a triangle, relative to each
+  // other
+  static constexpr float TRAVERSAL_COST = 1.0f;
+  static constexpr float INTERSECTION_COST = 1.0f;
+
+  struct Bounds {
+    Eigen::Vector3f minimum = Eigen::Vector3f::Constant(INFINITY);
+    Eigen::Vector3f maximum = Eigen::Vector3f::Constant(-INFINITY);
+
+    void extend(const Eigen::Vector3f& point) {
+      minimum = minimum.cwiseMin(point);
+      maximum = maximum.cwiseMax(point);
+    }
+
+    void extend(const Bounds& bounds) {
+      minimum = minimum.cwiseMin(bounds.minimum);
+      maximum = maximum.cwiseMax(bounds.maximum);
+    }
+
+    float getSurfaceArea() const {
+      Eigen::Vector3f extent = (maximum - minimum).cwiseMax(0.0f);
+      return 2 * (extent[0] * extent[1] + extent[1] * extent[2] +
+                  extent[2] * extent[0]);
+    }
+  };
+
+  struct BuildTriangle {
+    Bounds bounds;
+    Eigen::Vector3f centroid;
+    uint32_t index;
+  };
+
+  // Leaves have no children, and hold triangleCount build triangles from
+  // firstTriangle on
+  struct BinaryNode {
+    Bounds bounds;
+    uint32_t children[2];
+    uint32_t firstTriangle;
+    uint32_t triangleCount;
+
+    // Of the subtree, in triangle tests, relative to this node's area
+    float cost;
+  };
+
+  // Corner 0 and the edges from it to the other two
+  struct Triangle {
+    float corner[3];
+    float edge1[3];
+    float edge2[3];
+    uint32_t index;
+  };
+
+  std::vector<Node> nodes_;
+  std::vector<Triangle> triangles_;
+  float sahCost_ = 0.0f;
+
+  // Builds the node over build triangles [begin, end), reordering them so
+  // that each leaf's are contiguous; returns its index
+  static uint32_t buildBinaryNode(std::vector<BuildTriangle>& buildTriangles,
+                                  uint32_t begin, uint32_t end,
+                                  unsigned depth,
+                                  std::vector<BinaryNode>& binaryNodes) {
+    const uint32_t nodeIndex = binaryNodes.size();
+    binaryNodes.emplace_back();
+
+    Bounds bounds, centroidBounds;
+    for (uint32_t i = begin; i < end; ++i) {
+      bounds.extend(buildTriangles[i].bounds);
+      centroidBounds.extend(buildTriangles[i].centroid);
+    }
+
+    const uint32_t triangleCount = end - begin;
+    const float leafCost = INTERSECTION_COST * triangleCount;
+
+    //// Bin the centroids along each axis, and find the cheapest split
+    //// between bins
+    int splitAxis = -1;
+    unsigned splitBin = 0;
+    float splitCost = INFINITY;
+    const float surfaceArea = bounds.getSurfaceArea();
+    Eigen::Vector3f centroidExtent =
+        centroidBounds.maximum - centroidBounds.minimum;
+    for (int axis = 0; axis < 3 && triangleCount > 1; ++axis) {
+      if (!(centroidExtent[axis] > 0.0f)) {
+        continue;
+      }
+
+      Bounds binBounds[BIN_COUNT];
+      uint32_t binCounts[BIN_COUNT] = {};
+      const float binScale = BIN_COUNT / centroidExtent[axis];
+      for (uint32_t i = begin; i < end; ++i) {
+        unsigned bin = getBin(buildTriangles[i].centroid[axis],
+                              centroidBounds.minimum[axis], binScale);
+        binBounds[bin].extend(buildTriangles[i].bounds);
+        ++binCounts[bin];
+      }
+
+      // Areas and counts left of each split, swept from the left, then
+      // those right of it from the right
+      float leftAreas[BIN_COUNT - 1];
+      uint32_t leftCounts[BIN_COUNT - 1];
+      Bounds left;
+      uint32_t leftCount = 0;
+      for (unsigned bin = 0; bin + 1 < BIN_COUNT; ++bin) {
+        left.extend(binBounds[bin]);
+        leftCount += binCounts[bin];
+        leftAreas[bin] = left.getSurfaceArea();
+        leftCounts[bin] = leftCount;
+      }
+
+      Bounds right;
+      uint32_t rightCount = 0;
+      for (unsigned bin = BIN_COUNT - 1; bin > 0; --bin) {
+        right.extend(binBounds[bin]);
+        rightCount += binCounts[bin];
+        if (leftCounts[bin - 1] == 0 || rightCount == 0) {
+          continue;
+        }
+
+        float cost = leftAreas[bin - 1] * leftCounts[bin - 1] +
+                     right.getSurfaceArea() * rightCount;
+        if (cost < splitCost) {
+          splitAxis = axis;
+          splitBin = bin;
+          splitCost = cost;
+        }
+      }
+    }
+
+    splitCost = TRAVERSAL_COST +
+                INTERSECTION_COST * splitCost /
+                    std::max(surfaceArea, std::numeric_limits<float>::min());
+
+    //// Make a leaf where splitting would not pay, or cannot be done
+    bool makeLeaf = splitAxis < 0 || depth >= MAX_DEPTH ||
+                    (triangleCount <= MAX_LEAF_TRIANGLE_COUNT &&
+                     leafCost <= splitCost);
+    if (makeLeaf) {
+      BinaryNode& node = binaryNodes[nodeIndex];
+      node.bounds = bounds;
+      node.firstTriangle = begin;
+      node.triangleCount = triangleCount;
+      node.cost = leafCost;
+      return nodeIndex;
+    }
+
+    const float binScale = BIN_COUNT / centroidExtent[splitAxis];
+    const float binStart = centroidBounds.minimum[splitAxis];
+    BuildTriangle* middle = std::partition(
+        buildTriangles.data() + begin, buildTriangles.data() + end,
+        [&](const BuildTriangle& buildTriangle) {
+          return getBin(buildTriangle.centroid[splitAxis], binStart,
+                        binScale) < splitBin;
+        });
+    const uint32_t split = middle - buildTriangles.data();
+
+    uint32_t leftChild =
+        buildBinaryNode(buildTriangles, begin, split, depth + 1, binaryNodes);
+    uint32_t rightChild =
+        buildBinaryNode(buildTriangles, split, end, depth + 1, binaryNodes);
+
+    // The vector may have moved while the children were built
+    BinaryNode& node = binaryNodes[nodeIndex];
+    node.bounds = bounds;
+    node.children[0] = leftChild;
+    node.children[1] = rightChild;
+    node.triangleCount = 0;
+    node.cost = TRAVERSAL_COST;
+    for (uint32_t child : {leftChild, rightChild}) {
+      node.cost += binaryNodes[child].cost *
+                   binaryNodes[child].bounds.getSurfaceArea() /
+                   std::max(surfaceArea, std::numeric_limits<float>::min());
+    }
+    return nodeIndex;
+  }
+
+  static unsigned getBin(float centroid, float binStart, float binScale) {
+    int bin = int((centroid - binStart) * binScale);
+    return std::min(std::max(bin, 0), int(BIN_COUNT) - 1);
+  }
+
+  // Turns the binary subtree into 4-wide nodes: the node's children are
+  // opened, largest first, until there are 4 of them or only leaves are
+  // left. Returns the index of the new node
+  uint32_t collapseBinaryNode(const std::vector<BinaryNode>& binaryNodes,
+                              uint32_t binaryIndex) {
+    std::vector<uint32_t> children;
+    if (binaryNodes[binaryIndex].triangleCount > 0) {
+      children.push_back(binaryIndex);
+    } else {
+      children.assign(binaryNodes[binaryIndex].children,
+                      binaryNodes[binaryIndex].children + 2);
+    }
+
+    while (children.size() < 4) {
+      int largestChild = -1;
+      float largestArea = -1.0f;
+      for (size_t i = 0; i < children.size(); ++i) {
+        const BinaryNode& child = binaryNodes[children[i]];
+        if (child.triangleCount == 0 &&
+            child.bounds.getSurfaceArea() > largestArea) {
+          largestChild = i;
+          largestArea = child.bounds.getSurfaceArea();
+        }
+      }
+      if (largestChild < 0) {
+        break;
+      }
+
+      const BinaryNode& opened = binaryNodes[children[largestChild]];
+      children[largestChild] = opened.children[0];
+      children.push_back(opened.children[1]);
+    }
+
+    const uint32_t nodeIndex = nodes_.size();
+    nodes_.emplace_back();
+    for (unsigned slot = 0; slot < 4; ++slot) {
+      uint32_t child = EMPTY_CHILD;
+      uint32_t triangleCount = 0;
+      Bounds bounds;
+      if (slot < children.size()) {
+        const BinaryNode& binaryChild = binaryNodes[children[slot]];
+        bounds = binaryChild.bounds;
+        triangleCount = binaryChild.triangleCount;
+        child = triangleCount > 0
+                    ? binaryChild.firstTriangle
+                    : collapseBinaryNode(binaryNodes, children[slot]);
+      }
+
+      // The array may have moved while the child was collapsed
+      Node& node = nodes_[nodeIndex];
+      node.minimumX[slot] = bounds.minimum[0];
+      node.minimumY[slot] = bounds.minimum[1];
+      node.minimumZ[slot] = bounds.minimum[2];
+      node.maximumX[slot] = bounds.maximum[0];
+      node.maximumY[slot] = bounds.maximum[1];
+      node.maximumZ[slot] = bounds.maximum[2];
+      node.children[slot] = child;
+      node.triangleCounts[slot] = triangleCount;
+    }
+
+    return nodeIndex;
+  }
+
+  // Returns a bit for each child whose box the ray enters before
+  // maxDistance, and where it enters them
+  static unsigned intersectBoxes(const Node& node,
+                                 const Eigen::Vector3f& origin,
+                                 const Eigen::Vector3f& inverseDirection,
+                                 float maxDistance, float entries[4]) {
+#if defined(__SSE__)
+    const __m128 originX = _mm_set1_ps(origin[0]);
+    const __m128 originY = _mm_set1_ps(origin[1]);
+    const __m128 originZ = _mm_set1_ps(origin[2]);
+    const __m128 inverseX = _mm_set1_ps(inverseDirection[0]);
+    const __m128 inverseY = _mm_set1_ps(inverseDirection[1]);
+    const __m128 inverseZ = _mm_set1_ps(inverseDirection[2]);
+
+    __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minimumX), originX),
+                           inverseX);
+    __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maximumX), originX),
+                           inverseX);
+    __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minimumY), originY),
+                           inverseY);
+    __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maximumY), originY),
+                           inverseY);
+    __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minimumZ), originZ),
+                           inverseZ);
+    __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maximumZ), originZ),
+                           inverseZ);
+
+    __m128 entry = _mm_max_ps(
+        _mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)),
+        _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+    __m128 exit = _mm_min_ps(
+        _mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)),
+        _mm_min_ps(_mm_max_ps(z0, z1), _mm_set1_ps(maxDistance)));
+
+    _mm_storeu_ps(entries, entry);
+    return _mm_movemask_ps(_mm_cmple_ps(entry, exit));
+#else
+    const float* minima[3] = {node.minimumX, node.minimumY, node.minimumZ};
+    const float* maxima[3] = {node.maximumX, node.maximumY, node.maximumZ};
+    unsigned hitMask = 0;
+    for (int slot = 0; slot < 4; ++slot) {
+      float entry = 0.0f;
+      float exit = maxDistance;
+      for (int axis = 0; axis < 3; ++axis) {
+        float t0 = (minima[axis][slot] - origin[axis]) * inverseDirection[axis];
+        float t1 = (maxima[axis][slot] - origin[axis]) * inverseDirection[axis];
+        entry = std::max(entry, std::min(t0, t1));
+        exit = std::min(exit, std::max(t0, t1));
+      }
+
+      entries[slot] = entry;
+      hitMask |= unsigned(entry <= exit) << slot;
+    }
+
+    return hitMask;
+#endif
+  }
+
+  // Moller-Trumbore; only hits nearer than hit's distance count
+  bool intersectTriangle(const Triangle& triangle,
+                         const Eigen::Vector3f& origin,
+                         const Eigen::Vector3f& direction, Hit& hit) const {
+    Eigen::Map<const Eigen::Vector3f> corner(triangle.corner);
+    Eigen::Map<const Eigen::Vector3f> edge1(triangle.edge1);
+    Eigen::Map<const Eigen::Vector3f> edge2(triangle.edge2);
+
+    Eigen::Vector3f p = direction.cross(edge2);
+    float determinant = edge1.dot(p);
+    if (determinant == 0.0f) {
+      return false;
+    }
+
+    float inverseDeterminant = 1.0f / determinant;
+    Eigen::Vector3f s = origin - corner;
+    float u = s.dot(p) * inverseDeterminant;
+    if (!(u >= 0.0f && u <= 1.0f)) {
+      return false;
+    }
+
+    Eigen::Vector3f q = s.cross(edge1);
+    float v = direction.dot(q) * inverseDeterminant;
+    if (!(v >= 0.0f && u + v <= 1.0f)) {
+      return false;
+    }
+
+    float distance = edge2.dot(q) * inverseDeterminant;
+    if (!(distance > 0.0f && distance < hit.distance)) {
+      return false;
+    }
+
+    hit.triangle = triangle.index;
+    hit.distance = distance;
+    hit.u = u;
+    hit.v = v;
+    return true;
+  }
+
+  // Nearest children first, so that hits found early cut off the boxes
+  // behind them. With anyHit, returns at the first hit
+  template <bool anyHit>
+  bool traverse(const Eigen::Vector3f& origin,
+                const Eigen::Vector3f& direction, Hit& hit) const {
+    if (nodes_.empty()) {
+      return false;
+    }
+
+    const Eigen::Vector3f inverseDirection = direction.cwiseInverse();
+
+    uint32_t stack[STACK_SIZE];
+    unsigned stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+      const Node& node = nodes_[stack[--stackSize]];
+
+      float entries[4];
+      unsigned hitMask = intersectBoxes(node, origin, inverseDirection,
+                                        hit.distance, entries);
+
+      //// Order the children hit by where the ray enters them
+      unsigned slots[4];
+      unsigned slotCount = 0;
+      for (; hitMask != 0; hitMask &= hitMask - 1) {
+        unsigned slot = __builtin_ctz(hitMask);
+        if (node.children[slot] == EMPTY_CHILD) {
+          continue;
+        }
+
+        unsigned i = slotCount++;
+        for (; i > 0 && entries[slots[i - 1]] > entries[slot]; --i) {
+          slots[i] = slots[i - 1];
+        }
+        slots[i] = slot;
+      }
+
+      //// Test leaves now, nearest first, and visit inner nodes from the
+      //// stack, nearest on top
+      for (unsigned i = 0; i < slotCount; ++i) {
+        unsigned slot = slots[i];
+        if (node.triangleCounts[slot] == 0 ||
+            entries[slot] > hit.distance) {
+          continue;
+        }
+
+        const Triangle* triangle = &triangles_[node.children[slot]];
+        for (uint32_t k = 0; k < node.triangleCounts[slot]; ++k) {
+          if (intersectTriangle(triangle[k], origin, direction, hit) &&
+              anyHit) {
+            return true;
+          }
+        }
+      }
+
+      for (unsigned i = slotCount; i-- > 0;) {
+        unsigned slot = slots[i];
+        if (node.triangleCounts[slot] == 0 &&
+            entries[slot] <= hit.distance) {
+          stack[stackSize++] = node.children[slot];
+        }
+      }
+    }
+
+    return hit.triangle != NO_TRIANGLE;
+  }
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// A compact vertex format for uploading models: each position coordinate
+// becomes a 16-bit step across the model's bounding box, which a shader reads
+// as a normalized attribute and decodes as
+//   position = offset + scale * normalized
+// This takes positions from 12 bytes to 6. Indices shrink to 16 bits
+// whenever every vertex can be addressed that way
+class VertexQuantizer {
+ public:
+  static const uint32_t STEP_COUNT = 65535;
+
+  // Largest vertex count that 16-bit indices can address
+  static const size_t MAX_SHORT_INDEXED_VERTEX_COUNT = 65536;
+
+  VertexQuantizer(const std::vector<float>& minimumBounds,
+                  const std::vector<float>& dimensions) {
+    if (minimumBounds.size() != 3 || dimensions.size() != 3) {
+      throw std::runtime_error(
+          "Failed to quantize vertices: the bounds must contain 3 dimensions");
+    }
+
+    for (int axis = 0; axis < 3; ++axis) {
+      offset_[axis] = minimumBounds[axis];
+      scale_[axis] = dimensions[axis];
+
+      // A flat axis has one value, which every step decodes to
+      inverseStep_[axis] =
+          dimensions[axis] > 0.0f ? STEP_COUNT / dimensions[axis] : 0.0f;
+    }
+  }
+
+  // Rounds to the nearest step, so that no coordinate moves by more than
+  // half a step
+  void quantize(const float* positions, size_t vertexCount,
+                uint16_t* quantizedPositions) const {
+    for (size_t i = 0; i < 3 * vertexCount; ++i) {
+      int axis = i % 3;
+      float step = (positions[i] - offset_[axis]) * inverseStep_[axis];
+      step = std::fmin(std::fmax(step + 0.5f, 0.0f), float(STEP_COUNT));
+      quantizedPositions[i] = uint16_t(step);
+    }
+  }
+
+  const float* getOffset() const {
+    return offset_;
+  }
+
+  const float* getScale() const {
+    return scale_;
+  }
+
+  // How far, in model units, a decoded position can be from the original
+  float getMaximumError() const {
+    float squaredError = 0.0f;
+    for (int axis = 0; axis < 3; ++axis) {
+      float halfStep = scale_[axis] / STEP_COUNT / 2;
+      squaredError += halfStep * halfStep;
+    }
+
+    return std::sqrt(squaredError);
+  }
+
+  static bool fitsShortIndices(size_t vertexCount) {
+    return vertexCount <= MAX_SHORT_INDEXED_VERTEX_COUNT;
+  }
+
+  // The caller must have checked that the indices fit
+  static void narrowIndices(const uint32_t* indices, size_t indexCount,
+                            uint16_t* shortIndices) {
+    for (size_t i = 0; i < indexCount; ++i) {
+      shortIndices[i] = uint16_t(indices[i]);
+    }
+  }
+
+ private:
+  float offset_[3];
+  float scale_[3];
+  float inverseStep_[3];
+};
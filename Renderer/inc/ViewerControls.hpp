@@ -0,0 +1,157 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+
+#include <cmath>
+#include <vector>
+#include <Eigen/Geometry>
+
+#include "Camera.hpp"
+#include "Transforms.hpp"
+
+// What the viewers share besides their drawing: the keys that move what they
+// show and the camera, and, for the fixed function pipeline, placing both
+// from the same matrices the core profile viewer uses. What is shown is a
+// Model or a Scene, or anything else that moves and is placed the same way
+class ViewerControls {
+ public:
+  // Loads the camera's projection and view into the projection matrix, and
+  // clears the model view matrix
+  static void positionCamera(const Camera& camera) {
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(Transforms::buildProjectionMatrix(camera).data());
+    glMultMatrixf(Transforms::buildViewMatrix(camera).data());
+
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+  }
+
+  // Multiplies the model view matrix by where what is shown is placed
+  template <typename Placed>
+  static void place(Placed& placed) {
+    glMultMatrixf(Transforms::buildModelMatrix(placed).data());
+  }
+
+  // Moves what is shown or the camera, or switches the camera's projection;
+  // returns false, doing nothing, for keys the viewer handles itself
+  template <typename Placed>
+  static bool handleKey(unsigned char key, Placed& placed, Camera& camera) {
+    switch (key) {
+      case 'x': {
+        // Puts what is shown and the camera back where they start
+        placed.rotate(placed.getOrientation().inverse());
+        std::vector<float> placedPosition = placed.getDisplacement();
+        placed.translate(std::vector<float>{-placedPosition[0],
+                                            -placedPosition[1],
+                                            -placedPosition[2] - 10.0f});
+
+        camera.rotate(camera.getOrientation().inverse());
+        std::vector<float> cameraPosition = camera.getDisplacement();
+        camera.translate(std::vector<float>{
+            -cameraPosition[0], -cameraPosition[1], -cameraPosition[2]});
+        return true;
+      }
+      case 'v':
+        camera.setCameraProjectionMode(
+            Camera::CAMERA_PROJECTION_MODE::ORTHOGRAPHIC);
+        return true;
+      case 'V':
+        camera.setCameraProjectionMode(
+            Camera::CAMERA_PROJECTION_MODE::PERSPECTIVE);
+        return true;
+      case 'n':
+        placed.translate(std::vector<float>{0.0f, 0.0f, -0.1f});
+        return true;
+      case 'N':
+        placed.translate(std::vector<float>{0.0f, 0.0f, 0.1f});
+        return true;
+      case 'p':
+        placed.rotate(buildRotation(-10, 0));
+        return true;
+      case 'P':
+        placed.rotate(buildRotation(10, 0));
+        return true;
+      case 'y':
+        placed.rotate(buildRotation(-10, 1));
+        return true;
+      case 'Y':
+        placed.rotate(buildRotation(10, 1));
+        return true;
+      case 'r':
+        placed.rotate(buildRotation(-10, 2));
+        return true;
+      case 'R':
+        placed.rotate(buildRotation(10, 2));
+        return true;
+      case 'd':
+        camera.translate(std::vector<float>{-0.1f, 0.0f, 0.0f});
+        return true;
+      case 'D':
+        camera.translate(std::vector<float>{0.1f, 0.0f, 0.0f});
+        return true;
+      case 'c':
+        camera.translate(std::vector<float>{0.0f, -0.1f, 0.0f});
+        return true;
+      case 'C':
+        camera.translate(std::vector<float>{0.0f, 0.1f, 0.0f});
+        return true;
+      case 'z':
+        camera.translate(std::vector<float>{0.0f, 0.0f, -0.1f});
+        return true;
+      case 'Z':
+        camera.translate(std::vector<float>{0.0f, 0.0f, 0.1f});
+        return true;
+      case 't':
+        camera.rotate(buildRotation(-1, 0));
+        return true;
+      case 'T':
+        camera.rotate(buildRotation(1, 0));
+        return true;
+      case 'a':
+        camera.rotate(buildRotation(-1, 1));
+        return true;
+      case 'A':
+        camera.rotate(buildRotation(1, 1));
+        return true;
+      case 'l':
+        camera.rotate(buildRotation(-10, 2));
+        return true;
+      case 'L':
+        camera.rotate(buildRotation(10, 2));
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // The arrow keys move what is shown in the view's plane
+  template <typename Placed>
+  static bool handleSpecialKey(int key, Placed& placed) {
+    switch (key) {
+      case GLUT_KEY_UP:
+        placed.translate(std::vector<float>{0.0f, 0.1f, 0.0f});
+        return true;
+      case GLUT_KEY_DOWN:
+        placed.translate(std::vector<float>{0.0f, -0.1f, 0.0f});
+        return true;
+      case GLUT_KEY_LEFT:
+        placed.translate(std::vector<float>{-0.1f, 0.0f, 0.0f});
+        return true;
+      case GLUT_KEY_RIGHT:
+        placed.translate(std::vector<float>{0.1f, 0.0f, 0.0f});
+        return true;
+      default:
+        return false;
+    }
+  }
+
+ private:
+  // About the x (0), y (1) or z (2) axis
+  static Eigen::Quaternion<float> buildRotation(float degrees, int axis) {
+    const float halfAngle = degrees * float(M_PI) / 360;
+    Eigen::Quaternion<float> rotation(std::cos(halfAngle), 0.0f, 0.0f, 0.0f);
+    rotation.vec()[axis] = std::sin(halfAngle);
+    return rotation;
+  }
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ModelFactory.hpp"
+
+// Command line options shared by the model viewers:
+//   <viewer> [--loader=stream|mmap|parallel] [--no-cache] [--optimize]
+//            [--lod] [--normals] [--quantize] [--deform]
+//            [--export-digits=N]
+//            [--bench N] [--stats[=json]] [--profile]
+//            [--profile-trace=<CSV path>]
+//            <path to model specifications>...
+// The first model is shown at start; the viewers load the others on request
+class ViewerOptions {
+ public:
+  enum class STATISTICS_FORMAT { NONE, REPORT, JSON };
+
+  ViewerOptions() {
+    modelLoadMode_ = ModelFactory::MODEL_LOAD_MODE::STREAM;
+    useModelCache_ = true;
+    optimizeVertexCache_ = false;
+    generateLevelsOfDetail_ = false;
+    generateNormals_ = false;
+    quantizeVertices_ = false;
+    deformVertices_ = false;
+    exportSignificantDigits_ = 0;
+    benchmarkFrameCount_ = 0;
+    statisticsFormat_ = STATISTICS_FORMAT::NONE;
+    showProfile_ = false;
+  }
+
+  ViewerOptions(int argc, char** argv) : ViewerOptions() {
+
+    for (int i = 1; i < argc; ++i) {
+      std::string argument(argv[i]);
+
+      if (argument.compare(0, 2, "--") != 0) {
+        modelFilePaths_.push_back(argument);
+      } else if (argument == "--loader=stream") {
+        modelLoadMode_ = ModelFactory::MODEL_LOAD_MODE::STREAM;
+      } else if (argument == "--loader=mmap") {
+        modelLoadMode_ = ModelFactory::MODEL_LOAD_MODE::MAPPED;
+      } else if (argument == "--loader=parallel") {
+        modelLoadMode_ = ModelFactory::MODEL_LOAD_MODE::PARALLEL;
+      } else if (argument == "--no-cache") {
+        useModelCache_ = false;
+      } else if (argument == "--optimize") {
+        optimizeVertexCache_ = true;
+      } else if (argument == "--lod") {
+        generateLevelsOfDetail_ = true;
+      } else if (argument == "--normals") {
+        generateNormals_ = true;
+      } else if (argument == "--quantize") {
+        quantizeVertices_ = true;
+      } else if (argument == "--deform") {
+        deformVertices_ = true;
+      } else if (argument.compare(0, 16, "--export-digits=") == 0) {
+        exportSignificantDigits_ = parseInteger(argument, 16);
+      } else if (argument == "--bench" && i + 1 < argc) {
+        benchmarkFrameCount_ =
+            parseFrameCount("--bench=" + std::string(argv[++i]));
+      } else if (argument.compare(0, 8, "--bench=") == 0) {
+        benchmarkFrameCount_ = parseFrameCount(argument);
+      } else if (argument == "--stats") {
+        statisticsFormat_ = STATISTICS_FORMAT::REPORT;
+      } else if (argument == "--stats=json") {
+        statisticsFormat_ = STATISTICS_FORMAT::JSON;
+      } else if (argument == "--profile") {
+        showProfile_ = true;
+      } else if (argument.compare(0, 16, "--profile-trace=") == 0) {
+        profileTraceFilePath_ = argument.substr(16);
+      } else {
+        throw std::runtime_error("Unrecognized option: " + argument);
+      }
+    }
+
+    if (modelFilePaths_.empty()) {
+      throw std::runtime_error(
+          "Incorrect arguments; at least one argument (path to model "
+          "specifications) is expected");
+    }
+  }
+
+  std::string getModelFilePath() const {
+    return modelFilePaths_.front();
+  }
+
+  const std::vector<std::string>& getModelFilePaths() const {
+    return modelFilePaths_;
+  }
+
+  ModelFactory::MODEL_LOAD_MODE getModelLoadMode() const {
+    return modelLoadMode_;
+  }
+
+  bool getUseModelCache() const {
+    return useModelCache_;
+  }
+
+  // Whether to reorder the model for the GPU's vertex cache at load time
+  bool getOptimizeVertexCache() const {
+    return optimizeVertexCache_;
+  }
+
+  // Whether to build simplified levels of detail at load time; only the VBO
+  // viewer draws them
+  bool getGenerateLevelsOfDetail() const {
+    return generateLevelsOfDetail_;
+  }
+
+  // Whether to generate vertex normals at load time, for models that do not
+  // have them cached; only the VBO viewer lights the model
+  bool getGenerateNormals() const {
+    return generateNormals_;
+  }
+
+  // Whether to upload positions as 16-bit fixed point, and indices as 16
+  // bits where they fit; only the VBO viewer does
+  bool getQuantizeVertices() const {
+    return quantizeVertices_;
+  }
+
+  // Whether to animate the model's positions, rewriting them every frame;
+  // only the VBO viewer does
+  bool getDeformVertices() const {
+    return deformVertices_;
+  }
+
+  // Significant digits used when exporting the model; 0 for the shortest
+  // exact representation
+  int getExportSignificantDigits() const {
+    return exportSignificantDigits_;
+  }
+
+  // Frames to render offscreen before printing their timings and exiting; 0
+  // to run interactively
+  int getBenchmarkFrameCount() const {
+    return benchmarkFrameCount_;
+  }
+
+  // How to print where each model's load and setup time and memory went,
+  // once it is on the GPU; the scene viewer does not keep these
+  STATISTICS_FORMAT getStatisticsFormat() const {
+    return statisticsFormat_;
+  }
+
+  // Whether to time each frame's sections on the CPU and GPU: shown over
+  // the model with --profile, and written to a CSV file with
+  // --profile-trace
+  bool getProfileFrames() const {
+    return showProfile_ || !profileTraceFilePath_.empty();
+  }
+
+  bool getShowProfile() const {
+    return showProfile_;
+  }
+
+  // Empty for no trace
+  std::string getProfileTraceFilePath() const {
+    return profileTraceFilePath_;
+  }
+
+ private:
+  std::vector<std::string> modelFilePaths_;
+  ModelFactory::MODEL_LOAD_MODE modelLoadMode_;
+  bool useModelCache_;
+  bool optimizeVertexCache_;
+  bool generateLevelsOfDetail_;
+  bool generateNormals_;
+  bool quantizeVertices_;
+  bool deformVertices_;
+  int exportSignificantDigits_;
+  int benchmarkFrameCount_;
+  STATISTICS_FORMAT statisticsFormat_;
+  bool showProfile_;
+  std::string profileTraceFilePath_;
+
+  static int parseInteger(const std::string& argument, size_t valueOffset) {
+    try {
+      size_t parsedLength;
+      int value = std::stoi(argument.substr(valueOffset), &parsedLength);
+      if (parsedLength == argument.size() - valueOffset) {
+        return value;
+      }
+    } catch (const std::exception&) {
+    }
+
+    throw std::runtime_error("Invalid value in option: " + argument);
+  }
+
+  static int parseFrameCount(const std::string& argument) {
+    int frameCount = parseInteger(argument, 8);
+    if (frameCount <= 0) {
+      throw std::runtime_error("The number of frames to benchmark must be "
+                               "positive");
+    }
+
+    return frameCount;
+  }
+};
@@ -0,0 +1,338 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Eigen/Geometry>
+
+#include "Model.hpp"
+#include "ModelFactory.hpp"
+#include "ThreadPool.hpp"
+#include "TriangleBvh.hpp"
+
+// Measures the bounding volume hierarchy used for picking: how long it takes
+// to build over each model, how much memory it takes, and how many rays per
+// second it answers, both nearest-hit and occlusion queries, on one thread
+// and on all of them:
+//   bvhBench [--rays=N] [--builds=N] [--threads=N] [--check=N]
+//            <paths to model specifications>...
+// Two sets of rays are cast: a coherent grid, as from a camera looking down
+// the model's Z axis, and incoherent rays between random points around the
+// model. The first --check random rays are also tested against every
+// triangle, and the benchmark fails if the hierarchy disagrees with that
+//
+// Exits with 1 if any model failed to load or to check
+
+static const double MEGABYTE = 1 << 20;
+
+struct BenchOptions {
+  unsigned rayCount = 1 << 20;
+  unsigned buildCount = 3;
+  unsigned threadCount = std::thread::hardware_concurrency();
+  unsigned checkCount = 1000;
+  std::vector<std::string> modelFilePaths;
+};
+
+struct Ray {
+  Eigen::Vector3f origin;
+  Eigen::Vector3f direction;
+};
+
+BenchOptions parseOptions(int argc, char** argv);
+unsigned parseUnsigned(const std::string& argument, size_t valueOffset);
+bool benchmark(const std::string& modelFilePath, const BenchOptions& options,
+               ThreadPool& threadPool);
+std::vector<Ray> buildGridRays(Model& model, unsigned rayCount);
+std::vector<Ray> buildRandomRays(Model& model, unsigned rayCount);
+void castRays(const TriangleBvh& bvh, const std::vector<Ray>& rays,
+              const std::string& name, ThreadPool& threadPool);
+bool checkRays(const TriangleBvh& bvh, Model& model,
+               const std::vector<Ray>& rays, unsigned checkCount);
+float intersectBruteForce(Model& model, const Ray& ray);
+double millisecondsSince(std::chrono::steady_clock::time_point start);
+
+int main(int argc, char** argv) {
+  BenchOptions options;
+  try {
+    options = parseOptions(argc, argv);
+  } catch (const std::exception& exception) {
+    std::cerr << exception.what() << std::endl;
+    return 1;
+  }
+
+  ThreadPool threadPool(options.threadCount);
+  bool succeeded = true;
+  for (const std::string& modelFilePath : options.modelFilePaths) {
+    try {
+      succeeded &= benchmark(modelFilePath, options, threadPool);
+    } catch (const std::exception& exception) {
+      std::cerr << modelFilePath << ": " << exception.what() << std::endl;
+      succeeded = false;
+    }
+  }
+
+  return succeeded ? 0 : 1;
+}
+
+BenchOptions parseOptions(int argc, char** argv) {
+  BenchOptions options;
+  for (int i = 1; i < argc; ++i) {
+    std::string argument(argv[i]);
+
+    if (argument.compare(0, 2, "--") != 0) {
+      options.modelFilePaths.push_back(argument);
+    } else if (argument.compare(0, 7, "--rays=") == 0) {
+      options.rayCount = std::max(parseUnsigned(argument, 7), 1u);
+    } else if (argument.compare(0, 9, "--builds=") == 0) {
+      options.buildCount = std::max(parseUnsigned(argument, 9), 1u);
+    } else if (argument.compare(0, 10, "--threads=") == 0) {
+      options.threadCount = std::max(parseUnsigned(argument, 10), 1u);
+    } else if (argument.compare(0, 8, "--check=") == 0) {
+      options.checkCount = parseUnsigned(argument, 8);
+    } else {
+      throw std::runtime_error("Unrecognized option: " + argument);
+    }
+  }
+
+  if (options.modelFilePaths.empty()) {
+    throw std::runtime_error(
+        "Incorrect arguments; at least one argument (path to model "
+        "specifications) is expected");
+  }
+
+  return options;
+}
+
+unsigned parseUnsigned(const std::string& argument, size_t valueOffset) {
+  try {
+    size_t parsedLength;
+    unsigned long value =
+        std::stoul(argument.substr(valueOffset), &parsedLength);
+    if (parsedLength == argument.size() - valueOffset) {
+      return value;
+    }
+  } catch (const std::exception&) {
+  }
+
+  throw std::runtime_error("Invalid value in option: " + argument);
+}
+
+// Returns whether the hierarchy agreed with the brute-force check
+bool benchmark(const std::string& modelFilePath, const BenchOptions& options,
+               ThreadPool& threadPool) {
+  ModelFactory modelFactory(modelFilePath,
+                            ModelFactory::MODEL_LOAD_MODE::PARALLEL, true);
+  Model model = modelFactory.takeModel();
+
+  //// Build, keeping the fastest of the builds
+  std::unique_ptr<TriangleBvh> bvh;
+  double buildTime = INFINITY;
+  for (unsigned build = 0; build < options.buildCount; ++build) {
+    bvh.reset();
+    std::chrono::steady_clock::time_point buildStart =
+        std::chrono::steady_clock::now();
+    bvh.reset(new TriangleBvh(model));
+    buildTime = std::min(buildTime, millisecondsSince(buildStart));
+  }
+
+  const size_t triangleCount = bvh->getTriangleCount();
+  std::cout << modelFilePath << ": " << triangleCount << " triangles"
+            << std::endl;
+  std::cout << "  build: " << buildTime << " ms ("
+            << triangleCount / buildTime / 1e3 << " M triangles/s), "
+            << bvh->getNodeCount() << " nodes, "
+            << bvh->getMemorySize() / MEGABYTE << " MB ("
+            << double(bvh->getMemorySize()) / std::max<size_t>(triangleCount, 1)
+            << " bytes/triangle), SAH cost " << bvh->getSahCost() << std::endl;
+
+  std::vector<Ray> gridRays = buildGridRays(model, options.rayCount);
+  std::vector<Ray> randomRays = buildRandomRays(model, options.rayCount);
+  castRays(*bvh, gridRays, "grid", threadPool);
+  castRays(*bvh, randomRays, "random", threadPool);
+
+  return checkRays(*bvh, model, randomRays, options.checkCount);
+}
+
+// Parallel rays down the Z axis over the model's front, as a camera would
+// cast them
+std::vector<Ray> buildGridRays(Model& model, unsigned rayCount) {
+  std::vector<float> dimensions = model.getDimensions();
+  std::vector<float> center = model.getCenter();
+  const unsigned side = std::max(unsigned(std::sqrt(double(rayCount))), 1u);
+
+  std::vector<Ray> rays;
+  rays.reserve(side * side);
+  for (unsigned row = 0; row < side; ++row) {
+    for (unsigned column = 0; column < side; ++column) {
+      Ray ray;
+      ray.origin = Eigen::Vector3f(
+          center[0] + dimensions[0] * ((column + 0.5f) / side - 0.5f),
+          center[1] + dimensions[1] * ((row + 0.5f) / side - 0.5f),
+          center[2] + dimensions[2]);
+      ray.direction = Eigen::Vector3f(0.0f, 0.0f, -1.0f);
+      rays.push_back(ray);
+    }
+  }
+
+  return rays;
+}
+
+// From random points on the model's bounding sphere to random points in its
+// box; always the same rays for the same model
+std::vector<Ray> buildRandomRays(Model& model, unsigned rayCount) {
+  std::vector<float> dimensions = model.getDimensions();
+  Eigen::Vector3f center = Eigen::Map<Eigen::Vector3f>(
+      model.getCenter().data());
+  Eigen::Vector3f extent = Eigen::Map<Eigen::Vector3f>(dimensions.data());
+  const float radius = extent.norm() / 2;
+
+  std::mt19937 generator(1);
+  std::normal_distribution<float> normal;
+  std::uniform_real_distribution<float> uniform(-0.5f, 0.5f);
+
+  std::vector<Ray> rays(rayCount);
+  for (Ray& ray : rays) {
+    Eigen::Vector3f onSphere, target;
+    for (int axis = 0; axis < 3; ++axis) {
+      onSphere[axis] = normal(generator);
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+      target[axis] = uniform(generator);
+    }
+
+    ray.origin = center + radius * onSphere.normalized();
+    ray.direction = (center + target.cwiseProduct(extent) - ray.origin)
+                        .normalized();
+  }
+
+  return rays;
+}
+
+// Rays per second of both queries, on one thread and then on the pool
+void castRays(const TriangleBvh& bvh, const std::vector<Ray>& rays,
+              const std::string& name, ThreadPool& threadPool) {
+  static const size_t RAYS_PER_TASK = 4096;
+
+  size_t hitCount = 0;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (const Ray& ray : rays) {
+    TriangleBvh::Hit hit;
+    hitCount += bvh.intersect(ray.origin, ray.direction, hit);
+  }
+  double nearestTime = millisecondsSince(start);
+
+  size_t occludedCount = 0;
+  start = std::chrono::steady_clock::now();
+  for (const Ray& ray : rays) {
+    occludedCount += bvh.isOccluded(ray.origin, ray.direction);
+  }
+  double occlusionTime = millisecondsSince(start);
+
+  // Each task counts its hits, both so that the queries are not optimized
+  // away and as a check on the threads
+  const size_t taskCount = (rays.size() + RAYS_PER_TASK - 1) / RAYS_PER_TASK;
+  std::vector<size_t> taskHitCounts(taskCount);
+  start = std::chrono::steady_clock::now();
+  threadPool.parallelFor(taskCount, [&](size_t task) {
+    size_t end = std::min(rays.size(), (task + 1) * RAYS_PER_TASK);
+    for (size_t i = task * RAYS_PER_TASK; i < end; ++i) {
+      TriangleBvh::Hit hit;
+      taskHitCounts[task] +=
+          bvh.intersect(rays[i].origin, rays[i].direction, hit);
+    }
+  });
+  double parallelTime = millisecondsSince(start);
+
+  size_t parallelHitCount = 0;
+  for (size_t taskHitCount : taskHitCounts) {
+    parallelHitCount += taskHitCount;
+  }
+  if (occludedCount != hitCount || parallelHitCount != hitCount) {
+    std::cerr << "  " << name << ": " << hitCount << " rays hit, but "
+              << occludedCount << " were occluded and " << parallelHitCount
+              << " hit on the threads" << std::endl;
+  }
+
+  const double rayCount = rays.size();
+  std::cout << "  " << name << " rays: " << rayCount << ", "
+            << 100.0 * hitCount / rayCount << "% hit; nearest "
+            << rayCount / nearestTime / 1e3 << " Mrays/s, occlusion "
+            << rayCount / occlusionTime / 1e3 << " Mrays/s, nearest on "
+            << threadPool.getThreadCount() << " threads "
+            << rayCount / parallelTime / 1e3 << " Mrays/s" << std::endl;
+}
+
+// The hierarchy must find the same nearest distance as testing every
+// triangle; a different triangle at the same distance is fine
+bool checkRays(const TriangleBvh& bvh, Model& model,
+               const std::vector<Ray>& rays, unsigned checkCount) {
+  checkCount = std::min<size_t>(checkCount, rays.size());
+  unsigned mismatchCount = 0;
+  for (unsigned i = 0; i < checkCount; ++i) {
+    TriangleBvh::Hit hit;
+    bvh.intersect(rays[i].origin, rays[i].direction, hit);
+    float expected = intersectBruteForce(model, rays[i]);
+    if (hit.distance != expected &&
+        !(std::abs(hit.distance - expected) <= 1e-4f * expected)) {
+      ++mismatchCount;
+    }
+  }
+
+  if (checkCount > 0) {
+    std::cout << "  check: " << checkCount - mismatchCount << " of "
+              << checkCount << " rays agree with testing every triangle"
+              << std::endl;
+  }
+  return mismatchCount == 0;
+}
+
+// Moller-Trumbore over every triangle, in double precision; the nearest
+// distance, or infinity
+float intersectBruteForce(Model& model, const Ray& ray) {
+  const std::vector<float>& vertices = model.getVertices();
+  const std::vector<uint32_t>& indices = model.getIndices();
+  const Eigen::Vector3d origin = ray.origin.cast<double>();
+  const Eigen::Vector3d direction = ray.direction.cast<double>();
+
+  double nearest = INFINITY;
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    Eigen::Vector3d corners[3];
+    for (int corner = 0; corner < 3; ++corner) {
+      corners[corner] = Eigen::Map<const Eigen::Vector3f>(
+                            &vertices[3 * indices[i + corner]])
+                            .cast<double>();
+    }
+
+    Eigen::Vector3d edge1 = corners[1] - corners[0];
+    Eigen::Vector3d edge2 = corners[2] - corners[0];
+    Eigen::Vector3d p = direction.cross(edge2);
+    double determinant = edge1.dot(p);
+    if (determinant == 0.0) {
+      continue;
+    }
+
+    Eigen::Vector3d s = origin - corners[0];
+    double u = s.dot(p) / determinant;
+    Eigen::Vector3d q = s.cross(edge1);
+    double v = direction.dot(q) / determinant;
+    double distance = edge2.dot(q) / determinant;
+    if (u >= 0.0 && v >= 0.0 && u + v <= 1.0 && distance > 0.0) {
+      nearest = std::min(nearest, distance);
+    }
+  }
+
+  return nearest;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
\ No newline at end of file
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "MappedFile.hpp"
+#include "Model.hpp"
+#include "ModelCodec.hpp"
+#include "ModelFactory.hpp"
+
+// Round-trips models through the compressed format: writes each next to its
+// source as .mdlz, reads it back and checks it against the original, then
+// reports how much smaller it is and how fast it decodes, beside how fast the
+// source parses:
+//   modelCodec [--bits=N] [--runs=N] <path to model specifications>...
+
+static const double MEGABYTE = 1 << 20;
+
+struct CodecOptions {
+  unsigned positionBits = ModelCodec::DEFAULT_POSITION_BITS;
+
+  // Parses and decodes are timed this many times each; the fastest counts
+  unsigned runCount = 3;
+
+  std::vector<std::string> modelFilePaths;
+};
+
+CodecOptions parseOptions(int argc, char** argv);
+unsigned parseUnsigned(const std::string& argument, size_t valueOffset);
+bool roundTrip(const std::string& modelFilePath, const CodecOptions& options);
+double measureError(Model& original, Model& decoded);
+double millisecondsSince(std::chrono::steady_clock::time_point start);
+
+int main(int argc, char** argv) {
+  CodecOptions options = parseOptions(argc, argv);
+
+  bool succeeded = true;
+  for (const std::string& modelFilePath : options.modelFilePaths) {
+    try {
+      succeeded = roundTrip(modelFilePath, options) && succeeded;
+    } catch (const std::exception& exception) {
+      std::cerr << modelFilePath << ": " << exception.what() << std::endl;
+      succeeded = false;
+    }
+  }
+
+  return succeeded ? 0 : 1;
+}
+
+CodecOptions parseOptions(int argc, char** argv) {
+  CodecOptions options;
+  for (int i = 1; i < argc; ++i) {
+    std::string argument(argv[i]);
+
+    if (argument.compare(0, 2, "--") != 0) {
+      options.modelFilePaths.push_back(argument);
+    } else if (argument.compare(0, 7, "--bits=") == 0) {
+      options.positionBits = parseUnsigned(argument, 7);
+    } else if (argument.compare(0, 7, "--runs=") == 0) {
+      options.runCount = std::max(parseUnsigned(argument, 7), 1u);
+    } else {
+      throw std::runtime_error("Unrecognized option: " + argument);
+    }
+  }
+
+  if (options.modelFilePaths.empty()) {
+    throw std::runtime_error(
+        "Incorrect arguments; at least one argument (path to model "
+        "specifications) is expected");
+  }
+
+  return options;
+}
+
+unsigned parseUnsigned(const std::string& argument, size_t valueOffset) {
+  try {
+    size_t parsedLength;
+    unsigned long value =
+        std::stoul(argument.substr(valueOffset), &parsedLength);
+    if (parsedLength == argument.size() - valueOffset) {
+      return value;
+    }
+  } catch (const std::exception&) {
+  }
+
+  throw std::runtime_error("Invalid value in option: " + argument);
+}
+
+// Returns false if the decoded model is not the original, to within the
+// quantization error
+bool roundTrip(const std::string& modelFilePath, const CodecOptions& options) {
+  const std::string compressedFilePath =
+      ModelCodec::getCompressedFilePath(modelFilePath);
+
+  //// Parse the source, as the viewers would without a cache
+  Model original;
+  double parseTime = 0.0;
+  for (unsigned run = 0; run < options.runCount; ++run) {
+    std::chrono::steady_clock::time_point parseStart =
+        std::chrono::steady_clock::now();
+    ModelFactory modelFactory(modelFilePath,
+                              ModelFactory::MODEL_LOAD_MODE::MAPPED);
+    original = modelFactory.takeModel();
+    double runTime = millisecondsSince(parseStart);
+    parseTime = run == 0 ? runTime : std::min(parseTime, runTime);
+  }
+
+  std::chrono::steady_clock::time_point encodeStart =
+      std::chrono::steady_clock::now();
+  ModelCodec::write(original, compressedFilePath, options.positionBits);
+  double encodeTime = millisecondsSince(encodeStart);
+
+  //// Read it back, from the page cache like the source
+  Model decoded;
+  double decodeTime = 0.0;
+  for (unsigned run = 0; run < options.runCount; ++run) {
+    std::chrono::steady_clock::time_point decodeStart =
+        std::chrono::steady_clock::now();
+    decoded = ModelCodec::read(compressedFilePath);
+    double runTime = millisecondsSince(decodeStart);
+    decodeTime = run == 0 ? runTime : std::min(decodeTime, runTime);
+  }
+
+  const double sourceSize = MappedFile(modelFilePath).size() / MEGABYTE;
+  const double compressedSize =
+      MappedFile(compressedFilePath).size() / MEGABYTE;
+  const double maximumError =
+      ModelCodec::getMaximumError(original, options.positionBits);
+  const double error = measureError(original, decoded);
+
+  std::cout << modelFilePath << " -> " << compressedFilePath << std::endl
+            << "  size:   " << sourceSize << " MB, " << compressedSize
+            << " MB compressed (" << sourceSize / compressedSize << "x)"
+            << std::endl
+            << "  error:  " << error << " (at most " << maximumError
+            << " with " << options.positionBits << "-bit positions)"
+            << std::endl
+            << "  parse:  " << parseTime << " ms ("
+            << sourceSize / parseTime * 1000 << " MB/s)" << std::endl
+            << "  encode: " << encodeTime << " ms" << std::endl
+            << "  decode: " << decodeTime << " ms ("
+            << compressedSize / decodeTime * 1000 << " MB/s compressed, "
+            << sourceSize / decodeTime * 1000 << " MB/s of source)"
+            << std::endl;
+
+  if (!(error <= maximumError)) {
+    std::cout << "  FAILED: the decoded model does not match the original"
+              << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+// The furthest any decoded triangle corner is from the original's, or
+// infinity if the models differ in anything but precision. Decoded vertices
+// are renumbered and triangles may start at another corner, so triangles are
+// compared by position in their best rotation
+double measureError(Model& original, Model& decoded) {
+  const std::vector<float>& originalVertices = original.getVertices();
+  const std::vector<float>& decodedVertices = decoded.getVertices();
+  const std::vector<uint32_t>& originalIndices = original.getIndices();
+  const std::vector<uint32_t>& decodedIndices = decoded.getIndices();
+  if (originalVertices.size() != decodedVertices.size() ||
+      originalIndices.size() != decodedIndices.size() ||
+      original.hasVertexColors() != decoded.hasVertexColors()) {
+    return INFINITY;
+  }
+
+  const std::vector<float>& originalColors = original.getColors();
+  const std::vector<float>& decodedColors = decoded.getColors();
+
+  double error = 0.0;
+  for (size_t triangle = 0; triangle < originalIndices.size() / 3;
+       ++triangle) {
+    const uint32_t* originalCorners = &originalIndices[3 * triangle];
+    const uint32_t* decodedCorners = &decodedIndices[3 * triangle];
+
+    double triangleError = INFINITY;
+    for (int rotation = 0; rotation < 3; ++rotation) {
+      double rotationError = 0.0;
+      for (int corner = 0; corner < 3; ++corner) {
+        const uint32_t originalVertex =
+            originalCorners[(corner + rotation) % 3];
+        const uint32_t decodedVertex = decodedCorners[corner];
+
+        double squaredDistance = 0.0;
+        for (int axis = 0; axis < 3; ++axis) {
+          double difference =
+              double(originalVertices[3 * originalVertex + axis]) -
+              decodedVertices[3 * decodedVertex + axis];
+          squaredDistance += difference * difference;
+        }
+        rotationError = std::max(rotationError, std::sqrt(squaredDistance));
+
+        // Colors only need to survive at 8 bits
+        for (int channel = 0; channel < 3 && !originalColors.empty();
+             ++channel) {
+          if (std::fabs(originalColors[3 * originalVertex + channel] -
+                        decodedColors[3 * decodedVertex + channel]) >
+              0.51f / 255) {
+            rotationError = INFINITY;
+          }
+        }
+      }
+      triangleError = std::min(triangleError, rotationError);
+    }
+    error = std::max(error, triangleError);
+  }
+
+  return error;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
\ No newline at end of file
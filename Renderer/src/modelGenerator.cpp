@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "MappedFile.hpp"
+#include "ObjWriter.hpp"
+
+// Writes synthetic models of any size, as reproducible workloads for the
+// loaders: a closed, bumpy torus of about the given number of triangles, as
+// faces of the given number of vertices, optionally with vertex colors:
+//   modelGenerator [--triangles=N] [--arity=N] [--colors] [--digits=N]
+//                  <output path>
+// The same options always write the same file. Faces are triangulated as
+// fans by the loaders, and every face size tiles the surface with 2
+// triangles per grid cell. Numbers are written with the shortest
+// representation that reads back the same, or with --digits significant
+// digits. The model is written as it is generated, so its size is only
+// limited by the disk (and by indices being 32-bit once loaded)
+
+static const double MEGABYTE = 1 << 20;
+
+struct GeneratorOptions {
+  uint64_t triangleCount = 1000000;
+  unsigned arity = 3;
+  bool writeColors = false;
+  int significantDigits = 0;
+  std::string outputFilePath;
+};
+
+GeneratorOptions parseOptions(int argc, char** argv);
+uint64_t parseUnsigned(const std::string& argument, size_t valueOffset);
+float getBump(uint64_t row, uint64_t column);
+double millisecondsSince(std::chrono::steady_clock::time_point start);
+
+int main(int argc, char** argv) {
+  try {
+    GeneratorOptions options = parseOptions(argc, argv);
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    //// Size the grid; it wraps around both ways. Each row is tiled with
+    //// pairs of faces, each pair spanning arity - 2 cells, and the torus is
+    //// 2.5 times as long around as it is thick
+    const uint64_t pairWidth = options.arity - 2;
+    uint64_t columnCount = std::max(
+        uint64_t(std::sqrt(options.triangleCount / 5.0) * 2.5), uint64_t(3));
+    columnCount = (columnCount + pairWidth - 1) / pairWidth * pairWidth;
+    const uint64_t rowCount = std::max(
+        uint64_t(std::llround(options.triangleCount / (2.0 * columnCount))),
+        uint64_t(3));
+    const uint64_t vertexCount = rowCount * columnCount;
+    if (vertexCount > UINT32_MAX) {
+      throw std::runtime_error("Too many triangles for 32-bit indices");
+    }
+
+    ObjWriter objWriter(options.outputFilePath, options.significantDigits);
+    objWriter.writeText("o torus\n");
+
+    //// Vertices, row by row around the tube
+    const double PI = 3.14159265358979323846;
+    const double MAJOR_RADIUS = 1.0, MINOR_RADIUS = 0.4;
+    for (uint64_t row = 0; row < rowCount; ++row) {
+      double v = 2 * PI * row / rowCount;
+      for (uint64_t column = 0; column < columnCount; ++column) {
+        double u = 2 * PI * column / columnCount;
+        double radius = MINOR_RADIUS * (1.0 + 0.05 * getBump(row, column));
+        double ringRadius = MAJOR_RADIUS + radius * std::cos(v);
+
+        objWriter.writeChar('v');
+        for (double coordinate : {ringRadius * std::cos(u),
+                                  ringRadius * std::sin(u),
+                                  radius * std::sin(v)}) {
+          objWriter.writeChar(' ');
+          objWriter.writeFloat(coordinate);
+        }
+
+        if (options.writeColors) {
+          for (double component :
+               {0.5 + 0.5 * std::cos(u), 0.5 + 0.5 * std::sin(v),
+                0.5 + 0.5 * getBump(column, row)}) {
+            objWriter.writeChar(' ');
+            objWriter.writeFloat(component);
+          }
+        }
+
+        objWriter.writeChar('\n');
+      }
+    }
+
+    //// Faces between each row and the next. The first face of a pair has
+    //// bottomWidth cells along its bottom edge and topWidth along its top,
+    //// and the second the other way round, so that they tile the row
+    const uint64_t bottomWidth = (options.arity - 1) / 2;
+    const uint64_t topWidth = pairWidth - bottomWidth;
+    uint64_t faceCount = 0;
+    for (uint64_t row = 0; row < rowCount; ++row) {
+      const uint64_t bottomRow = row * columnCount;
+      const uint64_t topRow = (row + 1) % rowCount * columnCount;
+      for (uint64_t pairStart = 0; pairStart < columnCount;
+           pairStart += pairWidth) {
+        for (int face = 0; face < 2; ++face) {
+          uint64_t bottomStart = pairStart + (face == 0 ? 0 : bottomWidth);
+          uint64_t bottomEnd =
+              bottomStart + (face == 0 ? bottomWidth : topWidth);
+          uint64_t topStart = pairStart + (face == 0 ? 0 : topWidth);
+          uint64_t topEnd = topStart + (face == 0 ? topWidth : bottomWidth);
+
+          // Counterclockwise from outside: along the bottom, then back along
+          // the top; 1-indexed
+          objWriter.writeChar('f');
+          for (uint64_t column = bottomStart; column <= bottomEnd; ++column) {
+            objWriter.writeChar(' ');
+            objWriter.writeUnsigned(bottomRow + column % columnCount + 1);
+          }
+          for (uint64_t column = topEnd + 1; column-- > topStart;) {
+            objWriter.writeChar(' ');
+            objWriter.writeUnsigned(topRow + column % columnCount + 1);
+          }
+          objWriter.writeChar('\n');
+          ++faceCount;
+        }
+      }
+    }
+
+    objWriter.close();
+
+    double writeTime = millisecondsSince(start);
+    double size = MappedFile(options.outputFilePath).size() / MEGABYTE;
+    std::cout << "Wrote " << options.outputFilePath << ": " << vertexCount
+              << " vertices, " << faceCount << " faces of " << options.arity
+              << " vertices (" << faceCount * (options.arity - 2)
+              << " triangles), " << size << " MB in " << writeTime << " ms ("
+              << size / writeTime * 1000 << " MB/s)" << std::endl;
+  } catch (const std::exception& exception) {
+    std::cerr << exception.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+GeneratorOptions parseOptions(int argc, char** argv) {
+  GeneratorOptions options;
+  for (int i = 1; i < argc; ++i) {
+    std::string argument(argv[i]);
+
+    if (argument.compare(0, 2, "--") != 0) {
+      if (!options.outputFilePath.empty()) {
+        throw std::runtime_error("Only one model can be generated at a time");
+      }
+      options.outputFilePath = argument;
+    } else if (argument.compare(0, 12, "--triangles=") == 0) {
+      options.triangleCount = std::max(parseUnsigned(argument, 12),
+                                       uint64_t(1));
+    } else if (argument.compare(0, 8, "--arity=") == 0) {
+      options.arity = parseUnsigned(argument, 8);
+      if (options.arity < 3 || options.arity > 64) {
+        throw std::runtime_error("Faces must have between 3 and 64 vertices");
+      }
+    } else if (argument == "--colors") {
+      options.writeColors = true;
+    } else if (argument.compare(0, 9, "--digits=") == 0) {
+      options.significantDigits = parseUnsigned(argument, 9);
+    } else {
+      throw std::runtime_error("Unrecognized option: " + argument);
+    }
+  }
+
+  if (options.outputFilePath.empty()) {
+    throw std::runtime_error(
+        "Incorrect arguments; one argument (output path) is expected");
+  }
+
+  return options;
+}
+
+uint64_t parseUnsigned(const std::string& argument, size_t valueOffset) {
+  try {
+    size_t parsedLength;
+    unsigned long long value =
+        std::stoull(argument.substr(valueOffset), &parsedLength);
+    if (parsedLength == argument.size() - valueOffset) {
+      return value;
+    }
+  } catch (const std::exception&) {
+  }
+
+  throw std::runtime_error("Invalid value in option: " + argument);
+}
+
+// Between -1 and 1, and the same for the same grid point on every machine
+float getBump(uint64_t row, uint64_t column) {
+  uint64_t hash = row * 0x9e3779b97f4a7c15ull ^ column * 0xc2b2ae3d27d4eb4full;
+  hash ^= hash >> 31;
+  hash *= 0xbf58476d1ce4e5b9ull;
+  hash ^= hash >> 29;
+  return (hash >> 40) / float(1 << 23) - 1.0f;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Camera.hpp"
+#include "FrameBenchmark.hpp"
+#include "Model.hpp"
+#include "ModelFactory.hpp"
+#include "SoftwareRasterizer.hpp"
+#include "ThreadPool.hpp"
+#include "Transforms.hpp"
+
+// Renders a model on the CPU, for machines without a GPU, as the VBO viewer
+// shows it at start, and writes the image as a PPM (x.obj becomes x.ppm by
+// default). With --bench it renders the viewers' benchmark script instead,
+// prints its timings, and writes the last frame:
+//   modelRasterizer [--width=N] [--height=N] [--mode=wireframe|flat]
+//                   [--threads=N] [--output=path] [--cache] [--bench N]
+//                   <path to model specifications>
+// The model cache is only used with --cache, since it writes next to the model
+
+struct RasterizerOptions {
+  int width = 1920;
+  int height = 1080;
+  SoftwareRasterizer::RENDER_MODE renderMode =
+      SoftwareRasterizer::RENDER_MODE::WIREFRAME;
+  unsigned threadCount = std::thread::hardware_concurrency();
+  std::string outputFilePath;
+  bool useModelCache = false;
+  unsigned benchmarkFrameCount = 0;
+  std::string modelFilePath;
+};
+
+RasterizerOptions parseOptions(int argc, char** argv);
+unsigned parseUnsigned(const std::string& argument, size_t valueOffset);
+std::string getImageFilePath(const std::string& modelFilePath);
+void fitModel(Model& model);
+void render(SoftwareRasterizer& rasterizer, Model& model, const Camera& camera,
+            SoftwareRasterizer::RENDER_MODE renderMode);
+double millisecondsSince(std::chrono::steady_clock::time_point start);
+
+int main(int argc, char** argv) {
+  try {
+    RasterizerOptions options = parseOptions(argc, argv);
+
+    std::chrono::steady_clock::time_point loadStart =
+        std::chrono::steady_clock::now();
+    ModelFactory modelFactory(options.modelFilePath,
+                              ModelFactory::MODEL_LOAD_MODE::PARALLEL,
+                              options.useModelCache);
+    Model model = modelFactory.takeModel();
+    double loadTime = millisecondsSince(loadStart);
+    fitModel(model);
+
+    ThreadPool threadPool(options.threadCount);
+    SoftwareRasterizer rasterizer(options.width, options.height, threadPool);
+    Camera camera;
+
+    if (options.benchmarkFrameCount == 0) {
+      render(rasterizer, model, camera, options.renderMode);
+    } else {
+      FrameBenchmark frameBenchmark(options.benchmarkFrameCount);
+      frameBenchmark.setLoadTime(loadTime);
+      frameBenchmark.startScript(camera);
+      for (unsigned frame = 0; frame < frameBenchmark.getFrameCount();
+           ++frame) {
+        frameBenchmark.advance(model, camera);
+
+        frameBenchmark.beginFrame();
+        render(rasterizer, model, camera, options.renderMode);
+        frameBenchmark.endFrame();
+      }
+
+      frameBenchmark.writeReport(std::cout, "modelRasterizer",
+                                 options.modelFilePath);
+    }
+
+    rasterizer.writePpm(options.outputFilePath);
+  } catch (const std::exception& exception) {
+    std::cerr << exception.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+RasterizerOptions parseOptions(int argc, char** argv) {
+  RasterizerOptions options;
+  for (int i = 1; i < argc; ++i) {
+    std::string argument(argv[i]);
+
+    if (argument.compare(0, 2, "--") != 0) {
+      if (!options.modelFilePath.empty()) {
+        throw std::runtime_error("Only one model can be rendered at a time");
+      }
+      options.modelFilePath = argument;
+    } else if (argument.compare(0, 8, "--width=") == 0) {
+      options.width = std::max(parseUnsigned(argument, 8), 1u);
+    } else if (argument.compare(0, 9, "--height=") == 0) {
+      options.height = std::max(parseUnsigned(argument, 9), 1u);
+    } else if (argument == "--mode=wireframe") {
+      options.renderMode = SoftwareRasterizer::RENDER_MODE::WIREFRAME;
+    } else if (argument == "--mode=flat") {
+      options.renderMode = SoftwareRasterizer::RENDER_MODE::FLAT;
+    } else if (argument.compare(0, 10, "--threads=") == 0) {
+      options.threadCount = std::max(parseUnsigned(argument, 10), 1u);
+    } else if (argument.compare(0, 9, "--output=") == 0) {
+      options.outputFilePath = argument.substr(9);
+    } else if (argument == "--cache") {
+      options.useModelCache = true;
+    } else if (argument == "--bench" && i + 1 < argc) {
+      options.benchmarkFrameCount =
+          std::max(parseUnsigned("--bench=" + std::string(argv[++i]), 8), 1u);
+    } else if (argument.compare(0, 8, "--bench=") == 0) {
+      options.benchmarkFrameCount = std::max(parseUnsigned(argument, 8), 1u);
+    } else {
+      throw std::runtime_error("Unrecognized option: " + argument);
+    }
+  }
+
+  if (options.modelFilePath.empty()) {
+    throw std::runtime_error(
+        "Incorrect arguments; one argument (path to model specifications) is "
+        "expected");
+  }
+
+  if (options.outputFilePath.empty()) {
+    options.outputFilePath = getImageFilePath(options.modelFilePath);
+  }
+
+  return options;
+}
+
+unsigned parseUnsigned(const std::string& argument, size_t valueOffset) {
+  try {
+    size_t parsedLength;
+    unsigned long value =
+        std::stoul(argument.substr(valueOffset), &parsedLength);
+    if (parsedLength == argument.size() - valueOffset) {
+      return value;
+    }
+  } catch (const std::exception&) {
+  }
+
+  throw std::runtime_error("Invalid value in option: " + argument);
+}
+
+// x.obj becomes x.ppm
+std::string getImageFilePath(const std::string& modelFilePath) {
+  size_t extensionStart = modelFilePath.find_last_of('.');
+  size_t directoryEnd = modelFilePath.find_last_of('/');
+  if (extensionStart == std::string::npos ||
+      (directoryEnd != std::string::npos && extensionStart < directoryEnd)) {
+    return modelFilePath + ".ppm";
+  }
+
+  return modelFilePath.substr(0, extensionStart) + ".ppm";
+}
+
+// Places the model as the viewers do when it arrives
+void fitModel(Model& model) {
+  // Move the model into the viewing frustum
+  model.translate(std::vector<float>{0, 0, -10});
+
+  //// Scale the model to fit within screen
+  std::vector<float> modelDimensions = model.getDimensions();
+  float maxDimension = std::max(
+      std::max(modelDimensions[0], modelDimensions[1]), modelDimensions[2]);
+
+  std::vector<float> scale =
+      std::vector<float>{1 / maxDimension, 1 / maxDimension, 1 / maxDimension};
+  scale[0] *= 1.25;
+  scale[1] *= 1.25;
+  scale[2] *= 1.25;
+
+  model.scale(scale);
+}
+
+// The viewers' viewport is square; a wider or taller image shows more of the
+// scene rather than stretching it
+void render(SoftwareRasterizer& rasterizer, Model& model, const Camera& camera,
+            SoftwareRasterizer::RENDER_MODE renderMode) {
+  Eigen::Matrix4f projection = Transforms::buildProjectionMatrix(camera);
+  float aspectRatio = float(rasterizer.getWidth()) / rasterizer.getHeight();
+  if (aspectRatio > 1.0f) {
+    projection.row(0) /= aspectRatio;
+  } else {
+    projection.row(1) *= aspectRatio;
+  }
+
+  rasterizer.clear();
+  rasterizer.draw(model, Transforms::buildModelMatrix(model),
+                  Transforms::buildViewMatrix(camera), projection, renderMode);
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
\ No newline at end of file
@@ -0,0 +1,326 @@
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MappedFile.hpp"
+#include "Model.hpp"
+#include "ModelCache.hpp"
+#include "ModelCodec.hpp"
+#include "ModelFactory.hpp"
+#include "ThreadPool.hpp"
+
+// Converts models in bulk, for instance to build the viewers' caches ahead of
+// time. Each model is parsed, optionally reordered for the vertex cache and
+// given levels of detail and normals, and written next to its source, either
+// as the viewers' binary cache (.mdlbin) or compressed (.mdlz):
+//   modelTool [--format=cache|compressed] [--optimize] [--lod] [--normals]
+//             [--bits=N] [--jobs=N] <directories, globs or paths of models>...
+// Directories are searched recursively for .obj files, and globs are expanded
+// here too, so that they can be quoted past the shell's argument limit.
+// Several models are converted at once, and while they are, the files next in
+// line are read ahead into the page cache
+//
+// Prints a line for each model as it finishes, then the totals; exits with 1
+// if any model failed
+
+static const double MEGABYTE = 1 << 20;
+
+enum OUTPUT_FORMAT { CACHE, COMPRESSED };
+
+struct ToolOptions {
+  OUTPUT_FORMAT outputFormat = CACHE;
+  bool optimizeVertexCache = false;
+  bool generateLevelsOfDetail = false;
+  bool generateNormals = false;
+  unsigned positionBits = ModelCodec::DEFAULT_POSITION_BITS;
+  unsigned jobCount = std::thread::hardware_concurrency();
+  std::vector<std::string> inputs;
+};
+
+struct Conversion {
+  std::string modelFilePath;
+  std::string outputFilePath;
+  bool succeeded = false;
+  size_t vertexCount = 0;
+  size_t triangleCount = 0;
+  uint64_t inputSize = 0;
+  uint64_t outputSize = 0;
+
+  // Parsing and post-processing, then writing; in milliseconds
+  double loadTime = 0.0;
+  double writeTime = 0.0;
+
+  // What post-processing reported, or why the conversion failed
+  std::string log;
+};
+
+ToolOptions parseOptions(int argc, char** argv);
+unsigned parseUnsigned(const std::string& argument, size_t valueOffset);
+std::vector<std::string> findModelFiles(const std::vector<std::string>& inputs);
+void readAhead(const std::string& filePath);
+void convert(Conversion& conversion, const ToolOptions& options);
+void printConversion(const Conversion& conversion);
+double millisecondsSince(std::chrono::steady_clock::time_point start);
+
+int main(int argc, char** argv) {
+  ToolOptions options;
+  std::vector<std::string> modelFilePaths;
+  try {
+    options = parseOptions(argc, argv);
+    modelFilePaths = findModelFiles(options.inputs);
+  } catch (const std::exception& exception) {
+    std::cerr << exception.what() << std::endl;
+    return 1;
+  }
+
+  std::vector<Conversion> conversions(modelFilePaths.size());
+  for (size_t i = 0; i < conversions.size(); ++i) {
+    conversions[i].modelFilePath = modelFilePaths[i];
+  }
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  {
+    ThreadPool threadPool(options.jobCount);
+    const unsigned jobCount = threadPool.getThreadCount();
+    std::mutex outputMutex;
+
+    // Tasks start in order, so the model jobCount on from this one starts
+    // about when this one finishes
+    threadPool.parallelFor(conversions.size(), [&](size_t i) {
+      if (i + jobCount < conversions.size()) {
+        readAhead(conversions[i + jobCount].modelFilePath);
+      }
+
+      convert(conversions[i], options);
+
+      std::lock_guard<std::mutex> lock(outputMutex);
+      printConversion(conversions[i]);
+    });
+  }
+  double totalTime = millisecondsSince(start);
+
+  size_t failedCount = 0;
+  uint64_t inputSize = 0, outputSize = 0;
+  size_t triangleCount = 0;
+  double busyTime = 0.0;
+  for (const Conversion& conversion : conversions) {
+    if (!conversion.succeeded) {
+      ++failedCount;
+      continue;
+    }
+
+    inputSize += conversion.inputSize;
+    outputSize += conversion.outputSize;
+    triangleCount += conversion.triangleCount;
+    busyTime += conversion.loadTime + conversion.writeTime;
+  }
+
+  const double seconds = totalTime / 1000;
+  std::cout << "Converted " << conversions.size() - failedCount << " of "
+            << conversions.size() << " models in " << seconds << " s with "
+            << options.jobCount << " jobs: " << inputSize / MEGABYTE
+            << " MB -> " << outputSize / MEGABYTE << " MB, "
+            << (conversions.size() - failedCount) / seconds << " models/s, "
+            << inputSize / MEGABYTE / seconds << " MB/s, "
+            << triangleCount / seconds / 1e6 << " M triangles/s ("
+            << (totalTime > 0.0 ? busyTime / totalTime : 0.0)
+            << " models at a time on average)" << std::endl;
+
+  return failedCount == 0 ? 0 : 1;
+}
+
+ToolOptions parseOptions(int argc, char** argv) {
+  ToolOptions options;
+  for (int i = 1; i < argc; ++i) {
+    std::string argument(argv[i]);
+
+    if (argument.compare(0, 2, "--") != 0) {
+      options.inputs.push_back(argument);
+    } else if (argument == "--format=cache") {
+      options.outputFormat = CACHE;
+    } else if (argument == "--format=compressed") {
+      options.outputFormat = COMPRESSED;
+    } else if (argument == "--optimize") {
+      options.optimizeVertexCache = true;
+    } else if (argument == "--lod") {
+      options.generateLevelsOfDetail = true;
+    } else if (argument == "--normals") {
+      options.generateNormals = true;
+    } else if (argument.compare(0, 7, "--bits=") == 0) {
+      options.positionBits = parseUnsigned(argument, 7);
+    } else if (argument.compare(0, 7, "--jobs=") == 0) {
+      options.jobCount = std::max(parseUnsigned(argument, 7), 1u);
+    } else {
+      throw std::runtime_error("Unrecognized option: " + argument);
+    }
+  }
+
+  if (options.inputs.empty()) {
+    throw std::runtime_error(
+        "Incorrect arguments; at least one argument (directory, glob or path "
+        "of models) is expected");
+  }
+
+  if (options.outputFormat == COMPRESSED && options.generateLevelsOfDetail) {
+    throw std::runtime_error(
+        "Compressed models do not keep levels of detail; use --format=cache "
+        "with --lod");
+  }
+
+  if (options.outputFormat == COMPRESSED && options.generateNormals) {
+    throw std::runtime_error(
+        "Compressed models do not keep normals; use --format=cache with "
+        "--normals");
+  }
+
+  options.jobCount = std::max(options.jobCount, 1u);
+  return options;
+}
+
+unsigned parseUnsigned(const std::string& argument, size_t valueOffset) {
+  try {
+    size_t parsedLength;
+    unsigned long value =
+        std::stoul(argument.substr(valueOffset), &parsedLength);
+    if (parsedLength == argument.size() - valueOffset) {
+      return value;
+    }
+  } catch (const std::exception&) {
+  }
+
+  throw std::runtime_error("Invalid value in option: " + argument);
+}
+
+// Each model once, in order
+std::vector<std::string> findModelFiles(
+    const std::vector<std::string>& inputs) {
+  std::vector<std::string> modelFilePaths;
+  for (const std::string& input : inputs) {
+    if (std::filesystem::is_directory(input)) {
+      for (const std::filesystem::directory_entry& entry :
+           std::filesystem::recursive_directory_iterator(input)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".obj") {
+          modelFilePaths.push_back(entry.path().string());
+        }
+      }
+      continue;
+    }
+
+    // A path that names no file is reported when it fails to convert
+    glob_t matches;
+    if (glob(input.c_str(), 0, NULL, &matches) == 0) {
+      modelFilePaths.insert(modelFilePaths.end(), matches.gl_pathv,
+                            matches.gl_pathv + matches.gl_pathc);
+    } else {
+      modelFilePaths.push_back(input);
+    }
+    globfree(&matches);
+  }
+
+  std::sort(modelFilePaths.begin(), modelFilePaths.end());
+  modelFilePaths.erase(
+      std::unique(modelFilePaths.begin(), modelFilePaths.end()),
+      modelFilePaths.end());
+  if (modelFilePaths.empty()) {
+    throw std::runtime_error("No models were found");
+  }
+
+  return modelFilePaths;
+}
+
+// Has the kernel start reading the file into the page cache, and returns
+// without waiting for it
+void readAhead(const std::string& filePath) {
+  int fileDescriptor = open(filePath.c_str(), O_RDONLY);
+  if (fileDescriptor < 0) {
+    return;
+  }
+
+  posix_fadvise(fileDescriptor, 0, 0, POSIX_FADV_WILLNEED);
+  close(fileDescriptor);
+}
+
+// Records, rather than throws, any failure, so that the other models carry
+// on
+void convert(Conversion& conversion, const ToolOptions& options) {
+  const std::string& modelFilePath = conversion.modelFilePath;
+  try {
+    //// Each model is parsed on one thread, as the jobs already keep every
+    //// core busy
+    std::ostringstream logStream;
+    std::chrono::steady_clock::time_point loadStart =
+        std::chrono::steady_clock::now();
+    ModelFactory modelFactory(modelFilePath,
+                              ModelFactory::MODEL_LOAD_MODE::MAPPED, false,
+                              options.optimizeVertexCache,
+                              options.generateLevelsOfDetail,
+                              options.generateNormals, logStream);
+    Model model = modelFactory.takeModel();
+    conversion.loadTime = millisecondsSince(loadStart);
+    conversion.log = logStream.str();
+    conversion.vertexCount = model.getVertices().size() / 3;
+    conversion.triangleCount = model.getTriangleCount();
+
+    std::chrono::steady_clock::time_point writeStart =
+        std::chrono::steady_clock::now();
+    if (options.outputFormat == CACHE) {
+      ModelCache modelCache(modelFilePath);
+      modelCache.store(model);
+      conversion.outputFilePath = modelCache.getCacheFilePath();
+    } else {
+      conversion.outputFilePath =
+          ModelCodec::getCompressedFilePath(modelFilePath);
+      ModelCodec::write(model, conversion.outputFilePath,
+                        options.positionBits);
+    }
+    conversion.writeTime = millisecondsSince(writeStart);
+
+    conversion.inputSize = MappedFile(modelFilePath).size();
+    conversion.outputSize = MappedFile(conversion.outputFilePath).size();
+    conversion.succeeded = true;
+  } catch (const std::exception& exception) {
+    conversion.log = exception.what();
+    conversion.log += '\n';
+  }
+}
+
+void printConversion(const Conversion& conversion) {
+  if (!conversion.succeeded) {
+    std::cout << conversion.modelFilePath << ": FAILED: " << conversion.log;
+    return;
+  }
+
+  std::cout << conversion.modelFilePath << " -> " << conversion.outputFilePath
+            << ": " << conversion.vertexCount << " vertices, "
+            << conversion.triangleCount << " triangles, "
+            << conversion.inputSize / MEGABYTE << " MB -> "
+            << conversion.outputSize / MEGABYTE << " MB; load "
+            << conversion.loadTime << " ms, write " << conversion.writeTime
+            << " ms" << std::endl;
+
+  // Post-processing reports, indented under their model
+  std::istringstream logStream(conversion.log);
+  std::string line;
+  while (std::getline(logStream, line)) {
+    std::cout << "  " << line << std::endl;
+  }
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
\ No newline at end of file
@@ -2,49 +2,85 @@
 #include <GL/freeglut.h>
 
 #include <algorithm>
+#include <chrono>
 #include <exception>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <sstream>
+#include <string>
 #include <vector>
 
+#include "FrameBenchmark.hpp"
+#include "FrameProfiler.hpp"
+#include "HeadlessContext.hpp"
+#include "LoadStatistics.hpp"
 #include "Model.hpp"
+#include "ModelExporter.hpp"
 #include "ModelFactory.hpp"
+#include "ModelLoader.hpp"
 #include "Camera.hpp"
+#include "ViewerControls.hpp"
+#include "ViewerOptions.hpp"
 
-// todo: move this somewhere else?
-static const float PI = 3.14159265;
-float degreesToRadians(float degrees) {
-  return degrees * (PI / 180);
-}
-float radiansToDegrees(float radians) {
-  return radians * (180 / PI);
-}
-
+ViewerOptions viewerOptions;
 Camera camera;
 Model model;
+ModelExporter modelExporter;
+ModelLoader modelLoader;
 
 // Display list identifier
 static unsigned int aModel;
 
+// Nothing is drawn until the first model arrives from the loader
+static bool hasModel = false;
+
+// Which of the given models is shown, or on its way
+static size_t modelFileIndex = 0;
+
+// With --profile or --profile-trace, or once 'g' is pressed; the overlay
+// keeps frames coming, so that its times stay current
+enum PROFILED_SECTION { CLEAR_SECTION, DRAW_SECTION, SWAP_SECTION };
+static std::unique_ptr<FrameProfiler> frameProfiler;
+static bool showProfile = false;
+
+// The shown model's, from the loader on, printed with --stats once its
+// display list is compiled. The GL setup is done once, before the first
+// model, and is added to every model's
+static LoadStatistics loadStatistics;
+static std::string loadedModelFilePath;
+static double glSetupTime = 0.0;
+
 void drawScene(void);
+void renderScene(void);
 void resize(int, int);
 void keyInput(unsigned char, int, int);
 void specialKeyInput(int key, int x, int y);
 void setup(void);
-
-void positionCamera(void);
+void setupModel(void);
+
+void runBenchmark(void);
+double millisecondsSince(std::chrono::steady_clock::time_point start);
+bool loadModel(const std::string& modelFilePath);
+void takeLoadedModel(ModelLoader::LoadedModel& loadedModel);
+void writeLoadStatistics(void);
+void redisplay(int);
+void startProfiling(void);
+void beginProfiledSection(PROFILED_SECTION section);
+void endProfiledSection(void);
+void drawProfileOverlay(void);
 
 int main(int argc, char** argv) {
-  if (argc != 2) {
-    throw std::runtime_error(
-        "Incorrect arguments; one argument (path to model specifications) is "
-        "expected");
-  }
+  viewerOptions = ViewerOptions(argc, argv);
 
-  ModelFactory modelFactory(argv[1]);
-  model = modelFactory.getModel();
+  // Parsed in the background while the window comes up
+  loadModel(viewerOptions.getModelFilePath());
+
+  if (viewerOptions.getBenchmarkFrameCount() > 0) {
+    runBenchmark();
+    return 0;
+  }
 
   glutInit(&argc, argv);
   glutInitContextVersion(3, 0);
@@ -54,7 +90,7 @@ int main(int argc, char** argv) {
   glutInitWindowSize(500, 500);
   glutInitWindowPosition(100, 100);
 
-  glutCreateWindow(model.getName().c_str());
+  glutCreateWindow(viewerOptions.getModelFilePath().c_str());
 
   glutDisplayFunc(drawScene);
   glutReshapeFunc(resize);
@@ -72,18 +108,44 @@ int main(int argc, char** argv) {
 }
 
 void setup(void) {
+  std::chrono::steady_clock::time_point setupStart =
+      std::chrono::steady_clock::now();
+
   glClearColor(0.0, 0.0, 0.0, 0.0);
 
   glEnableClientState(GL_VERTEX_ARRAY);
-  glEnableClientState(GL_COLOR_ARRAY);
+
+  glEnable(GL_DEPTH_TEST);
+
+  aModel = glGenLists(1);
+
+  if (viewerOptions.getProfileFrames()) {
+    startProfiling();
+    showProfile = viewerOptions.getShowProfile();
+  }
+
+  glSetupTime = millisecondsSince(setupStart);
+}
+
+// Compiles a newly arrived model into the display list, in place of the
+// previous one
+void setupModel(void) {
+  loadStatistics.addTime("GL setup", glSetupTime);
+  LoadStatistics::ScopedTimer timer(loadStatistics, "model setup");
 
   std::vector<float>& vertices = model.getVertices();
   std::vector<float>& colors = model.getColors();
 
   glVertexPointer(3, GL_FLOAT, 0, (float*)&vertices[0]);
-  glColorPointer(3, GL_FLOAT, 0, (float*)&colors[0]);
 
-  glEnable(GL_DEPTH_TEST);
+  // Models without per-vertex colors are drawn in their uniform color
+  if (model.hasVertexColors()) {
+    glEnableClientState(GL_COLOR_ARRAY);
+    glColorPointer(3, GL_FLOAT, 0, (float*)&colors[0]);
+  } else {
+    glDisableClientState(GL_COLOR_ARRAY);
+    glColor3fv(&model.getUniformColor()[0]);
+  }
 
   // Move the model into the viewing frustum
   model.translate(std::vector<float>{0, 0, -10});
@@ -101,23 +163,69 @@ void setup(void) {
 
   model.scale(scale);
 
-  aModel = glGenLists(1);
-
   glNewList(aModel, GL_COMPILE);
 
-  std::vector<std::vector<unsigned>>& polygons = model.getPolygons();
-  for (std::vector<unsigned>& polygon : polygons) {
-    glDrawElements(GL_TRIANGLE_STRIP, 3, GL_UNSIGNED_INT,
-                   (unsigned*)&polygon[0]);
-  }
+  std::vector<uint32_t>& indices = model.getIndices();
+  glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, &indices[0]);
 
   glEndList();
+
+  hasModel = true;
 }
 
 void drawScene(void) {
-  positionCamera();
+  if (frameProfiler) {
+    frameProfiler->beginFrame();
+  }
+
+  // Checked before the mailbox, since a load that has finished has already
+  // left its model there
+  bool loading = modelLoader.isLoading();
+
+  std::unique_ptr<ModelLoader::LoadedModel> loadedModel =
+      modelLoader.takeLoadedModel();
+  if (loadedModel) {
+    takeLoadedModel(*loadedModel);
+    setupModel();
+    writeLoadStatistics();
+    glutSetWindowTitle(model.getName().c_str());
+  }
+
+  renderScene();
+  drawProfileOverlay();
+
+  beginProfiledSection(SWAP_SECTION);
+  glutSwapBuffers();
+  endProfiledSection();
+
+  if (frameProfiler) {
+    frameProfiler->endFrame();
+  }
+
+  // Check on a load in progress now and then, rather than every frame
+  if (showProfile) {
+    glutPostRedisplay();
+  } else if (loading) {
+    glutTimerFunc(10, redisplay, 0);
+  }
+}
+
+void redisplay(int) {
+  glutPostRedisplay();
+}
 
+void renderScene(void) {
+  ViewerControls::positionCamera(camera);
+
+  beginProfiledSection(CLEAR_SECTION);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  endProfiledSection();
+
+  if (!hasModel) {
+    return;
+  }
+
+  beginProfiledSection(DRAW_SECTION);
 
   float fogColor[4] = {0.0, 0.0, 0.0, 0.0};
 
@@ -133,307 +241,198 @@ void drawScene(void) {
 
   glPushMatrix();
 
-  // Translate model to position
-  std::vector<float> displacement = model.getDisplacement();
-  glTranslatef(displacement[0], displacement[1], displacement[2]);
-
-  //// Extract angle and axis of rotation from quaternion, rotate model
-  Eigen::Quaternion<float> modelOrientation = model.getOrientation();
-
-  float angle = 0.0f, axisX = 0.0f, axisY = 0.0f, axisZ = 0.0f;
-  angle = 2 * acos(modelOrientation.w());
-  axisX = modelOrientation.x() / sin(angle / 2);
-  axisY = modelOrientation.y() / sin(angle / 2);
-  axisZ = modelOrientation.z() / sin(angle / 2);
-
-  glRotatef(radiansToDegrees(angle), axisX, axisY, axisZ);
-
-  // Scale model
-  std::vector<float> modelScale = model.getScale();
-  glScalef(modelScale[0], modelScale[1], modelScale[2]);
-
-  // Translate model to origin
-  auto modelCenter = model.getCenter();
-  glTranslatef(-modelCenter[0], -modelCenter[1], -modelCenter[2]);
+  ViewerControls::place(model);
 
   glCallList(aModel);
 
   glPopMatrix();
 
-  glutSwapBuffers();
-}
-
-void resize(int w, int h) {
-  glViewport(0, 0, w, h);
-  positionCamera();
+  endProfiledSection();
 }
 
-void positionCamera(void) {
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
+// Renders the benchmark script offscreen, instead of opening a window, and
+// prints its timings
+void runBenchmark(void) {
+  FrameBenchmark frameBenchmark(viewerOptions.getBenchmarkFrameCount());
 
-  Camera::CAMERA_PROJECTION_MODE cameraProjectionMode =
-      camera.getCameraProjectionMode();
-  switch (cameraProjectionMode) {
-    case Camera::CAMERA_PROJECTION_MODE::ORTHOGRAPHIC:
-      glOrtho(-1.0, 1.0, -1.0, 1.0, 8.0, 100.0);
-      break;
-    case Camera::CAMERA_PROJECTION_MODE::PERSPECTIVE:
-      glFrustum(-1.0, 1.0, -1.0, 1.0, 8.0, 100.0);
-      break;
-    default:
-      throw std::runtime_error("Unrecognized camera projection mode");
+  modelLoader.wait();
+  std::unique_ptr<ModelLoader::LoadedModel> loadedModel =
+      modelLoader.takeLoadedModel();
+  if (!loadedModel) {
+    throw std::runtime_error("There is no model to benchmark");
   }
+  takeLoadedModel(*loadedModel);
+  frameBenchmark.setLoadTime(loadedModel->loadTime);
 
-  std::vector<float> cameraDisplacement = camera.getDisplacement();
-  glTranslatef(cameraDisplacement[0], cameraDisplacement[1],
-               cameraDisplacement[2]);
-
-  //// Extract angle and axis of rotation from quaternion, rotate camera
-  Eigen::Quaternion<float> cameraOrientation = camera.getOrientation();
-
-  float angle = 0.0f, axisX = 0.0f, axisY = 0.0f, axisZ = 0.0f;
-  angle = 2 * acos(cameraOrientation.w());
-  axisX = cameraOrientation.x() / sin(angle / 2);
-  axisY = cameraOrientation.y() / sin(angle / 2);
-  axisZ = cameraOrientation.z() / sin(angle / 2);
-
-  // note: angle needs to be in degrees
-  glRotatef(radiansToDegrees(angle), axisX, axisY, axisZ);
-
-  glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
-}
-
-void keyInput(unsigned char key, int x, int y) {
-  switch (key) {
-    case 'q':
-      exit(0);
-      break;
-    // TODO: MAKE SURE THAT YOU UPDATE THIS; RESET EVERYTHING
-    case 'x': {
-      Eigen::Quaternion<float> modelOrientation = model.getOrientation();
-      model.rotate(modelOrientation.inverse());
-
-      std::vector<float> modelPosition = model.getDisplacement();
-      model.translate(std::vector<float>{-modelPosition[0], -modelPosition[1],
-                                         -modelPosition[2] - 10.0f});
-
-      Eigen::Quaternion<float> cameraOrientation = camera.getOrientation();
-      camera.rotate(cameraOrientation.inverse());
-
-      std::vector<float> cameraPosition = camera.getDisplacement();
-      camera.translate(std::vector<float>{
-          -cameraPosition[0], -cameraPosition[1], -cameraPosition[2]});
-
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'w':
-      model.writeToFile("out.obj");
-      break;
-    case 'v': {
-      camera.setCameraProjectionMode(
-          Camera::CAMERA_PROJECTION_MODE::ORTHOGRAPHIC);
-
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'V': {
-      camera.setCameraProjectionMode(
-          Camera::CAMERA_PROJECTION_MODE::PERSPECTIVE);
-
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'n': {
-      model.translate(std::vector<float>{0.0, 0.0, -0.1});
-
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'N': {
-      model.translate(std::vector<float>{0.0, 0.0, 0.1});
-
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'p': {
-      float rotationAngle = degreesToRadians(-10);
-
-      Eigen::Quaternion<float> rotationDelta(
-          cos(rotationAngle / 2), sin(rotationAngle / 2), 0.0f, 0.0f);
-
-      model.rotate(rotationDelta);
-
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'P': {
-      float rotationAngle = degreesToRadians(10);
+  HeadlessContext headlessContext(500, 500);
 
-      Eigen::Quaternion<float> rotationDelta(
-          cos(rotationAngle / 2), sin(rotationAngle / 2), 0.0f, 0.0f);
-
-      model.rotate(rotationDelta);
-
-      glutPostRedisplay();  // re-draw scene
-      break;
+  std::chrono::steady_clock::time_point setupStart =
+      std::chrono::steady_clock::now();
+  setup();
+  setupModel();
+  glFinish();
+  frameBenchmark.setSetupTime(millisecondsSince(setupStart));
+  writeLoadStatistics();
+
+  frameBenchmark.startScript(camera);
+  resize(500, 500);
+  for (unsigned frame = 0; frame < frameBenchmark.getFrameCount(); ++frame) {
+    frameBenchmark.advance(model, camera);
+
+    frameBenchmark.beginFrame();
+    if (frameProfiler) {
+      frameProfiler->beginFrame();
     }
-    case 'y': {
-      float rotationAngle = degreesToRadians(-10);
-
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f,
-                                             sin(rotationAngle / 2), 0.0f);
-
-      model.rotate(rotationDelta);
-
-      glutPostRedisplay();  // re-draw scene
-      break;
+    renderScene();
+    glFinish();
+    frameBenchmark.endFrame();
+    if (frameProfiler) {
+      frameProfiler->endFrame();
     }
-    case 'Y': {
-      float rotationAngle = degreesToRadians(10);
-
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f,
-                                             sin(rotationAngle / 2), 0.0f);
+  }
 
-      model.rotate(rotationDelta);
+  frameBenchmark.writeReport(std::cout, "modelViewer",
+                             viewerOptions.getModelFilePath());
 
-      glutPostRedisplay();  // re-draw scene
-      break;
+  // Before the context goes
+  if (frameProfiler) {
+    for (const std::string& line : frameProfiler->getSummary()) {
+      std::cout << line << std::endl;
     }
-    case 'r': {
-      float rotationAngle = degreesToRadians(-10);
-
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f, 0.0f,
-                                             sin(rotationAngle / 2));
+    frameProfiler.reset();
+  }
+}
 
-      model.rotate(rotationDelta);
+// Makes the loaded model the one shown, with its statistics so far
+void takeLoadedModel(ModelLoader::LoadedModel& loadedModel) {
+  model = std::move(loadedModel.model);
+  loadStatistics = loadedModel.loadStatistics;
+  loadedModelFilePath = loadedModel.filePath;
+}
 
-      glutPostRedisplay();  // re-draw scene
+void writeLoadStatistics(void) {
+  switch (viewerOptions.getStatisticsFormat()) {
+    case ViewerOptions::STATISTICS_FORMAT::REPORT:
+      loadStatistics.writeReport(std::cout, loadedModelFilePath);
       break;
-    }
-    case 'R': {
-      float rotationAngle = degreesToRadians(10);
-
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f, 0.0f,
-                                             sin(rotationAngle / 2));
-
-      model.rotate(rotationDelta);
-
-      glutPostRedisplay();  // re-draw scene
+    case ViewerOptions::STATISTICS_FORMAT::JSON:
+      loadStatistics.writeJson(std::cout, loadedModelFilePath);
       break;
-    }
-    case 'd': {
-      camera.translate(std::vector<float>{-0.1f, 0.0f, 0.0f});
-
-      glutPostRedisplay();  // re-draw scene
+    default:
       break;
-    }
-    case 'D': {
-      camera.translate(std::vector<float>{0.1f, 0.0f, 0.0f});
+  }
+}
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'c': {
-      camera.translate(std::vector<float>{0.0f, -0.1f, 0.0f});
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'C': {
-      camera.translate(std::vector<float>{0.0f, 0.1f, 0.0f});
+// Starts loading a model in the background, with the viewer's options;
+// returns false if the previous load has not finished yet
+bool loadModel(const std::string& modelFilePath) {
+  return modelLoader.load(modelFilePath, viewerOptions.getModelLoadMode(),
+                          viewerOptions.getUseModelCache(),
+                          viewerOptions.getOptimizeVertexCache());
+}
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'z': {
-      camera.translate(std::vector<float>{0.0f, 0.0f, -0.1f});
+void startProfiling(void) {
+  frameProfiler.reset(new FrameProfiler(
+      {"clear", "draw", "swap"}, viewerOptions.getProfileTraceFilePath()));
+  if (!frameProfiler->hasGpuTimer()) {
+    std::cout << "No timer queries in this GL; profiling the CPU only"
+              << std::endl;
+  }
+}
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'Z': {
-      camera.translate(std::vector<float>{0.0f, 0.0f, 0.1f});
+void beginProfiledSection(PROFILED_SECTION section) {
+  if (frameProfiler) {
+    frameProfiler->beginSection(section);
+  }
+}
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 't': {
-      float rotationAngle = degreesToRadians(-1);
+void endProfiledSection(void) {
+  if (frameProfiler) {
+    frameProfiler->endSection();
+  }
+}
 
-      Eigen::Quaternion<float> rotationDelta(
-          cos(rotationAngle / 2), sin(rotationAngle / 2), 0.0f, 0.0f);
-      camera.rotate(rotationDelta);
+// In the top left corner, over everything
+void drawProfileOverlay(void) {
+  if (!showProfile) {
+    return;
+  }
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'T': {
-      float rotationAngle = degreesToRadians(1);
+  glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_FOG);
+
+  // The raster position takes the current color
+  glColor3f(1.0, 1.0, 0.0);
+  int lineY = glutGet(GLUT_WINDOW_HEIGHT);
+  for (const std::string& line : frameProfiler->getSummary()) {
+    lineY -= 15;
+    glWindowPos2i(5, lineY);
+    glutBitmapString(GLUT_BITMAP_8_BY_13,
+                     reinterpret_cast<const unsigned char*>(line.c_str()));
+  }
 
-      Eigen::Quaternion<float> rotationDelta(
-          cos(rotationAngle / 2), sin(rotationAngle / 2), 0.0f, 0.0f);
-      camera.rotate(rotationDelta);
+  glPopAttrib();
+}
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'a': {
-      float rotationAngle = degreesToRadians(-1);
+void resize(int w, int h) {
+  glViewport(0, 0, w, h);
+  ViewerControls::positionCamera(camera);
+}
 
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f,
-                                             sin(rotationAngle / 2), 0.0f);
-      camera.rotate(rotationDelta);
+void keyInput(unsigned char key, int x, int y) {
+  if (ViewerControls::handleKey(key, model, camera)) {
+    glutPostRedisplay();  // re-draw scene
+    return;
+  }
 
-      glutPostRedisplay();  // re-draw scene
+  switch (key) {
+    case 'q':
+      exit(0);
       break;
-    }
-    case 'A': {
-      float rotationAngle = degreesToRadians(1);
-
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f,
-                                             sin(rotationAngle / 2), 0.0f);
-      camera.rotate(rotationDelta);
-
-      glutPostRedisplay();  // re-draw scene
+    case 'w':
+      // Exported in the background; the scene keeps rendering meanwhile
+      if (!modelExporter.exportModel(
+              model, "out.obj", viewerOptions.getExportSignificantDigits())) {
+        std::cout << "The previous export has not finished yet" << std::endl;
+      }
       break;
-    }
-    case 'l': {
-      float rotationAngle = degreesToRadians(-10);
-
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f, 0.0f,
-                                             sin(rotationAngle / 2));
-      camera.rotate(rotationDelta);
+    case 'o': {
+      // Loads the next of the given models, or reloads the only one; the
+      // current model stays on screen until the new one arrives
+      const std::vector<std::string>& modelFilePaths =
+          viewerOptions.getModelFilePaths();
+      size_t nextModelFileIndex = (modelFileIndex + 1) % modelFilePaths.size();
+      if (!loadModel(modelFilePaths[nextModelFileIndex])) {
+        std::cout << "The previous load has not finished yet" << std::endl;
+        break;
+      }
+      modelFileIndex = nextModelFileIndex;
 
       glutPostRedisplay();  // re-draw scene
       break;
     }
-    case 'L': {
-      float rotationAngle = degreesToRadians(10);
-
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f, 0.0f,
-                                             sin(rotationAngle / 2));
-      camera.rotate(rotationDelta);
+    case 'g':
+      if (!frameProfiler) {
+        startProfiling();
+      }
+      showProfile = !showProfile;
 
       glutPostRedisplay();  // re-draw scene
       break;
-    }
     default:
       break;
   }
 }
 
 void specialKeyInput(int key, int x, int y) {
-  if (key == GLUT_KEY_UP)
-    model.translate(std::vector<float>{0.0, 0.1, 0.0});
-  if (key == GLUT_KEY_DOWN)
-    model.translate(std::vector<float>{0.0, -0.1, 0.0});
-  if (key == GLUT_KEY_LEFT)
-    model.translate(std::vector<float>{-0.1, 0.0, 0.0});
-  if (key == GLUT_KEY_RIGHT)
-    model.translate(std::vector<float>{0.1, 0.0, 0.0});
+  ViewerControls::handleSpecialKey(key, model);
 
   glutPostRedisplay();  // re-draw scene
 }
\ No newline at end of file
@@ -2,71 +2,283 @@
 #include <GL/freeglut.h>
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <exception>
 #include <fstream>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <sstream>
+#include <string>
 #include <vector>
 
+#include "DynamicVertexBuffer.hpp"
+#include "FrameBenchmark.hpp"
+#include "FrameProfiler.hpp"
+#include "HeadlessContext.hpp"
+#include "LoadStatistics.hpp"
+#include "MeshletBuilder.hpp"
+#include "MeshletCuller.hpp"
 #include "Model.hpp"
+#include "ModelExporter.hpp"
 #include "ModelFactory.hpp"
+#include "ModelLoader.hpp"
 #include "Camera.hpp"
+#include "ShaderProgram.hpp"
+#include "TransformBlock.hpp"
+#include "TriangleBvh.hpp"
+#include "VertexQuantizer.hpp"
+#include "ViewerControls.hpp"
+#include "ViewerOptions.hpp"
 
 #define VERTICES 0
 #define INDICES 1
+#define MESHLET_INDICES 2
+
+// Vertex attribute locations
+#define POSITION_ATTRIBUTE 0
+#define COLOR_ATTRIBUTE 1
+#define NORMAL_ATTRIBUTE 2
+
+// Core profile: the matrices come from the Transforms uniform block, built
+// on the CPU, and the fog the fixed function viewers get from GL_FOG is done
+// here. The fog distance leaves out the camera, which the other viewers keep
+// in the projection matrix, so that all of them fog the same. Models with
+// normals (--normals) are lit from the camera, on both sides, as their
+// triangles may face either way
+static const char* VERTEX_SHADER_SOURCE = R"(
+#version 330 core
+
+layout(std140) uniform Transforms {
+  mat4 model;
+  mat4 view;
+  mat4 projection;
+  mat4 modelViewProjection;
+};
+
+// Positions are either floats, decoded with an offset of 0 and a scale of
+// 1, or normalized 16-bit steps across the model's bounds
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+const float AMBIENT = 0.3;
+
+in vec3 position;
+in vec3 color;
+
+// Zero for models without normals, which are left unlit
+in vec3 normal;
+
+out vec3 vertexColor;
+out float eyeDepth;
+
+void main() {
+  vec4 modelPosition = vec4(positionOffset + positionScale * position, 1.0);
+  gl_Position = modelViewProjection * modelPosition;
+  eyeDepth = -(model * modelPosition).z;
+
+  float lighting = 1.0;
+  if (dot(normal, normal) > 0.0) {
+    vec3 eyeNormal = normalize(mat3(view * model) * normal);
+    lighting = AMBIENT + (1.0 - AMBIENT) * abs(eyeNormal.z);
+  }
+  vertexColor = color * lighting;
+}
+)";
+
+static const char* FRAGMENT_SHADER_SOURCE = R"(
+#version 330 core
+
+const float FOG_START = 10.0;
+const float FOG_END = 11.0;
+
+in vec3 vertexColor;
+in float eyeDepth;
+
+out vec4 fragmentColor;
+
+void main() {
+  // Linear fog towards black
+  float fog = clamp((FOG_END - eyeDepth) / (FOG_END - FOG_START), 0.0, 1.0);
+  fragmentColor = vec4(vertexColor * fog, 1.0);
+}
+)";
 
 // Buffer identifiers
-static unsigned int buffer[2];
+static unsigned int buffer[3];
+
+// Holds the attribute layout and element buffer of whichever model is shown
+static GLuint vertexArray;
+
+static std::unique_ptr<ShaderProgram> modelShaderProgram;
+static std::unique_ptr<TransformBlock> transformBlock;
+
+// Chosen per model with --quantize: positions as 16-bit steps, or floats
+// when null, and 16-bit indices when the model has few enough vertices
+static std::unique_ptr<VertexQuantizer> vertexQuantizer;
+static GLenum indexType = GL_UNSIGNED_INT;
+static size_t indexSize = sizeof(uint32_t);
+
+// With --deform the positions are rewritten every frame into a buffer of
+// their own, and only the colors and normals stream into the vertex buffer;
+// the normals stay those of the undeformed model
+static std::unique_ptr<DynamicVertexBuffer> dynamicVertexBuffer;
+
+// Bytes moved into the buffers each frame while the model streams in, so
+// that the first frames come quickly however large the model is
+static const size_t UPLOAD_BYTES_PER_FRAME = 4 << 20;
+
+// The model streams in as it was loaded and is drawn as far as it has
+// arrived. Meanwhile a worker thread groups its triangles into meshlets,
+// which stream in after it and then replace it
+enum UPLOAD_STAGE {
+  STREAMING_MODEL,
+  PARTITIONING_MESHLETS,
+  STREAMING_MESHLETS,
+  RESIDENT
+};
+static UPLOAD_STAGE uploadStage = RESIDENT;
+
+// Nothing is drawn until the first model arrives from the loader
+static bool hasModel = false;
+
+// Which of the given models is shown, or on its way
+static size_t modelFileIndex = 0;
+
+static size_t uploadedVertexCount;
+static size_t uploadedIndexCount;
+static size_t uploadedMeshletIndexCount;
+
+// Indices of the triangles before the first one with a vertex yet to arrive
+static size_t drawableIndexCount;
+
+// Every level of detail, partitioned into meshlets, one after the other
+struct MeshletLayout {
+  std::vector<uint32_t> indices;
+
+  // Where each level starts in indices; the last entry is the end of the
+  // coarsest level
+  std::vector<size_t> levelOfDetailOffsets;
+
+  // Each level's meshlets, relative to the start of the level
+  std::vector<std::vector<Meshlet>> levelOfDetailMeshlets;
+};
+
+// Whether meshlets outside the view frustum are skipped; those facing away
+// too, but only while GL culls back faces ('b'), as the wireframe otherwise
+// shows them
+static bool cullMeshlets = true;
+
+static int viewportWidth = 500;
+static int viewportHeight = 500;
+
+// Built over the model's full detail on its first pick, as most models are
+// never picked; the last point picked, in the model's own coordinates, is
+// what the next one is measured from
+static std::unique_ptr<TriangleBvh> pickingBvh;
+static bool hasPickedPoint = false;
+static Eigen::Vector3f pickedPoint;
+
+// The shown model's, from the loader on, printed with --stats once it is
+// resident. The GL setup is done once, before the first model, and is added
+// to every model's
+static LoadStatistics loadStatistics;
+static std::string loadedModelFilePath;
+static double glSetupTime = 0.0;
+static std::chrono::steady_clock::time_point streamingStart;
+
+// With --profile or --profile-trace, or once 'g' is pressed. The core
+// profile has no bitmap text, so the profile is shown in the window title,
+// refreshed now and then; it keeps frames coming, so that its times stay
+// current
+enum PROFILED_SECTION {
+  UPLOAD_SECTION,
+  CLEAR_SECTION,
+  DRAW_SECTION,
+  SWAP_SECTION
+};
+static std::unique_ptr<FrameProfiler> frameProfiler;
+static bool showProfile = false;
+static std::chrono::steady_clock::time_point profileShownTime;
+static const double PROFILE_REFRESH_MILLISECONDS = 500.0;
 
 // todo: move this somewhere else?
 static const float PI = 3.14159265;
-float degreesToRadians(float degrees) {
-  return degrees * (PI / 180);
-}
-float radiansToDegrees(float radians) {
-  return radians * (180 / PI);
-}
 
+ViewerOptions viewerOptions;
 Camera camera;
 Model model;
+ModelExporter modelExporter;
+ModelLoader modelLoader;
 
-// Display list identifier
-static unsigned int aModel;
+// Declared after the model, so that on exit the partitioning finishes before
+// the model is destroyed
+static std::future<MeshletLayout> meshletLayoutFuture;
+static MeshletLayout meshletLayout;
 
 void drawScene(void);
+void renderScene(void);
 void resize(int, int);
 void keyInput(unsigned char, int, int);
 void specialKeyInput(int key, int x, int y);
+void mouseInput(int button, int state, int x, int y);
 void setup(void);
-
-void positionCamera(void);
+void setupModel(void);
+void takeLoadedModel(ModelLoader::LoadedModel& loadedModel);
+void writeLoadStatistics(void);
+
+void runBenchmark(void);
+double millisecondsSince(std::chrono::steady_clock::time_point start);
+bool loadModel(const std::string& modelFilePath);
+float projectedModelRadius(void);
+MeshletLayout partitionMeshlets(void);
+bool streamModel(void);
+bool uploadNextChunks(void);
+void chooseVertexFormat(void);
+size_t getPositionSize(void);
+size_t getColorOffset(size_t vertexCount);
+size_t getNormalOffset(size_t vertexCount);
+void uploadPositions(size_t firstVertex, size_t vertexCount);
+void uploadIndices(GLuint target, size_t firstIndex, const uint32_t* indices,
+                   size_t indexCount);
+void uploadRange(GLuint target, size_t offset, const void* data, size_t size);
+void deformPositions(float* positions);
+void redisplay(int);
+void drawVisibleMeshlets(size_t level);
+void startProfiling(void);
+void beginProfiledSection(PROFILED_SECTION section);
+void endProfiledSection(void);
+void showProfileInTitle(void);
 
 int main(int argc, char** argv) {
-  if (argc != 2) {
-    throw std::runtime_error(
-        "Incorrect arguments; one argument (path to model specifications) is "
-        "expected");
-  }
+  viewerOptions = ViewerOptions(argc, argv);
+
+  // Parsed in the background while the window comes up
+  loadModel(viewerOptions.getModelFilePath());
 
-  ModelFactory modelFactory(argv[1]);
-  model = modelFactory.getModel();
+  if (viewerOptions.getBenchmarkFrameCount() > 0) {
+    runBenchmark();
+    return 0;
+  }
 
   glutInit(&argc, argv);
-  glutInitContextVersion(3, 0);
-  glutInitContextProfile(GLUT_COMPATIBILITY_PROFILE);
+  glutInitContextVersion(3, 3);
+  glutInitContextProfile(GLUT_CORE_PROFILE);
   glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
 
   glutInitWindowSize(500, 500);
   glutInitWindowPosition(100, 100);
 
-  glutCreateWindow(model.getName().c_str());
+  glutCreateWindow(viewerOptions.getModelFilePath().c_str());
 
   glutDisplayFunc(drawScene);
   glutReshapeFunc(resize);
   glutKeyboardFunc(keyInput);
 
   glutSpecialFunc(specialKeyInput);
+  glutMouseFunc(mouseInput);
 
   // todo: needed?
   glewExperimental = GL_TRUE;
@@ -78,54 +290,116 @@ int main(int argc, char** argv) {
 }
 
 void setup(void) {
+  std::chrono::steady_clock::time_point setupStart =
+      std::chrono::steady_clock::now();
   glClearColor(0.0, 0.0, 0.0, 0.0);
 
-  // Generate buffer identifiers
-  glGenBuffers(2, buffer);
-
-  glEnableClientState(GL_VERTEX_ARRAY);
-  glEnableClientState(GL_COLOR_ARRAY);
-
-  std::vector<float>& vertexVector = model.getVertices();
-  std::vector<float>& colorVector = model.getColors();
-
-  float* vertices = (float*)&vertexVector[0];
-  float* colors = (float*)&colorVector[0];
+  glEnable(GL_DEPTH_TEST);
 
-  glBindBuffer(GL_ARRAY_BUFFER, buffer[VERTICES]);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-  glBufferData(GL_ARRAY_BUFFER,
-               (vertexVector.size() + colorVector.size()) * sizeof(float), NULL,
-               GL_DYNAMIC_DRAW);
+  modelShaderProgram.reset(new ShaderProgram(
+      VERTEX_SHADER_SOURCE, FRAGMENT_SHADER_SOURCE,
+      {{POSITION_ATTRIBUTE, "position"},
+       {COLOR_ATTRIBUTE, "color"},
+       {NORMAL_ATTRIBUTE, "normal"}}));
+  transformBlock.reset(new TransformBlock());
+  modelShaderProgram->bindUniformBlock("Transforms", TransformBlock::BINDING);
+  modelShaderProgram->use();
+
+  // The core profile draws nothing without a vertex array; this one stays
+  // bound
+  glGenVertexArrays(1, &vertexArray);
+  glBindVertexArray(vertexArray);
+
+  if (viewerOptions.getProfileFrames()) {
+    startProfiling();
+    showProfile = viewerOptions.getShowProfile();
+  }
 
-  glBufferSubData(GL_ARRAY_BUFFER, 0, vertexVector.size() * sizeof(float),
-                  vertices);
+  glSetupTime = millisecondsSince(setupStart);
+}
 
-  glBufferSubData(GL_ARRAY_BUFFER, vertexVector.size() * sizeof(float),
-                  colorVector.size() * sizeof(float), colors);
+// Starts streaming a newly arrived model into buffers of its own, in place of
+// the previous model's
+void setupModel(void) {
+  loadStatistics.addTime("GL setup", glSetupTime);
+  LoadStatistics::ScopedTimer timer(loadStatistics, "model setup");
 
+  // Generate buffer identifiers
+  glDeleteBuffers(3, buffer);
+  glGenBuffers(3, buffer);
 
-  std::vector<std::vector<unsigned>>& polygons = model.getPolygons();
-  std::cout << polygons.size() << std::endl;
-  unsigned tmp[polygons.size() * 3];
-  for (unsigned i = 0; i < polygons.size(); ++i) {
-    for (unsigned j = 0; j < polygons[i].size(); ++j) {
-      tmp[3 * i + j] = polygons[i][j];
-    }
+  std::vector<float>& vertexVector = model.getVertices();
+  std::vector<float>& normalVector = model.getNormals();
+  const size_t vertexCount = vertexVector.size() / 3;
+
+  chooseVertexFormat();
+  dynamicVertexBuffer.reset();
+  if (viewerOptions.getDeformVertices()) {
+    dynamicVertexBuffer.reset(
+        new DynamicVertexBuffer(vertexCount * 3 * sizeof(float)));
+    loadStatistics.setMemory("GL dynamic vertex buffer",
+                             dynamicVertexBuffer->getSize());
   }
 
-  // Bind and fill indices buffer.
+  //// Only allocate the buffers here; streamModel fills them over the first
+  //// frames
+  const size_t vertexBufferSize =
+      getNormalOffset(vertexCount) + normalVector.size() * sizeof(float);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer[VERTICES]);
+  glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, NULL, GL_STATIC_DRAW);
+  loadStatistics.setMemory("GL vertex buffer", vertexBufferSize);
+
+  const size_t indexBufferSize = model.getIndices().size() * indexSize;
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer[INDICES]);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(tmp), tmp, GL_DYNAMIC_DRAW);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, NULL,
+               GL_STATIC_DRAW);
+  loadStatistics.setMemory("GL index buffer", indexBufferSize);
+
+  uploadStage = STREAMING_MODEL;
+  uploadedVertexCount = uploadedIndexCount = uploadedMeshletIndexCount = 0;
+  drawableIndexCount = 0;
+  meshletLayout = MeshletLayout();
+  meshletLayoutFuture = std::async(std::launch::async, partitionMeshlets);
+  streamingStart = std::chrono::steady_clock::now();
+  pickingBvh.reset();
+  hasPickedPoint = false;
+
+  // Point the attributes at the start of the respective data; deformed
+  // positions are pointed at each frame, as their region moves
+  glBindBuffer(GL_ARRAY_BUFFER, buffer[VERTICES]);
+  glEnableVertexAttribArray(POSITION_ATTRIBUTE);
+  if (vertexQuantizer) {
+    glVertexAttribPointer(POSITION_ATTRIBUTE, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0,
+                          0);
+  } else if (!dynamicVertexBuffer) {
+    glVertexAttribPointer(POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, 0, 0);
+  }
 
-  // Specify vertex and color pointers to the start of the respective data.
-  glVertexPointer(3, GL_FLOAT, 0, 0);
-  glColorPointer(3, GL_FLOAT, 0,
-                 (GLvoid*)(vertexVector.size() * sizeof(float)));
+  // Models without per-vertex colors take their uniform color as a constant
+  // attribute
+  if (model.hasVertexColors()) {
+    glEnableVertexAttribArray(COLOR_ATTRIBUTE);
+    glVertexAttribPointer(COLOR_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, 0,
+                          (GLvoid*)getColorOffset(vertexCount));
+  } else {
+    glDisableVertexAttribArray(COLOR_ATTRIBUTE);
+    glVertexAttrib3fv(COLOR_ATTRIBUTE, &model.getUniformColor()[0]);
+  }
 
-  glEnable(GL_DEPTH_TEST);
+  // Those without normals get a zero normal, which the shader leaves unlit
+  if (model.hasNormals()) {
+    glEnableVertexAttribArray(NORMAL_ATTRIBUTE);
+    glVertexAttribPointer(NORMAL_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, 0,
+                          (GLvoid*)getNormalOffset(vertexCount));
+  } else {
+    glDisableVertexAttribArray(NORMAL_ATTRIBUTE);
+    glVertexAttrib3f(NORMAL_ATTRIBUTE, 0.0f, 0.0f, 0.0f);
+  }
 
   // Move the model into the viewing frustum
+  timer.startPhase("bounds");
   model.translate(std::vector<float>{0, 0, -10});
 
   //// Scale the model to fit within screen
@@ -141,338 +415,692 @@ void setup(void) {
 
   model.scale(scale);
 
-  aModel = glGenLists(1);
+  hasModel = true;
+}
 
-  glNewList(aModel, GL_COMPILE);
+void drawScene(void) {
+  if (frameProfiler) {
+    frameProfiler->beginFrame();
+  }
 
-  for (unsigned i = 0; i < polygons.size(); ++i) {
-    glDrawElements(GL_TRIANGLE_STRIP, 3, GL_UNSIGNED_INT,
-                   (GLvoid*)(3 * i * sizeof(unsigned)));
+  // Checked before the mailbox, since a load that has finished has already
+  // left its model there
+  bool loading = modelLoader.isLoading();
+
+  // The worker reads the model until its meshlets are partitioned, so a new
+  // model waits in the mailbox until then
+  if (!meshletLayoutFuture.valid()) {
+    std::unique_ptr<ModelLoader::LoadedModel> loadedModel =
+        modelLoader.takeLoadedModel();
+    if (loadedModel) {
+      takeLoadedModel(*loadedModel);
+      setupModel();
+      glutSetWindowTitle(model.getName().c_str());
+    }
   }
 
-  glEndList();
+  beginProfiledSection(UPLOAD_SECTION);
+  streamModel();
+  endProfiledSection();
+
+  renderScene();
+
+  beginProfiledSection(SWAP_SECTION);
+  glutSwapBuffers();
+  endProfiledSection();
+
+  if (frameProfiler) {
+    frameProfiler->endFrame();
+  }
+  showProfileInTitle();
+
+  // Keep frames coming until the model is resident; there is nothing to
+  // upload while the meshlets are partitioned or a model is loaded, so only
+  // check on those now and then
+  if (uploadStage == STREAMING_MODEL || uploadStage == STREAMING_MESHLETS ||
+      dynamicVertexBuffer || showProfile) {
+    glutPostRedisplay();
+  } else if (uploadStage == PARTITIONING_MESHLETS || loading ||
+             modelLoader.hasLoadedModel()) {
+    glutTimerFunc(10, redisplay, 0);
+  }
 }
 
-void drawScene(void) {
-  positionCamera();
+void redisplay(int) {
+  glutPostRedisplay();
+}
 
+void renderScene(void) {
+  beginProfiledSection(CLEAR_SECTION);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  endProfiledSection();
 
-  float fogColor[4] = {0.0, 0.0, 0.0, 0.0};
+  if (!hasModel) {
+    return;
+  }
 
-  glEnable(GL_FOG);
-  glFogfv(GL_FOG_COLOR, fogColor);
-  glFogi(GL_FOG_MODE, GL_LINEAR);
-  glFogf(GL_FOG_START, 10.0);
-  glFogf(GL_FOG_END, 11.0);
-  glFogf(GL_FOG_DENSITY, 0.01);
-  glHint(GL_FOG_HINT, GL_NICEST);
+  beginProfiledSection(DRAW_SECTION);
 
-  glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+  // Only uploads the matrices if the model or camera has moved
+  transformBlock->update(model, camera);
 
-  glPushMatrix();
+  if (dynamicVertexBuffer) {
+    deformPositions(static_cast<float*>(dynamicVertexBuffer->beginFrame()));
+    glBindBuffer(GL_ARRAY_BUFFER, dynamicVertexBuffer->getBuffer());
+    glVertexAttribPointer(POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, 0,
+                          (GLvoid*)dynamicVertexBuffer->getRegionOffset());
+  }
 
-  // Translate model to position
-  std::vector<float> displacement = model.getDisplacement();
-  glTranslatef(displacement[0], displacement[1], displacement[2]);
+  if (uploadStage != RESIDENT) {
+    // Still streaming in; draw as much as has arrived
+    glDrawElements(GL_TRIANGLES, drawableIndexCount, indexType, 0);
+  } else {
+    // Draw the level of detail that suits the model's size on screen
+    const std::vector<size_t>& levelOfDetailOffsets =
+        meshletLayout.levelOfDetailOffsets;
+    size_t level = model.selectLevelOfDetail(projectedModelRadius());
+
+    // The meshlets' bounds are those of the undeformed model
+    if (cullMeshlets && !dynamicVertexBuffer) {
+      drawVisibleMeshlets(level);
+    } else {
+      glDrawElements(
+          GL_TRIANGLES,
+          levelOfDetailOffsets[level + 1] - levelOfDetailOffsets[level],
+          indexType, (GLvoid*)(levelOfDetailOffsets[level] * indexSize));
+    }
+  }
 
-  //// Extract angle and axis of rotation from quaternion, rotate model
-  Eigen::Quaternion<float> modelOrientation = model.getOrientation();
+  if (dynamicVertexBuffer) {
+    dynamicVertexBuffer->endFrame();
+  }
 
-  float angle = 0.0f, axisX = 0.0f, axisY = 0.0f, axisZ = 0.0f;
-  angle = 2 * acos(modelOrientation.w());
-  axisX = modelOrientation.x() / sin(angle / 2);
-  axisY = modelOrientation.y() / sin(angle / 2);
-  axisZ = modelOrientation.z() / sin(angle / 2);
+  endProfiledSection();
+}
 
-  glRotatef(radiansToDegrees(angle), axisX, axisY, axisZ);
+// Renders the benchmark script offscreen, instead of opening a window, and
+// prints its timings
+void runBenchmark(void) {
+  FrameBenchmark frameBenchmark(viewerOptions.getBenchmarkFrameCount());
 
-  // Scale model
-  std::vector<float> modelScale = model.getScale();
-  glScalef(modelScale[0], modelScale[1], modelScale[2]);
+  modelLoader.wait();
+  std::unique_ptr<ModelLoader::LoadedModel> loadedModel =
+      modelLoader.takeLoadedModel();
+  if (!loadedModel) {
+    throw std::runtime_error("There is no model to benchmark");
+  }
+  takeLoadedModel(*loadedModel);
+  frameBenchmark.setLoadTime(loadedModel->loadTime);
 
-  // Translate model to origin
-  auto modelCenter = model.getCenter();
-  glTranslatef(-modelCenter[0], -modelCenter[1], -modelCenter[2]);
+  HeadlessContext headlessContext(500, 500, true);
 
-  glCallList(aModel);
+  std::chrono::steady_clock::time_point setupStart =
+      std::chrono::steady_clock::now();
+  setup();
+  setupModel();
 
-  glPopMatrix();
+  // Frames are timed with the whole model resident
+  while (streamModel()) {
+    if (uploadStage == PARTITIONING_MESHLETS) {
+      meshletLayoutFuture.wait();
+    }
+  }
+  glFinish();
+  frameBenchmark.setSetupTime(millisecondsSince(setupStart));
 
-  glutSwapBuffers();
-}
+  frameBenchmark.startScript(camera);
+  resize(500, 500);
+  for (unsigned frame = 0; frame < frameBenchmark.getFrameCount(); ++frame) {
+    frameBenchmark.advance(model, camera);
 
-void resize(int w, int h) {
-  glViewport(0, 0, w, h);
-  positionCamera();
+    frameBenchmark.beginFrame();
+    if (frameProfiler) {
+      frameProfiler->beginFrame();
+    }
+    renderScene();
+    glFinish();
+    frameBenchmark.endFrame();
+    if (frameProfiler) {
+      frameProfiler->endFrame();
+    }
+  }
+
+  // The glFinish after every frame leaves the GPU idle, so any wait here
+  // would be the buffering failing
+  if (dynamicVertexBuffer) {
+    std::cout << "Dynamic vertex buffer: "
+              << dynamicVertexBuffer->getStallCount() << " of "
+              << dynamicVertexBuffer->getFrameCount()
+              << " frames waited on the GPU" << std::endl;
+  }
+
+  frameBenchmark.writeReport(std::cout, "modelViewerVBO",
+                             viewerOptions.getModelFilePath());
+
+  // Before the context goes
+  if (frameProfiler) {
+    for (const std::string& line : frameProfiler->getSummary()) {
+      std::cout << line << std::endl;
+    }
+    frameProfiler.reset();
+  }
 }
 
-void positionCamera(void) {
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
+// Makes the loaded model the one shown, with its statistics so far
+void takeLoadedModel(ModelLoader::LoadedModel& loadedModel) {
+  model = std::move(loadedModel.model);
+  loadStatistics = loadedModel.loadStatistics;
+  loadedModelFilePath = loadedModel.filePath;
+}
 
-  Camera::CAMERA_PROJECTION_MODE cameraProjectionMode =
-      camera.getCameraProjectionMode();
-  switch (cameraProjectionMode) {
-    case Camera::CAMERA_PROJECTION_MODE::ORTHOGRAPHIC:
-      glOrtho(-1.0, 1.0, -1.0, 1.0, 8.0, 100.0);
+void writeLoadStatistics(void) {
+  switch (viewerOptions.getStatisticsFormat()) {
+    case ViewerOptions::STATISTICS_FORMAT::REPORT:
+      loadStatistics.writeReport(std::cout, loadedModelFilePath);
       break;
-    case Camera::CAMERA_PROJECTION_MODE::PERSPECTIVE:
-      glFrustum(-1.0, 1.0, -1.0, 1.0, 8.0, 100.0);
+    case ViewerOptions::STATISTICS_FORMAT::JSON:
+      loadStatistics.writeJson(std::cout, loadedModelFilePath);
       break;
     default:
-      throw std::runtime_error("Unrecognized camera projection mode");
+      break;
   }
+}
 
-  std::vector<float> cameraDisplacement = camera.getDisplacement();
-  glTranslatef(cameraDisplacement[0], cameraDisplacement[1],
-               cameraDisplacement[2]);
-
-  //// Extract angle and axis of rotation from quaternion, rotate camera
-  Eigen::Quaternion<float> cameraOrientation = camera.getOrientation();
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
 
-  float angle = 0.0f, axisX = 0.0f, axisY = 0.0f, axisZ = 0.0f;
-  angle = 2 * acos(cameraOrientation.w());
-  axisX = cameraOrientation.x() / sin(angle / 2);
-  axisY = cameraOrientation.y() / sin(angle / 2);
-  axisZ = cameraOrientation.z() / sin(angle / 2);
+// Starts loading a model in the background, with the viewer's options;
+// returns false if the previous load has not finished yet
+bool loadModel(const std::string& modelFilePath) {
+  return modelLoader.load(modelFilePath, viewerOptions.getModelLoadMode(),
+                          viewerOptions.getUseModelCache(),
+                          viewerOptions.getOptimizeVertexCache(),
+                          viewerOptions.getGenerateLevelsOfDetail(),
+                          viewerOptions.getGenerateNormals());
+}
 
-  // note: angle needs to be in degrees
-  glRotatef(radiansToDegrees(angle), axisX, axisY, axisZ);
+// Runs on a worker thread, so it only reads the model
+MeshletLayout partitionMeshlets(void) {
+  LoadStatistics::ScopedTimer timer(loadStatistics, "meshlet partition");
+  MeshletLayout layout;
+  layout.levelOfDetailOffsets.assign(1, 0);
+  for (size_t level = 0; level < model.getLevelOfDetailCount(); ++level) {
+    std::vector<uint32_t> levelIndices = model.getLevelOfDetailIndices(level);
+    MeshletBuilder meshletBuilder(model.getVertices(), levelIndices);
+    layout.levelOfDetailMeshlets.push_back(meshletBuilder.getMeshlets());
+
+    layout.indices.insert(layout.indices.end(), levelIndices.begin(),
+                          levelIndices.end());
+    layout.levelOfDetailOffsets.push_back(layout.indices.size());
+  }
 
-  glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
+  return layout;
 }
 
-void keyInput(unsigned char key, int x, int y) {
-  switch (key) {
-    case 'q':
-      exit(0);
-      break;
-    // TODO: MAKE SURE THAT YOU UPDATE THIS; RESET EVERYTHING
-    case 'x': {
-      Eigen::Quaternion<float> modelOrientation = model.getOrientation();
-      model.rotate(modelOrientation.inverse());
-
-      std::vector<float> modelPosition = model.getDisplacement();
-      model.translate(std::vector<float>{-modelPosition[0], -modelPosition[1],
-                                         -modelPosition[2] - 10.0f});
+// Moves the next chunks of the model into its buffers; returns false once
+// everything is resident
+bool streamModel(void) {
+  if (uploadStage == RESIDENT) {
+    return false;
+  }
 
-      Eigen::Quaternion<float> cameraOrientation = camera.getOrientation();
-      camera.rotate(cameraOrientation.inverse());
+  bool streaming;
+  {
+    LoadStatistics::ScopedTimer timer(loadStatistics, "upload");
+    streaming = uploadNextChunks();
+  }
 
-      std::vector<float> cameraPosition = camera.getDisplacement();
-      camera.translate(std::vector<float>{
-          -cameraPosition[0], -cameraPosition[1], -cameraPosition[2]});
+  if (!streaming) {
+    loadStatistics.addTime("streaming, wall clock",
+                           millisecondsSince(streamingStart));
+    writeLoadStatistics();
+  }
+  return streaming;
+}
 
-      glutPostRedisplay();  // re-draw scene
-      break;
+// One frame's worth of streamModel
+bool uploadNextChunks(void) {
+  size_t budget = UPLOAD_BYTES_PER_FRAME;
+
+  switch (uploadStage) {
+    case STREAMING_MODEL: {
+      std::vector<float>& vertexVector = model.getVertices();
+      std::vector<float>& colorVector = model.getColors();
+      std::vector<float>& normalVector = model.getNormals();
+      std::vector<uint32_t>& indices = model.getIndices();
+      const size_t vertexCount = vertexVector.size() / 3;
+      const size_t vertexSize =
+          getPositionSize() + (colorVector.empty() ? 0 : 3 * sizeof(float)) +
+          (normalVector.empty() ? 0 : 3 * sizeof(float));
+
+      //// Vertices get half the budget until the indices are all in, since
+      //// no triangle can be drawn without its vertices
+      size_t vertexBudget =
+          uploadedIndexCount < indices.size() ? budget / 2 : budget;
+      size_t newVertexCount =
+          vertexSize == 0 ? vertexCount - uploadedVertexCount
+                          : std::min(vertexCount - uploadedVertexCount,
+                                     vertexBudget / vertexSize);
+
+      uploadPositions(uploadedVertexCount, newVertexCount);
+      if (!colorVector.empty()) {
+        uploadRange(buffer[VERTICES],
+                    getColorOffset(vertexCount) +
+                        3 * uploadedVertexCount * sizeof(float),
+                    colorVector.data() + 3 * uploadedVertexCount,
+                    newVertexCount * 3 * sizeof(float));
+      }
+      if (!normalVector.empty()) {
+        uploadRange(buffer[VERTICES],
+                    getNormalOffset(vertexCount) +
+                        3 * uploadedVertexCount * sizeof(float),
+                    normalVector.data() + 3 * uploadedVertexCount,
+                    newVertexCount * 3 * sizeof(float));
+      }
+      uploadedVertexCount += newVertexCount;
+      budget -= newVertexCount * vertexSize;
+
+      //// Then whole triangles' worth of indices
+      size_t newIndexCount = std::min(indices.size() - uploadedIndexCount,
+                                      budget / indexSize / 3 * 3);
+      uploadIndices(buffer[INDICES], uploadedIndexCount,
+                    indices.data() + uploadedIndexCount, newIndexCount);
+      uploadedIndexCount += newIndexCount;
+
+      while (drawableIndexCount < uploadedIndexCount &&
+             indices[drawableIndexCount] < uploadedVertexCount &&
+             indices[drawableIndexCount + 1] < uploadedVertexCount &&
+             indices[drawableIndexCount + 2] < uploadedVertexCount) {
+        drawableIndexCount += 3;
+      }
+
+      if (uploadedVertexCount == vertexCount &&
+          uploadedIndexCount == indices.size()) {
+        uploadStage = PARTITIONING_MESHLETS;
+      }
+      return true;
     }
-    case 'w':
-      model.writeToFile("out.obj");
-      break;
-    case 'v': {
-      camera.setCameraProjectionMode(
-          Camera::CAMERA_PROJECTION_MODE::ORTHOGRAPHIC);
-
-      glutPostRedisplay();  // re-draw scene
-      break;
+    case PARTITIONING_MESHLETS:
+      if (meshletLayoutFuture.wait_for(std::chrono::seconds(0)) !=
+          std::future_status::ready) {
+        return true;
+      }
+
+      meshletLayout = meshletLayoutFuture.get();
+      glBindBuffer(GL_ARRAY_BUFFER, buffer[MESHLET_INDICES]);
+      glBufferData(GL_ARRAY_BUFFER,
+                   meshletLayout.indices.size() * indexSize, NULL,
+                   GL_STATIC_DRAW);
+      loadStatistics.setMemory("GL meshlet index buffer",
+                               meshletLayout.indices.size() * indexSize);
+      uploadStage = STREAMING_MESHLETS;
+      return true;
+    case STREAMING_MESHLETS: {
+      std::vector<uint32_t>& indices = meshletLayout.indices;
+      size_t newIndexCount =
+          std::min(indices.size() - uploadedMeshletIndexCount,
+                   budget / indexSize);
+      uploadIndices(buffer[MESHLET_INDICES], uploadedMeshletIndexCount,
+                    indices.data() + uploadedMeshletIndexCount,
+                    newIndexCount);
+      uploadedMeshletIndexCount += newIndexCount;
+      if (uploadedMeshletIndexCount < indices.size()) {
+        return true;
+      }
+
+      // Draw the meshlets from now on; the streamed indices are no longer
+      // needed, on either side. The name is cleared, as GL may hand it out
+      // again before setupModel deletes the buffers
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer[MESHLET_INDICES]);
+      glDeleteBuffers(1, &buffer[INDICES]);
+      buffer[INDICES] = 0;
+      std::vector<uint32_t>().swap(indices);
+      loadStatistics.setMemory("GL index buffer", 0);
+      uploadStage = RESIDENT;
+      return false;
     }
-    case 'V': {
-      camera.setCameraProjectionMode(
-          Camera::CAMERA_PROJECTION_MODE::PERSPECTIVE);
+    default:
+      return false;
+  }
+}
 
-      glutPostRedisplay();  // re-draw scene
-      break;
+// Picks the formats the model is uploaded in, and reports how far quantizing
+// moves its vertices
+void chooseVertexFormat(void) {
+  const size_t vertexCount = model.getVertices().size() / 3;
+
+  vertexQuantizer.reset();
+  indexType = GL_UNSIGNED_INT;
+  indexSize = sizeof(uint32_t);
+  // Deformed positions are written as floats every frame, so they are never
+  // quantized
+  if (viewerOptions.getQuantizeVertices() &&
+      !viewerOptions.getDeformVertices()) {
+    std::vector<float> modelDimensions = model.getDimensions();
+    vertexQuantizer.reset(
+        new VertexQuantizer(model.getMinimumBounds(), modelDimensions));
+    if (VertexQuantizer::fitsShortIndices(vertexCount)) {
+      indexType = GL_UNSIGNED_SHORT;
+      indexSize = sizeof(uint16_t);
     }
-    case 'n': {
-      model.translate(std::vector<float>{0.0, 0.0, -0.1});
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'N': {
-      model.translate(std::vector<float>{0.0, 0.0, 0.1});
+    float maxDimension = std::max(
+        std::max(modelDimensions[0], modelDimensions[1]), modelDimensions[2]);
+    float maximumError = vertexQuantizer->getMaximumError();
+    std::cout << "Quantized positions to 16 bits; error at most "
+              << maximumError << " ("
+              << (maxDimension > 0.0f ? 100 * maximumError / maxDimension
+                                      : 0.0f)
+              << "% of the model's size), with " << 8 * indexSize
+              << "-bit indices" << std::endl;
+  }
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'p': {
-      float rotationAngle = degreesToRadians(-10);
+  const float floatOffset[3] = {0.0f, 0.0f, 0.0f};
+  const float floatScale[3] = {1.0f, 1.0f, 1.0f};
+  glUniform3fv(modelShaderProgram->getUniformLocation("positionOffset"), 1,
+               vertexQuantizer ? vertexQuantizer->getOffset() : floatOffset);
+  glUniform3fv(modelShaderProgram->getUniformLocation("positionScale"), 1,
+               vertexQuantizer ? vertexQuantizer->getScale() : floatScale);
+}
 
-      Eigen::Quaternion<float> rotationDelta(
-          cos(rotationAngle / 2), sin(rotationAngle / 2), 0.0f, 0.0f);
+// Deformed positions are not in the vertex buffer at all
+size_t getPositionSize(void) {
+  if (dynamicVertexBuffer) {
+    return 0;
+  }
 
-      model.rotate(rotationDelta);
+  return vertexQuantizer ? 3 * sizeof(uint16_t) : 3 * sizeof(float);
+}
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'P': {
-      float rotationAngle = degreesToRadians(10);
+// Colors follow the positions in the vertex buffer, from a 4-byte boundary
+size_t getColorOffset(size_t vertexCount) {
+  return (vertexCount * getPositionSize() + 3) / 4 * 4;
+}
 
-      Eigen::Quaternion<float> rotationDelta(
-          cos(rotationAngle / 2), sin(rotationAngle / 2), 0.0f, 0.0f);
+// Normals follow the colors, if the model has any
+size_t getNormalOffset(size_t vertexCount) {
+  return getColorOffset(vertexCount) + model.getColors().size() * sizeof(float);
+}
 
-      model.rotate(rotationDelta);
+void uploadPositions(size_t firstVertex, size_t vertexCount) {
+  if (dynamicVertexBuffer) {
+    return;
+  }
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'y': {
-      float rotationAngle = degreesToRadians(-10);
+  const float* positions = model.getVertices().data() + 3 * firstVertex;
+  if (!vertexQuantizer) {
+    uploadRange(buffer[VERTICES], firstVertex * getPositionSize(), positions,
+                vertexCount * getPositionSize());
+    return;
+  }
 
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f,
-                                             sin(rotationAngle / 2), 0.0f);
+  static std::vector<uint16_t> quantizedPositions;
+  quantizedPositions.resize(3 * vertexCount);
+  vertexQuantizer->quantize(positions, vertexCount, quantizedPositions.data());
+  uploadRange(buffer[VERTICES], firstVertex * getPositionSize(),
+              quantizedPositions.data(), vertexCount * getPositionSize());
+}
 
-      model.rotate(rotationDelta);
+// In whichever width was chosen for the model
+void uploadIndices(GLuint target, size_t firstIndex, const uint32_t* indices,
+                   size_t indexCount) {
+  if (indexType == GL_UNSIGNED_INT) {
+    uploadRange(target, firstIndex * indexSize, indices,
+                indexCount * indexSize);
+    return;
+  }
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'Y': {
-      float rotationAngle = degreesToRadians(10);
+  static std::vector<uint16_t> shortIndices;
+  shortIndices.resize(indexCount);
+  VertexQuantizer::narrowIndices(indices, indexCount, shortIndices.data());
+  uploadRange(target, firstIndex * indexSize, shortIndices.data(),
+              indexCount * indexSize);
+}
 
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f,
-                                             sin(rotationAngle / 2), 0.0f);
+// Buffers are filled through the array buffer binding, which, unlike the
+// element array binding, does not affect what is drawn
+void uploadRange(GLuint target, size_t offset, const void* data, size_t size) {
+  if (size == 0) {
+    return;
+  }
 
-      model.rotate(rotationDelta);
+  glBindBuffer(GL_ARRAY_BUFFER, target);
+  glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+  loadStatistics.addUpload(target == buffer[VERTICES]  ? "vertex buffer"
+                           : target == buffer[INDICES] ? "index buffer"
+                                                       : "meshlet index buffer",
+                           size);
+}
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'r': {
-      float rotationAngle = degreesToRadians(-10);
+// Writes this frame's positions: the model with a ripple running across it,
+// which advances with each frame drawn rather than with time, so that
+// benchmarks see the same frames however fast they come
+void deformPositions(float* positions) {
+  const std::vector<float>& vertices = model.getVertices();
+  std::vector<float> modelDimensions = model.getDimensions();
+  float maxDimension = std::max(
+      std::max(modelDimensions[0], modelDimensions[1]), modelDimensions[2]);
 
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f, 0.0f,
-                                             sin(rotationAngle / 2));
+  // Two waves across the model, 2% of its size high
+  const float amplitude = 0.02f * maxDimension;
+  const float waveNumber = maxDimension > 0.0f ? 4 * PI / maxDimension : 0.0f;
+  const float phase = 0.1f * dynamicVertexBuffer->getFrameCount();
+
+  for (size_t i = 0; i < vertices.size(); i += 3) {
+    float x = vertices[i];
+    float z = vertices[i + 2];
+    positions[i] = x;
+    positions[i + 1] = vertices[i + 1] +
+                       amplitude * std::sin(waveNumber * x + phase) *
+                           std::cos(waveNumber * z + phase);
+    positions[i + 2] = z;
+  }
+}
 
-      model.rotate(rotationDelta);
+void startProfiling(void) {
+  frameProfiler.reset(new FrameProfiler(
+      {"upload", "clear", "draw", "swap"},
+      viewerOptions.getProfileTraceFilePath()));
+  if (!frameProfiler->hasGpuTimer()) {
+    std::cout << "No timer queries in this GL; profiling the CPU only"
+              << std::endl;
+  }
+}
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'R': {
-      float rotationAngle = degreesToRadians(10);
+void beginProfiledSection(PROFILED_SECTION section) {
+  if (frameProfiler) {
+    frameProfiler->beginSection(section);
+  }
+}
 
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f, 0.0f,
-                                             sin(rotationAngle / 2));
+void endProfiledSection(void) {
+  if (frameProfiler) {
+    frameProfiler->endSection();
+  }
+}
 
-      model.rotate(rotationDelta);
+void showProfileInTitle(void) {
+  if (!showProfile ||
+      millisecondsSince(profileShownTime) < PROFILE_REFRESH_MILLISECONDS) {
+    return;
+  }
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'd': {
-      camera.translate(std::vector<float>{-0.1f, 0.0f, 0.0f});
+  glutSetWindowTitle(
+      (model.getName() + " | " + frameProfiler->getSummaryLine()).c_str());
+  profileShownTime = std::chrono::steady_clock::now();
+}
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'D': {
-      camera.translate(std::vector<float>{0.1f, 0.0f, 0.0f});
+// Culls the level's meshlets against the current transformation and draws the
+// rest, with one call for all the ranges of consecutive visible meshlets
+void drawVisibleMeshlets(size_t level) {
+  static std::vector<MeshletCuller::TriangleRange> visibleRanges;
+  MeshletCuller meshletCuller(transformBlock->getModelViewProjectionMatrix(),
+                              glIsEnabled(GL_CULL_FACE));
+  meshletCuller.cull(meshletLayout.levelOfDetailMeshlets[level],
+                     visibleRanges);
+
+  static std::vector<GLsizei> counts;
+  static std::vector<const GLvoid*> offsets;
+  counts.clear();
+  offsets.clear();
+  for (const MeshletCuller::TriangleRange& range : visibleRanges) {
+    counts.push_back(3 * range.triangleCount);
+    offsets.push_back((const GLvoid*)(
+        (meshletLayout.levelOfDetailOffsets[level] +
+         3 * size_t(range.triangleOffset)) *
+        indexSize));
+  }
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'c': {
-      camera.translate(std::vector<float>{0.0f, -0.1f, 0.0f});
+  if (!counts.empty()) {
+    glMultiDrawElements(GL_TRIANGLES, counts.data(), indexType,
+                        offsets.data(), counts.size());
+  }
+}
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'C': {
-      camera.translate(std::vector<float>{0.0f, 0.1f, 0.0f});
+void resize(int w, int h) {
+  glViewport(0, 0, w, h);
+  viewportWidth = w;
+  viewportHeight = h;
+}
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'z': {
-      camera.translate(std::vector<float>{0.0f, 0.0f, -0.1f});
+// Left clicks pick the point of the model under the cursor, and print it with
+// its distance from the point picked before, to measure the model. Picks see
+// the model undeformed
+void mouseInput(int button, int state, int x, int y) {
+  if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN || !hasModel) {
+    return;
+  }
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'Z': {
-      camera.translate(std::vector<float>{0.0f, 0.0f, 0.1f});
+  if (!pickingBvh) {
+    std::chrono::steady_clock::time_point buildStart =
+        std::chrono::steady_clock::now();
+    pickingBvh.reset(new TriangleBvh(model));
+    std::cout << "Built the picking hierarchy over "
+              << pickingBvh->getTriangleCount() << " triangles in "
+              << millisecondsSince(buildStart) << " ms ("
+              << pickingBvh->getMemorySize() / double(1 << 20) << " MB)"
+              << std::endl;
+  }
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 't': {
-      float rotationAngle = degreesToRadians(-1);
+  //// Unproject the cursor onto the near and far planes, in the model's
+  //// coordinates, and pick along the ray between them
+  transformBlock->update(model, camera);
+  Eigen::Matrix4f inverse =
+      transformBlock->getModelViewProjectionMatrix().inverse();
+  float deviceX = 2.0f * (x + 0.5f) / viewportWidth - 1.0f;
+  float deviceY = 1.0f - 2.0f * (y + 0.5f) / viewportHeight;
+  Eigen::Vector4f nearPoint =
+      inverse * Eigen::Vector4f(deviceX, deviceY, -1.0f, 1.0f);
+  Eigen::Vector4f farPoint =
+      inverse * Eigen::Vector4f(deviceX, deviceY, 1.0f, 1.0f);
+  Eigen::Vector3f origin = nearPoint.head<3>() / nearPoint[3];
+  Eigen::Vector3f direction = farPoint.head<3>() / farPoint[3] - origin;
+
+  TriangleBvh::Hit hit;
+  if (!pickingBvh->intersect(origin, direction, hit, 1.0f)) {
+    std::cout << "Nothing to pick there" << std::endl;
+    return;
+  }
+
+  Eigen::Vector3f point = origin + hit.distance * direction;
+  std::cout << "Picked (" << point[0] << ", " << point[1] << ", " << point[2]
+            << ") on triangle " << hit.triangle;
+  if (hasPickedPoint) {
+    std::cout << ", " << (point - pickedPoint).norm()
+              << " from the point picked before";
+  }
+  std::cout << std::endl;
 
-      Eigen::Quaternion<float> rotationDelta(
-          cos(rotationAngle / 2), sin(rotationAngle / 2), 0.0f, 0.0f);
-      camera.rotate(rotationDelta);
+  pickedPoint = point;
+  hasPickedPoint = true;
+}
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'T': {
-      float rotationAngle = degreesToRadians(1);
+// Radius, in pixels, of the model's bounding sphere on screen
+float projectedModelRadius(void) {
+  float radius = model.getBoundingRadius();
 
-      Eigen::Quaternion<float> rotationDelta(
-          cos(rotationAngle / 2), sin(rotationAngle / 2), 0.0f, 0.0f);
-      camera.rotate(rotationDelta);
+  // The frustum is as wide at its near plane (8) as the orthographic volume
+  if (camera.getCameraProjectionMode() ==
+      Camera::CAMERA_PROJECTION_MODE::PERSPECTIVE) {
+    float distance =
+        -(model.getDisplacement()[2] + camera.getDisplacement()[2]);
+    radius *= 8.0f / std::max(distance, 8.0f);
+  }
 
-      glutPostRedisplay();  // re-draw scene
-      break;
-    }
-    case 'a': {
-      float rotationAngle = degreesToRadians(-1);
+  return radius * viewportHeight / 2;
+}
 
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f,
-                                             sin(rotationAngle / 2), 0.0f);
-      camera.rotate(rotationDelta);
+void keyInput(unsigned char key, int x, int y) {
+  if (ViewerControls::handleKey(key, model, camera)) {
+    glutPostRedisplay();  // re-draw scene
+    return;
+  }
 
-      glutPostRedisplay();  // re-draw scene
+  switch (key) {
+    case 'q':
+      exit(0);
       break;
-    }
-    case 'A': {
-      float rotationAngle = degreesToRadians(1);
-
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f,
-                                             sin(rotationAngle / 2), 0.0f);
-      camera.rotate(rotationDelta);
+    case 'w':
+      // Exported in the background; the scene keeps rendering meanwhile
+      if (!modelExporter.exportModel(
+              model, "out.obj", viewerOptions.getExportSignificantDigits())) {
+        std::cout << "The previous export has not finished yet" << std::endl;
+      }
+      break;
+    case 'o': {
+      // Loads the next of the given models, or reloads the only one; the
+      // current model stays on screen until the new one arrives
+      const std::vector<std::string>& modelFilePaths =
+          viewerOptions.getModelFilePaths();
+      size_t nextModelFileIndex = (modelFileIndex + 1) % modelFilePaths.size();
+      if (!loadModel(modelFilePaths[nextModelFileIndex])) {
+        std::cout << "The previous load has not finished yet" << std::endl;
+        break;
+      }
+      modelFileIndex = nextModelFileIndex;
 
       glutPostRedisplay();  // re-draw scene
       break;
     }
-    case 'l': {
-      float rotationAngle = degreesToRadians(-10);
-
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f, 0.0f,
-                                             sin(rotationAngle / 2));
-      camera.rotate(rotationDelta);
+    case 'g':
+      if (!frameProfiler) {
+        startProfiling();
+      }
+      showProfile = !showProfile;
+      if (!showProfile) {
+        glutSetWindowTitle(model.getName().c_str());
+      }
 
       glutPostRedisplay();  // re-draw scene
       break;
-    }
-    case 'L': {
-      float rotationAngle = degreesToRadians(10);
+    case 'b':
+      if (glIsEnabled(GL_CULL_FACE)) {
+        glDisable(GL_CULL_FACE);
+      } else {
+        glEnable(GL_CULL_FACE);
+      }
+      std::cout << "Back-face culling "
+                << (glIsEnabled(GL_CULL_FACE) ? "on" : "off") << std::endl;
 
-      Eigen::Quaternion<float> rotationDelta(cos(rotationAngle / 2), 0.0f, 0.0f,
-                                             sin(rotationAngle / 2));
-      camera.rotate(rotationDelta);
+      glutPostRedisplay();  // re-draw scene
+      break;
+    case 'm':
+      cullMeshlets = !cullMeshlets;
+      std::cout << "Meshlet culling " << (cullMeshlets ? "on" : "off")
+                << std::endl;
 
       glutPostRedisplay();  // re-draw scene
       break;
-    }
     default:
       break;
   }
 }
 
 void specialKeyInput(int key, int x, int y) {
-  if (key == GLUT_KEY_UP)
-    model.translate(std::vector<float>{0.0, 0.1, 0.0});
-  if (key == GLUT_KEY_DOWN)
-    model.translate(std::vector<float>{0.0, -0.1, 0.0});
-  if (key == GLUT_KEY_LEFT)
-    model.translate(std::vector<float>{-0.1, 0.0, 0.0});
-  if (key == GLUT_KEY_RIGHT)
-    model.translate(std::vector<float>{0.1, 0.0, 0.0});
+  ViewerControls::handleSpecialKey(key, model);
 
   glutPostRedisplay();  // re-draw scene
 }
\ No newline at end of file
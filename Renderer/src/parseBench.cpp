@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "MappedFile.hpp"
+#include "Model.hpp"
+#include "ModelFactory.hpp"
+
+// Times the load path on models such as modelGenerator writes: parsing with
+// each loader, building a Model through its interface from what was parsed,
+// and writing it back out with Model::writeToFile. Each stage keeps its
+// fastest run, and is reported in MB/s of OBJ text and triangles/s:
+//   parseBench [--loader=stream|mmap|parallel]... [--runs=N]
+//              [--baseline=path [--update-baseline] [--tolerance=P]]
+//              <paths to models>...
+// Every loader is timed unless some are given. The written copy goes next to
+// the model and is removed afterwards. The model cache is never used
+//
+// With --baseline, each stage is compared with the triangles/s stored for
+// the same model file name, and the benchmark exits with 1 if any is more
+// than --tolerance percent (15 by default) slower. --update-baseline stores
+// this run's results there instead. Baselines only compare runs on the same
+// machine, so none is committed: run with --update-baseline first on each
+// machine (on modelGenerator's reference models, say), or --baseline has
+// nothing to compare against and only reports "no baseline"
+
+static const double MEGABYTE = 1 << 20;
+
+struct BenchOptions {
+  std::vector<ModelFactory::MODEL_LOAD_MODE> modelLoadModes;
+  unsigned runCount = 3;
+  std::string baselineFilePath;
+  bool updateBaseline = false;
+  double tolerance = 15.0;
+  std::vector<std::string> modelFilePaths;
+};
+
+// Triangles/s, by model file name, then by stage
+typedef std::map<std::string, std::map<std::string, double>> Results;
+
+BenchOptions parseOptions(int argc, char** argv);
+unsigned parseUnsigned(const std::string& argument, size_t valueOffset);
+void benchmark(const std::string& modelFilePath, const BenchOptions& options,
+               std::map<std::string, double>& stageResults);
+double reportStage(const std::string& stage, double time, double size,
+                   size_t triangleCount);
+std::string getModelLoadModeName(ModelFactory::MODEL_LOAD_MODE modelLoadMode);
+std::string getFileName(const std::string& filePath);
+Results readBaseline(const std::string& baselineFilePath);
+void writeBaseline(const std::string& baselineFilePath,
+                   const Results& results);
+bool checkBaseline(const Results& baseline, const Results& results,
+                   double tolerance);
+double millisecondsSince(std::chrono::steady_clock::time_point start);
+
+int main(int argc, char** argv) {
+  try {
+    BenchOptions options = parseOptions(argc, argv);
+
+    Results results;
+    for (const std::string& modelFilePath : options.modelFilePaths) {
+      benchmark(modelFilePath, options, results[getFileName(modelFilePath)]);
+    }
+
+    if (options.baselineFilePath.empty()) {
+      return 0;
+    }
+
+    // Models not benchmarked this time keep their baselines
+    Results baseline = readBaseline(options.baselineFilePath);
+    if (options.updateBaseline) {
+      for (const auto& modelResults : results) {
+        baseline[modelResults.first] = modelResults.second;
+      }
+      writeBaseline(options.baselineFilePath, baseline);
+      std::cout << "Stored the baseline in " << options.baselineFilePath
+                << std::endl;
+      return 0;
+    }
+
+    return checkBaseline(baseline, results, options.tolerance) ? 0 : 1;
+  } catch (const std::exception& exception) {
+    std::cerr << exception.what() << std::endl;
+    return 1;
+  }
+}
+
+BenchOptions parseOptions(int argc, char** argv) {
+  BenchOptions options;
+  for (int i = 1; i < argc; ++i) {
+    std::string argument(argv[i]);
+
+    if (argument.compare(0, 2, "--") != 0) {
+      options.modelFilePaths.push_back(argument);
+    } else if (argument == "--loader=stream") {
+      options.modelLoadModes.push_back(ModelFactory::MODEL_LOAD_MODE::STREAM);
+    } else if (argument == "--loader=mmap") {
+      options.modelLoadModes.push_back(ModelFactory::MODEL_LOAD_MODE::MAPPED);
+    } else if (argument == "--loader=parallel") {
+      options.modelLoadModes.push_back(
+          ModelFactory::MODEL_LOAD_MODE::PARALLEL);
+    } else if (argument.compare(0, 7, "--runs=") == 0) {
+      options.runCount = std::max(parseUnsigned(argument, 7), 1u);
+    } else if (argument.compare(0, 11, "--baseline=") == 0) {
+      options.baselineFilePath = argument.substr(11);
+    } else if (argument == "--update-baseline") {
+      options.updateBaseline = true;
+    } else if (argument.compare(0, 12, "--tolerance=") == 0) {
+      options.tolerance = parseUnsigned(argument, 12);
+    } else {
+      throw std::runtime_error("Unrecognized option: " + argument);
+    }
+  }
+
+  if (options.modelFilePaths.empty()) {
+    throw std::runtime_error(
+        "Incorrect arguments; at least one argument (path to model) is "
+        "expected");
+  }
+
+  if (options.updateBaseline && options.baselineFilePath.empty()) {
+    throw std::runtime_error("--update-baseline needs --baseline=path");
+  }
+
+  if (options.modelLoadModes.empty()) {
+    options.modelLoadModes = {ModelFactory::MODEL_LOAD_MODE::STREAM,
+                              ModelFactory::MODEL_LOAD_MODE::MAPPED,
+                              ModelFactory::MODEL_LOAD_MODE::PARALLEL};
+  }
+
+  return options;
+}
+
+unsigned parseUnsigned(const std::string& argument, size_t valueOffset) {
+  try {
+    size_t parsedLength;
+    unsigned long value =
+        std::stoul(argument.substr(valueOffset), &parsedLength);
+    if (parsedLength == argument.size() - valueOffset) {
+      return value;
+    }
+  } catch (const std::exception&) {
+  }
+
+  throw std::runtime_error("Invalid value in option: " + argument);
+}
+
+// Records each stage's triangles/s in stageResults
+void benchmark(const std::string& modelFilePath, const BenchOptions& options,
+               std::map<std::string, double>& stageResults) {
+  const double fileSize = MappedFile(modelFilePath).size() / MEGABYTE;
+
+  //// Parse with each loader; the last one's model is kept for the other
+  //// stages
+  Model model;
+  std::vector<double> parseTimes;
+  for (ModelFactory::MODEL_LOAD_MODE modelLoadMode : options.modelLoadModes) {
+    double parseTime = INFINITY;
+    for (unsigned run = 0; run < options.runCount; ++run) {
+      std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+      ModelFactory modelFactory(modelFilePath, modelLoadMode);
+      model = modelFactory.takeModel();
+      parseTime = std::min(parseTime, millisecondsSince(start));
+    }
+    parseTimes.push_back(parseTime);
+  }
+
+  const size_t triangleCount = model.getTriangleCount();
+  std::cout << modelFilePath << ": " << fileSize << " MB, "
+            << model.getVertices().size() / 3 << " vertices, "
+            << triangleCount << " triangles" << std::endl;
+  for (size_t i = 0; i < parseTimes.size(); ++i) {
+    std::string stage =
+        "parse-" + getModelLoadModeName(options.modelLoadModes[i]);
+    stageResults[stage] =
+        reportStage(stage, parseTimes[i], fileSize, triangleCount);
+  }
+
+  //// Build the same model again through the interface an importer uses
+  std::vector<float>& vertices = model.getVertices();
+  std::vector<float>& colors = model.getColors();
+  std::vector<uint32_t>& indices = model.getIndices();
+  double buildTime = INFINITY;
+  for (unsigned run = 0; run < options.runCount; ++run) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    Model builtModel;
+    builtModel.setName(model.getName());
+    for (size_t i = 0; i < vertices.size(); i += 3) {
+      if (colors.empty()) {
+        builtModel.addVertex(vertices[i], vertices[i + 1], vertices[i + 2]);
+      } else {
+        builtModel.addVertex(vertices[i], vertices[i + 1], vertices[i + 2],
+                             colors[i], colors[i + 1], colors[i + 2]);
+      }
+    }
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      builtModel.addTriangle(indices[i], indices[i + 1], indices[i + 2]);
+    }
+    buildTime = std::min(buildTime, millisecondsSince(start));
+  }
+  stageResults["build"] =
+      reportStage("build", buildTime, fileSize, triangleCount);
+
+  //// Write it back out
+  const std::string outputFilePath = modelFilePath + ".parseBench.obj";
+  double writeTime = INFINITY;
+  for (unsigned run = 0; run < options.runCount; ++run) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    model.writeToFile(outputFilePath);
+    writeTime = std::min(writeTime, millisecondsSince(start));
+  }
+  const double writtenSize = MappedFile(outputFilePath).size() / MEGABYTE;
+  std::remove(outputFilePath.c_str());
+  stageResults["write"] =
+      reportStage("write", writeTime, writtenSize, triangleCount);
+}
+
+// Prints the stage's throughput; returns its triangles/s
+double reportStage(const std::string& stage, double time, double size,
+                   size_t triangleCount) {
+  const double seconds = time / 1000;
+  std::cout << "  " << stage << ": " << time << " ms, " << size / seconds
+            << " MB/s, " << triangleCount / seconds / 1e6 << " M triangles/s"
+            << std::endl;
+  return triangleCount / seconds;
+}
+
+std::string getModelLoadModeName(ModelFactory::MODEL_LOAD_MODE modelLoadMode) {
+  switch (modelLoadMode) {
+    case ModelFactory::MODEL_LOAD_MODE::STREAM:
+      return "stream";
+    case ModelFactory::MODEL_LOAD_MODE::MAPPED:
+      return "mmap";
+    case ModelFactory::MODEL_LOAD_MODE::PARALLEL:
+      return "parallel";
+    default:
+      throw std::runtime_error("Unrecognized model load mode");
+  }
+}
+
+// Baselines are keyed by file name, so that the same generated models can be
+// kept anywhere
+std::string getFileName(const std::string& filePath) {
+  size_t directoryEnd = filePath.find_last_of('/');
+  return directoryEnd == std::string::npos ? filePath
+                                           : filePath.substr(directoryEnd + 1);
+}
+
+// One "<model file name> <stage> <triangles/s>" line per stage; a missing
+// file is an empty baseline
+Results readBaseline(const std::string& baselineFilePath) {
+  Results baseline;
+  std::ifstream baselineStream(baselineFilePath);
+  std::string line;
+  while (std::getline(baselineStream, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    std::istringstream lineStream(line);
+    std::string modelFileName, stage;
+    double trianglesPerSecond;
+    if (!(lineStream >> modelFileName >> stage >> trianglesPerSecond)) {
+      throw std::runtime_error("Invalid baseline line: " + line);
+    }
+    baseline[modelFileName][stage] = trianglesPerSecond;
+  }
+
+  return baseline;
+}
+
+void writeBaseline(const std::string& baselineFilePath,
+                   const Results& results) {
+  std::ofstream baselineStream(baselineFilePath);
+  baselineStream << "# parseBench baseline: model file name, stage, "
+                    "triangles/s"
+                 << std::endl;
+  for (const auto& modelResults : results) {
+    for (const auto& stageResult : modelResults.second) {
+      baselineStream << modelResults.first << " " << stageResult.first << " "
+                     << std::llround(stageResult.second) << std::endl;
+    }
+  }
+
+  if (!baselineStream) {
+    throw std::runtime_error("Failed to write baseline file: " +
+                             baselineFilePath);
+  }
+}
+
+// Returns false if any stage with a baseline has regressed past the
+// tolerance; stages without one are only reported
+bool checkBaseline(const Results& baseline, const Results& results,
+                   double tolerance) {
+  bool passed = true;
+  for (const auto& modelResults : results) {
+    for (const auto& stageResult : modelResults.second) {
+      std::string name = modelResults.first + " " + stageResult.first;
+      auto modelBaseline = baseline.find(modelResults.first);
+      if (modelBaseline == baseline.end() ||
+          modelBaseline->second.count(stageResult.first) == 0) {
+        std::cout << name << ": no baseline" << std::endl;
+        continue;
+      }
+
+      double expected = modelBaseline->second.at(stageResult.first);
+      double change = 100.0 * (stageResult.second - expected) / expected;
+      bool regressed = change < -tolerance;
+      std::cout << name << ": " << (change >= 0.0 ? "+" : "") << change
+                << "% against the baseline" << (regressed ? ", REGRESSED" : "")
+                << std::endl;
+      passed &= !regressed;
+    }
+  }
+
+  return passed;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
\ No newline at end of file
@@ -0,0 +1,432 @@
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Camera.hpp"
+#include "FrameBenchmark.hpp"
+#include "FrameProfiler.hpp"
+#include "HeadlessContext.hpp"
+#include "Scene.hpp"
+#include "ShaderProgram.hpp"
+#include "ViewerControls.hpp"
+#include "ViewerOptions.hpp"
+
+// Vertex attribute locations; an instance's transformation takes four, one
+// per column
+#define POSITION_ATTRIBUTE 0
+#define COLOR_ATTRIBUTE 1
+#define INSTANCE_TRANSFORM_ATTRIBUTE 2
+
+// The fixed function pipeline has no instancing, so the scene is drawn by a
+// shader that applies each instance's transformation before the modelview
+// matrix, then fogs the result as the other viewers do
+static const char* VERTEX_SHADER_SOURCE = R"(
+#version 130
+
+in vec3 position;
+in vec3 color;
+in mat4 instanceTransform;
+
+out vec3 vertexColor;
+out float eyeDepth;
+
+void main() {
+  vec4 scenePosition = instanceTransform * vec4(position, 1.0);
+  gl_Position = gl_ModelViewProjectionMatrix * scenePosition;
+  eyeDepth = -(gl_ModelViewMatrix * scenePosition).z;
+  vertexColor = color;
+}
+)";
+
+static const char* FRAGMENT_SHADER_SOURCE = R"(
+#version 130
+
+const float FOG_START = 10.0;
+const float FOG_END = 11.0;
+
+in vec3 vertexColor;
+in float eyeDepth;
+
+out vec4 fragmentColor;
+
+void main() {
+  // Linear fog towards black
+  float fog = clamp((FOG_END - eyeDepth) / (FOG_END - FOG_START), 0.0, 1.0);
+  fragmentColor = vec4(vertexColor * fog, 1.0);
+}
+)";
+
+// GL objects of one of the scene's models
+struct MeshBuffers {
+  GLuint vertexArray;
+  GLuint buffers[3];
+  GLsizei indexCount;
+  GLsizei instanceCount;
+  bool hasVertexColors;
+  std::vector<float> uniformColor;
+};
+
+#define VERTICES 0
+#define INDICES 1
+#define INSTANCES 2
+
+static std::vector<MeshBuffers> meshBuffers;
+static std::unique_ptr<ShaderProgram> sceneShaderProgram;
+
+// With --profile or --profile-trace, or once 'g' is pressed; the overlay
+// keeps frames coming, so that its times stay current
+enum PROFILED_SECTION { CLEAR_SECTION, DRAW_SECTION, SWAP_SECTION };
+static std::unique_ptr<FrameProfiler> frameProfiler;
+static bool showProfile = false;
+
+ViewerOptions viewerOptions;
+Camera camera;
+Scene scene;
+
+void drawScene(void);
+void renderScene(void);
+void resize(int, int);
+void keyInput(unsigned char, int, int);
+void specialKeyInput(int key, int x, int y);
+void setup(void);
+
+void runBenchmark(double loadTime);
+double millisecondsSince(std::chrono::steady_clock::time_point start);
+void startProfiling(void);
+void beginProfiledSection(PROFILED_SECTION section);
+void endProfiledSection(void);
+void drawProfileOverlay(void);
+
+int main(int argc, char** argv) {
+  viewerOptions = ViewerOptions(argc, argv);
+
+  std::chrono::steady_clock::time_point loadStart =
+      std::chrono::steady_clock::now();
+  scene = Scene(viewerOptions.getModelFilePath(),
+                viewerOptions.getModelLoadMode(),
+                viewerOptions.getUseModelCache(),
+                viewerOptions.getOptimizeVertexCache());
+  double loadTime = millisecondsSince(loadStart);
+
+  std::cout << "Scene: " << scene.getInstanceCount() << " instances of "
+            << scene.getMeshes().size() << " models" << std::endl;
+
+  if (viewerOptions.getBenchmarkFrameCount() > 0) {
+    runBenchmark(loadTime);
+    return 0;
+  }
+
+  glutInit(&argc, argv);
+  glutInitContextVersion(3, 3);
+  glutInitContextProfile(GLUT_COMPATIBILITY_PROFILE);
+  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
+
+  glutInitWindowSize(500, 500);
+  glutInitWindowPosition(100, 100);
+
+  glutCreateWindow(viewerOptions.getModelFilePath().c_str());
+
+  glutDisplayFunc(drawScene);
+  glutReshapeFunc(resize);
+  glutKeyboardFunc(keyInput);
+
+  glutSpecialFunc(specialKeyInput);
+
+  // todo: needed?
+  glewExperimental = GL_TRUE;
+  glewInit();
+
+  setup();
+
+  glutMainLoop();
+}
+
+void setup(void) {
+  // Instanced drawing and attribute divisors are core from 3.3 on; without
+  // them their entry points are null
+  if (!GLEW_VERSION_3_3) {
+    throw std::runtime_error(
+        "The scene viewer needs OpenGL 3.3 for instanced drawing");
+  }
+
+  glClearColor(0.0, 0.0, 0.0, 0.0);
+
+  sceneShaderProgram.reset(new ShaderProgram(
+      VERTEX_SHADER_SOURCE, FRAGMENT_SHADER_SOURCE,
+      {{POSITION_ATTRIBUTE, "position"},
+       {COLOR_ATTRIBUTE, "color"},
+       {INSTANCE_TRANSFORM_ATTRIBUTE, "instanceTransform"}}));
+
+  //// Upload each model once, with the transformations of all its instances
+  meshBuffers.clear();
+  for (Scene::SceneMesh& mesh : scene.getMeshes()) {
+    MeshBuffers buffers;
+    std::vector<float>& vertexVector = mesh.model.getVertices();
+    std::vector<float>& colorVector = mesh.model.getColors();
+    std::vector<uint32_t>& indices = mesh.model.getIndices();
+
+    buffers.indexCount = indices.size();
+    buffers.instanceCount = mesh.instanceTransforms.size();
+    buffers.hasVertexColors = mesh.model.hasVertexColors();
+    buffers.uniformColor = mesh.model.getUniformColor();
+
+    glGenVertexArrays(1, &buffers.vertexArray);
+    glBindVertexArray(buffers.vertexArray);
+    glGenBuffers(3, buffers.buffers);
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.buffers[VERTICES]);
+    glBufferData(GL_ARRAY_BUFFER,
+                 (vertexVector.size() + colorVector.size()) * sizeof(float),
+                 NULL, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, vertexVector.size() * sizeof(float),
+                    vertexVector.data());
+    glBufferSubData(GL_ARRAY_BUFFER, vertexVector.size() * sizeof(float),
+                    colorVector.size() * sizeof(float), colorVector.data());
+
+    glEnableVertexAttribArray(POSITION_ATTRIBUTE);
+    glVertexAttribPointer(POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+    // Models without per-vertex colors take their uniform color as a
+    // constant attribute when drawn
+    if (buffers.hasVertexColors) {
+      glEnableVertexAttribArray(COLOR_ATTRIBUTE);
+      glVertexAttribPointer(COLOR_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, 0,
+                            (GLvoid*)(vertexVector.size() * sizeof(float)));
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.buffers[INDICES]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t),
+                 indices.data(), GL_STATIC_DRAW);
+
+    //// One transformation per instance, advancing once per instance
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.buffers[INSTANCES]);
+    glBufferData(GL_ARRAY_BUFFER,
+                 mesh.instanceTransforms.size() * sizeof(Eigen::Matrix4f),
+                 mesh.instanceTransforms.data(), GL_STATIC_DRAW);
+
+    for (int column = 0; column < 4; ++column) {
+      GLuint attribute = INSTANCE_TRANSFORM_ATTRIBUTE + column;
+      glEnableVertexAttribArray(attribute);
+      glVertexAttribPointer(attribute, 4, GL_FLOAT, GL_FALSE,
+                            sizeof(Eigen::Matrix4f),
+                            (GLvoid*)(column * 4 * sizeof(float)));
+      glVertexAttribDivisor(attribute, 1);
+    }
+
+    glBindVertexArray(0);
+    meshBuffers.push_back(buffers);
+  }
+
+  glEnable(GL_DEPTH_TEST);
+
+  // Move the scene into the viewing frustum
+  scene.translate(std::vector<float>{0, 0, -10});
+
+  //// Scale the scene to fit within screen
+  std::vector<float> sceneDimensions = scene.getDimensions();
+  float maxDimension = std::max(
+      std::max(sceneDimensions[0], sceneDimensions[1]), sceneDimensions[2]);
+
+  std::vector<float> scale =
+      std::vector<float>{1 / maxDimension, 1 / maxDimension, 1 / maxDimension};
+  scale[0] *= 1.25;
+  scale[1] *= 1.25;
+  scale[2] *= 1.25;
+
+  scene.scale(scale);
+
+  if (viewerOptions.getProfileFrames()) {
+    startProfiling();
+    showProfile = viewerOptions.getShowProfile();
+  }
+}
+
+void drawScene(void) {
+  if (frameProfiler) {
+    frameProfiler->beginFrame();
+  }
+
+  renderScene();
+  drawProfileOverlay();
+
+  beginProfiledSection(SWAP_SECTION);
+  glutSwapBuffers();
+  endProfiledSection();
+
+  if (frameProfiler) {
+    frameProfiler->endFrame();
+  }
+
+  if (showProfile) {
+    glutPostRedisplay();
+  }
+}
+
+void renderScene(void) {
+  ViewerControls::positionCamera(camera);
+
+  beginProfiledSection(CLEAR_SECTION);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  endProfiledSection();
+
+  beginProfiledSection(DRAW_SECTION);
+
+  glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+  glPushMatrix();
+
+  ViewerControls::place(scene);
+
+  // One call per model, however many instances it has
+  sceneShaderProgram->use();
+  for (const MeshBuffers& buffers : meshBuffers) {
+    glBindVertexArray(buffers.vertexArray);
+    if (!buffers.hasVertexColors) {
+      glVertexAttrib3fv(COLOR_ATTRIBUTE, buffers.uniformColor.data());
+    }
+
+    glDrawElementsInstanced(GL_TRIANGLES, buffers.indexCount, GL_UNSIGNED_INT,
+                            0, buffers.instanceCount);
+  }
+  glBindVertexArray(0);
+  glUseProgram(0);
+
+  glPopMatrix();
+
+  endProfiledSection();
+}
+
+// Renders the benchmark script offscreen, instead of opening a window, and
+// prints its timings
+void runBenchmark(double loadTime) {
+  FrameBenchmark frameBenchmark(viewerOptions.getBenchmarkFrameCount());
+  frameBenchmark.setLoadTime(loadTime);
+
+  HeadlessContext headlessContext(500, 500);
+
+  std::chrono::steady_clock::time_point setupStart =
+      std::chrono::steady_clock::now();
+  setup();
+  glFinish();
+  frameBenchmark.setSetupTime(millisecondsSince(setupStart));
+
+  frameBenchmark.startScript(camera);
+  resize(500, 500);
+  for (unsigned frame = 0; frame < frameBenchmark.getFrameCount(); ++frame) {
+    frameBenchmark.advance(scene, camera);
+
+    frameBenchmark.beginFrame();
+    if (frameProfiler) {
+      frameProfiler->beginFrame();
+    }
+    renderScene();
+    glFinish();
+    frameBenchmark.endFrame();
+    if (frameProfiler) {
+      frameProfiler->endFrame();
+    }
+  }
+
+  frameBenchmark.writeReport(std::cout, "sceneViewer",
+                             viewerOptions.getModelFilePath());
+
+  // Before the context goes
+  sceneShaderProgram.reset();
+  if (frameProfiler) {
+    for (const std::string& line : frameProfiler->getSummary()) {
+      std::cout << line << std::endl;
+    }
+    frameProfiler.reset();
+  }
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+void startProfiling(void) {
+  frameProfiler.reset(new FrameProfiler(
+      {"clear", "draw", "swap"}, viewerOptions.getProfileTraceFilePath()));
+  if (!frameProfiler->hasGpuTimer()) {
+    std::cout << "No timer queries in this GL; profiling the CPU only"
+              << std::endl;
+  }
+}
+
+void beginProfiledSection(PROFILED_SECTION section) {
+  if (frameProfiler) {
+    frameProfiler->beginSection(section);
+  }
+}
+
+void endProfiledSection(void) {
+  if (frameProfiler) {
+    frameProfiler->endSection();
+  }
+}
+
+// In the top left corner, over everything
+void drawProfileOverlay(void) {
+  if (!showProfile) {
+    return;
+  }
+
+  glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT);
+  glDisable(GL_DEPTH_TEST);
+
+  // The raster position takes the current color
+  glColor3f(1.0, 1.0, 0.0);
+  int lineY = glutGet(GLUT_WINDOW_HEIGHT);
+  for (const std::string& line : frameProfiler->getSummary()) {
+    lineY -= 15;
+    glWindowPos2i(5, lineY);
+    glutBitmapString(GLUT_BITMAP_8_BY_13,
+                     reinterpret_cast<const unsigned char*>(line.c_str()));
+  }
+
+  glPopAttrib();
+}
+
+void resize(int w, int h) {
+  glViewport(0, 0, w, h);
+  ViewerControls::positionCamera(camera);
+}
+
+void keyInput(unsigned char key, int x, int y) {
+  if (ViewerControls::handleKey(key, scene, camera)) {
+    glutPostRedisplay();  // re-draw scene
+    return;
+  }
+
+  switch (key) {
+    case 'q':
+      exit(0);
+      break;
+    case 'g':
+      if (!frameProfiler) {
+        startProfiling();
+      }
+      showProfile = !showProfile;
+
+      glutPostRedisplay();  // re-draw scene
+      break;
+    default:
+      break;
+  }
+}
+
+void specialKeyInput(int key, int x, int y) {
+  ViewerControls::handleSpecialKey(key, scene);
+
+  glutPostRedisplay();  // re-draw scene
+}
\ No newline at end of file